@@ -35,18 +35,7 @@ EmptyTimedTextGenerator::~EmptyTimedTextGenerator(){
 
 int EmptyTimedTextGenerator::GenerateEmptyXml()
 {
-    try
-    {
-        XMLPlatformUtils::Initialize();
-    }
-    catch(const XMLException& e)
-    {
-        char* message = XMLString::transcode(e.getMessage());
-        qDebug() << "Error Message: " << message << "\n";
-        XMLString::release(&message);
-        return 1;
-    }
-
+    // Xerces is initialized once in main().
     int error = 0;
     {
         DOMImplementation* impl =  DOMImplementationRegistry::getDOMImplementation(Xuni("Core"));
@@ -133,8 +122,6 @@ int EmptyTimedTextGenerator::GenerateEmptyXml()
        }
     }
 
-    XMLPlatformUtils::Terminate();
-
     return error;
 }
 
@@ -25,6 +25,19 @@
 #include <QToolTip>
 #include "JP2K_Preview.h"
 
+namespace
+{
+
+//! Draws rText at rPosition (base line) on top of rBackground. Only the bounding rect of the text is filled.
+void draw_backed_text(QPainter *pPainter, const QPointF &rPosition, const QString &rText, const QColor &rBackground) {
+
+	if(rText.isEmpty() == true) return;
+	pPainter->fillRect(QFontMetricsF(pPainter->font()).boundingRect(rText).translated(rPosition), rBackground);
+	pPainter->drawText(rPosition, rText);
+}
+
+}
+
 AbstractGraphicsWidgetResource::AbstractGraphicsWidgetResource(GraphicsWidgetSequence *pParent, cpl2016::BaseResourceType *pResource, const QSharedPointer<AssetMxfTrack> &rAsset /*= QSharedPointer<AssetMxfTrack>(NULL)*/, const QColor &rColor /*= QColor(Qt::white)*/) :
 GraphicsWidgetBase(pParent), mpData(pResource), mAssset(rAsset), mColor(rColor), mOldEntryPoint(), mOldSourceDuration(-1), mpLeftTrimHandle(NULL), mpRightTrimHandle(NULL), mpDurationIndicator(NULL), mpVerticalIndicator(NULL) {
 
@@ -722,7 +735,7 @@ std::auto_ptr<cpl2016::BaseResourceType> GraphicsWidgetFileResource::Write() con
 
 GraphicsWidgetVideoResource::GraphicsWidgetVideoResource(GraphicsWidgetSequence *pParent, cpl2016::TrackFileResourceType *pResource, const QSharedPointer<AssetMxfTrack> &rAsset /*= QSharedPointer<AssetMxfTrack>(NULL)*/, int video_timeline_index) :
 mpJP2K(0), // (k)
-GraphicsWidgetFileResource(pParent, pResource, rAsset, QColor(CPL_COLOR_VIDEO_RESOURCE)), mLeftProxyImage(":/proxy_film.png"), mRightProxyImage(":/proxy_film.png"), mTrimActive(false) {
+GraphicsWidgetFileResource(pParent, pResource, rAsset, QColor(CPL_COLOR_VIDEO_RESOURCE)), mProxyImages(QList<QImage>() << QImage(":/proxy_film.png")), mThumbnails(), mThumbnailHeight(0), mTrimActive(false) {
 
 
 
@@ -734,7 +747,7 @@ GraphicsWidgetFileResource(pParent, pResource, rAsset, QColor(CPL_COLOR_VIDEO_RE
 
 	connect(decodeProxyThread, SIGNAL(started()), mpJP2K, SLOT(getProxy()));
 	connect(mpJP2K, SIGNAL(finished()), decodeProxyThread, SLOT(quit()));
-	connect(mpJP2K, SIGNAL(proxyFinished(const QImage&, const QImage&)), this, SLOT(rShowProxyImage(const QImage&, const QImage&)));
+	connect(mpJP2K, SIGNAL(proxyFinished(const QList<QImage>&)), this, SLOT(rShowProxyImage(const QList<QImage>&)));
 
 	connect(this, SIGNAL(SourceDurationChanged(const Duration&, const Duration&)), this, SLOT(rSourceDurationChanged()));
 	connect(this, SIGNAL(EntryPointChanged(const Duration&, const Duration&)), this, SLOT(rEntryPointChanged()));
@@ -745,7 +758,7 @@ GraphicsWidgetFileResource(pParent, pResource, rAsset, QColor(CPL_COLOR_VIDEO_RE
 
 GraphicsWidgetVideoResource::GraphicsWidgetVideoResource(GraphicsWidgetSequence *pParent, const QSharedPointer<AssetMxfTrack> &rAsset) :
 mpJP2K(0), // (k)
-GraphicsWidgetFileResource(pParent, rAsset, QColor(CPL_COLOR_VIDEO_RESOURCE)), mLeftProxyImage(":/proxy_film.png"), mRightProxyImage(":/proxy_film.png"), mTrimActive(false) {
+GraphicsWidgetFileResource(pParent, rAsset, QColor(CPL_COLOR_VIDEO_RESOURCE)), mProxyImages(QList<QImage>() << QImage(":/proxy_film.png")), mThumbnails(), mThumbnailHeight(0), mTrimActive(false) {
 
 
 	mpJP2K = new JP2K_Preview(); // (k)
@@ -755,7 +768,7 @@ GraphicsWidgetFileResource(pParent, rAsset, QColor(CPL_COLOR_VIDEO_RESOURCE)), m
 
 	connect(decodeProxyThread, SIGNAL(started()), mpJP2K, SLOT(getProxy()));
 	connect(mpJP2K, SIGNAL(finished()), decodeProxyThread, SLOT(quit()));
-	connect(mpJP2K, SIGNAL(proxyFinished(const QImage&, const QImage&)), this, SLOT(rShowProxyImage(const QImage&, const QImage&)));
+	connect(mpJP2K, SIGNAL(proxyFinished(const QList<QImage>&)), this, SLOT(rShowProxyImage(const QList<QImage>&)));
 
 	connect(this, SIGNAL(SourceDurationChanged(const Duration&, const Duration&)), this, SLOT(rSourceDurationChanged()));
 	connect(this, SIGNAL(EntryPointChanged(const Duration&, const Duration&)), this, SLOT(rEntryPointChanged()));
@@ -784,19 +797,30 @@ void GraphicsWidgetVideoResource::paint(QPainter *pPainter, const QStyleOptionGr
 		visible_rect.adjust(0, 0, -1. / pPainter->transform().m11(), -1. / pPainter->transform().m22());
 		if(visible_rect.isEmpty() == true) continue;
 
-		// scale proxy images (k)
-		QImage left_proxy_image = mLeftProxyImage.scaledToHeight(boundingRect().height() - 3, Qt::SmoothTransformation);
-		QImage right_proxy_image = mRightProxyImage.scaledToHeight(boundingRect().height() - 3, Qt::SmoothTransformation);
-
 		QTransform transf = pPainter->transform();
 
-		QRectF left_proxy_image_rect(QPointF((resource_rect.left() * transf.m11() + offset) * 1 / transf.m11(), resource_rect.topLeft().y() + 1), QSizeF(left_proxy_image.width() * 1 / transf.m11(), left_proxy_image.height()));
-		QRectF right_proxy_image_rect(QPointF((resource_rect.right() * transf.m11() - right_proxy_image.width() - offset - 1) * 1 / transf.m11(), resource_rect.topRight().y() + 1), QSizeF(right_proxy_image.width() * 1 / transf.m11(), right_proxy_image.height()));
+		// thumbnail strip (k): thumbnails are drawn unscaled on screen at their own width, each one picked by its position in the strip
+		const QVector<QPixmap> &r_thumbnails = GetThumbnails(boundingRect().height() - 3);
+		QRectF strip_rect(QPointF((resource_rect.left() * transf.m11() + offset) / transf.m11(), resource_rect.top() + 1), QPointF((resource_rect.right() * transf.m11() - offset - 1) / transf.m11(), resource_rect.top() + 1 + r_thumbnails.first().height()));
+		QVector<int> strip_thumbnails; // indices into r_thumbnails, left to right
+		qreal strip_used = 0;
+		while(strip_rect.width() > 0) {
+			const int index = qBound(0, (int)(strip_used / strip_rect.width() * r_thumbnails.size()), r_thumbnails.size() - 1);
+			const qreal thumbnail_width = r_thumbnails.at(index).width() / transf.m11();
+			if(thumbnail_width <= 0 || strip_used + thumbnail_width > strip_rect.width()) break;
+			strip_thumbnails.append(index);
+			strip_used += thumbnail_width;
+		}
+		if(strip_thumbnails.isEmpty() == false) {
+			const qreal gap = (strip_rect.width() - strip_used) / strip_thumbnails.size(); // spread the remaining space evenly
+			qreal thumbnail_left = strip_rect.left() + gap / 2;
+			for(int j = 0; j < strip_thumbnails.size() && thumbnail_left <= visible_rect.right(); j++) {
+				const QPixmap &r_thumbnail = r_thumbnails.at(strip_thumbnails.at(j));
+				const QRectF thumbnail_rect(thumbnail_left, strip_rect.top(), r_thumbnail.width() / transf.m11(), strip_rect.height());
+				if(visible_rect.intersects(thumbnail_rect)) pPainter->drawPixmap(thumbnail_rect, r_thumbnail, r_thumbnail.rect());
+				thumbnail_left += thumbnail_rect.width() + gap;
+			}
 
-		if(left_proxy_image_rect.right() <= right_proxy_image_rect.left()) {
-			if(visible_rect.intersects(left_proxy_image_rect)) pPainter->drawImage(left_proxy_image_rect, left_proxy_image);
-			if(visible_rect.intersects(right_proxy_image_rect))	pPainter->drawImage(right_proxy_image_rect, right_proxy_image);
-		
 			// (k) - start
 			if (!proxysVisible) {
 				proxysVisible = true; // (so proxies don't get loaded twice...)
@@ -804,17 +828,17 @@ void GraphicsWidgetVideoResource::paint(QPainter *pPainter, const QStyleOptionGr
 			}
 			// (k) - end
 		}
-		else {
-			left_proxy_image_rect.setWidth(0);
-			right_proxy_image_rect.setLeft(right_proxy_image_rect.right());
-		}
 
 		QFontMetricsF font_metrics(pPainter->font());
-		QRectF writable_rect(left_proxy_image_rect.topRight(), right_proxy_image_rect.bottomLeft());
+		QRectF writable_rect(strip_rect);
 		writable_rect.adjust(5 / transf.m11(), 0, -5 / transf.m11(), -2);
 
 		if(writable_rect.isEmpty() == false) {
 
+			// keep the text readable on top of the thumbnails
+			QColor text_background(CPL_COLOR_VIDEO_RESOURCE);
+			text_background.setAlpha(170);
+
 			QString duration(font_metrics.elidedText(tr("Dur.: %1").arg(MapToCplTimeline(GetSourceDuration()).GetCount()), Qt::ElideLeft, writable_rect.width() * transf.m11()));
 			QString file_name;
 			if(mAssset && mAssset->HasAffinity()) {
@@ -833,19 +857,19 @@ void GraphicsWidgetVideoResource::paint(QPainter *pPainter, const QStyleOptionGr
 			QString resource_in_point(font_metrics.elidedText(tr("In: %1").arg(Timecode(GetEditRate(), GetEntryPoint()).GetAsString()), Qt::ElideRight, writable_rect.width() * transf.m11() - font_metrics.width(cpl_out_point)));
 
 			pPainter->setTransform(QTransform(transf).scale(1 / transf.m11(), 1).translate(writable_rect.left() * transf.m11(), writable_rect.top() + font_metrics.height())); // We have to use QTransform::translate() because of bug 192573.
-			pPainter->drawText(QPointF(0, 0), file_name);
+			draw_backed_text(pPainter, QPointF(0, 0), file_name, text_background);
 			pPainter->setTransform(QTransform(transf).scale(1 / transf.m11(), 1).translate((writable_rect.right() * transf.m11() - font_metrics.width(duration)), writable_rect.top() + font_metrics.height()));
-			pPainter->drawText(QPointF(0, 0), duration);
+			draw_backed_text(pPainter, QPointF(0, 0), duration, text_background);
 
 			pPainter->setTransform(QTransform(transf).scale(1 / transf.m11(), 1).translate(writable_rect.left() * transf.m11(), writable_rect.bottom()));
-			pPainter->drawText(QPointF(0, 0), cpl_in_point);
+			draw_backed_text(pPainter, QPointF(0, 0), cpl_in_point, text_background);
 			pPainter->setTransform(QTransform(transf).scale(1 / transf.m11(), 1).translate((writable_rect.right() * transf.m11() - font_metrics.width(cpl_out_point)), writable_rect.bottom()));
-			pPainter->drawText(QPointF(0, 0), cpl_out_point);
+			draw_backed_text(pPainter, QPointF(0, 0), cpl_out_point, text_background);
 
 			pPainter->setTransform(QTransform(transf).scale(1 / transf.m11(), 1).translate(writable_rect.left() * transf.m11(), writable_rect.top()));
-			pPainter->drawText(QPointF(0, 35), resource_in_point);
+			draw_backed_text(pPainter, QPointF(0, 35), resource_in_point, text_background);
 			pPainter->setTransform(QTransform(transf).scale(1 / transf.m11(), 1).translate((writable_rect.right() * transf.m11() - font_metrics.width(resource_out_point)), writable_rect.top()));
-			pPainter->drawText(QPointF(0, 35), resource_out_point);
+			draw_backed_text(pPainter, QPointF(0, 35), resource_out_point, text_background);
 
 			pPainter->setTransform(transf);
 		}
@@ -857,11 +881,26 @@ double GraphicsWidgetVideoResource::ResourceErPerCompositionEr(const EditRate &r
 	return 1;
 }
 
-void GraphicsWidgetVideoResource::rShowProxyImage(const QImage &firstProxy, const QImage &secondProxy) {
+void GraphicsWidgetVideoResource::rShowProxyImage(const QList<QImage> &rProxies) {
 
-	mLeftProxyImage = firstProxy;
-	mRightProxyImage = secondProxy;
+	if(rProxies.isEmpty()) return;
+	mProxyImages = rProxies;
+	mThumbnails.clear(); // scaled again on next paint
 	update();
+}
+
+const QVector<QPixmap>& GraphicsWidgetVideoResource::GetThumbnails(int height) {
+
+	height = qMax(1, height);
+	if(mThumbnails.isEmpty() || mThumbnailHeight != height) {
+		mThumbnails.clear();
+		mThumbnails.reserve(mProxyImages.size());
+		for(int i = 0; i < mProxyImages.size(); i++) {
+			mThumbnails.append(QPixmap::fromImage(mProxyImages.at(i).scaledToHeight(height, Qt::SmoothTransformation)));
+		}
+		mThumbnailHeight = height;
+	}
+	return mThumbnails;
 }
 
 GraphicsWidgetVideoResource* GraphicsWidgetVideoResource::Clone() const {
@@ -869,8 +908,7 @@ GraphicsWidgetVideoResource* GraphicsWidgetVideoResource::Clone() const {
 	cpl2016::TrackFileResourceType intermediate_resource(*(static_cast<cpl2016::TrackFileResourceType*>(mpData)));
 	intermediate_resource.setId(ImfXmlHelper::Convert(QUuid::createUuid()));
 	GraphicsWidgetVideoResource *p_resource = new GraphicsWidgetVideoResource(NULL, intermediate_resource._clone(), mAssset);
-	p_resource->mLeftProxyImage = mLeftProxyImage;
-	p_resource->mRightProxyImage = mRightProxyImage;
+	p_resource->mProxyImages = mProxyImages;
 	p_resource->update();
 	return p_resource;
 }
@@ -909,15 +947,17 @@ void GraphicsWidgetVideoResource::RefreshProxy() {
 
 	if (decodeProxyThread->isRunning()) decodeProxyThread->quit();
 
-	// first proxy
-	Timecode first_frame = GetFirstVisibleFrame();
-	mpJP2K->mFirst_proxy = first_frame.GetTargetFrame(); // set frame number
-
-	// second proxy
-	Timecode last_frame = GetLastVisibleFrame();
-	mpJP2K->mSecond_proxy = last_frame.GetTargetFrame(); // set frame number
+	// thumbnail strip: evenly spaced over the visible frames
+	const qint64 first_frame = GetFirstVisibleFrame().GetTargetFrame();
+	const qint64 last_frame = GetLastVisibleFrame().GetTargetFrame();
+	const int count = (int)qBound<qint64>(1, last_frame - first_frame + 1, thumbnail_count);
+	QList<qint64> frames;
+	for(int i = 0; i < count; i++) {
+		frames.append(count > 1 ? first_frame + (last_frame - first_frame) * i / (count - 1) : first_frame);
+	}
+	mpJP2K->setProxyFrames(frames);
 
-	// start decoding process
+	// start decoding process (a running getProxy() picks up the new frames)
 	decodeProxyThread->start(QThread::LowPriority);
 }
 
@@ -19,6 +19,7 @@
 #include "ImfPackage.h"
 #include "GraphicsViewScaleable.h"
 #include "JP2K_Preview.h" // (k)
+#include <QPixmap>
 
 class GraphicsWidgetSequence;
 
@@ -211,11 +212,16 @@ private:
 };
 
 
+/*! \brief
+Video resource showing a strip of GraphicsWidgetVideoResource::thumbnail_count proxy frames evenly spaced over its visible source frames.
+The thumbnails are decoded at reduced resolution once, scaled to the track height once and drawn unscaled for the exposed rect only.
+*/
 class GraphicsWidgetVideoResource : public GraphicsWidgetFileResource {
 
 	Q_OBJECT
 
 public:
+	static const int thumbnail_count = 12; // frames of the thumbnail strip
 	//! Import existing Resource. pResource is owned by this.
 	GraphicsWidgetVideoResource(GraphicsWidgetSequence *pParent, cpl2016::TrackFileResourceType *pResource, const QSharedPointer<AssetMxfTrack> &rAsset = QSharedPointer<AssetMxfTrack>(NULL), int video_timeline_index = 0);
 	//! Creates new Resource.
@@ -228,7 +234,7 @@ public:
 	void RefreshProxy();
 
 	private slots:
-	void rShowProxyImage(const QImage&, const QImage&);
+	void rShowProxyImage(const QList<QImage>&);
 	void rSourceDurationChanged();
 	void rEntryPointChanged();
 
@@ -241,11 +247,14 @@ private:
 	Q_DISABLE_COPY(GraphicsWidgetVideoResource);
 	void RefreshFirstProxy();
 	void RefreshSecondProxy();
+	//! Thumbnails scaled to height (cached until the height or the proxies change).
+	const QVector<QPixmap>& GetThumbnails(int height);
 
 	JP2K_Preview *mpJP2K; // (k) JP2K decoder
 	QThread *decodeProxyThread;
-	QImage mLeftProxyImage;
-	QImage mRightProxyImage;
+	QList<QImage> mProxyImages; // thumbnail strip
+	QVector<QPixmap> mThumbnails; // mProxyImages scaled to mThumbnailHeight
+	int mThumbnailHeight;
 	bool mTrimActive;
 	bool proxysVisible = false; // default
 };
@@ -0,0 +1,344 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "HashEngine.h"
+#include "global.h"
+#include <QtGlobal>
+#include <QGlobalStatic>
+#include <QDataStream>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif // Q_OS_UNIX
+
+#define HASH_CACHE_FILE_NAME "hash_cache.dat"
+#define HASH_CACHE_MAGIC 0x48434331 // "HCC1"
+#define HASH_CACHE_MAX_ENTRIES 100000
+
+Q_GLOBAL_STATIC(HashCache, theHashCache)
+
+
+#ifdef IMFTOOL_OPENSSL_SHA1
+
+Sha1Hasher::Sha1Hasher() :
+mpContext(EVP_MD_CTX_new()) {
+
+	EVP_DigestInit_ex(mpContext, EVP_sha1(), NULL);
+}
+
+Sha1Hasher::~Sha1Hasher() {
+
+	EVP_MD_CTX_free(mpContext);
+}
+
+void Sha1Hasher::AddData(const char *pData, qint64 length) {
+
+	if(length > 0) EVP_DigestUpdate(mpContext, pData, (size_t)length);
+}
+
+QByteArray Sha1Hasher::Result() {
+
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_length = 0;
+	EVP_DigestFinal_ex(mpContext, digest, &digest_length);
+	return QByteArray((const char*)digest, (int)digest_length);
+}
+
+void Sha1Hasher::Reset() {
+
+	EVP_DigestInit_ex(mpContext, EVP_sha1(), NULL);
+}
+
+QString Sha1Hasher::GetBackendName() {
+
+	return "OpenSSL";
+}
+
+#else
+
+Sha1Hasher::Sha1Hasher() :
+mHash(QCryptographicHash::Sha1) {
+
+}
+
+Sha1Hasher::~Sha1Hasher() {
+
+}
+
+void Sha1Hasher::AddData(const char *pData, qint64 length) {
+
+	// QCryptographicHash::addData() takes an int length.
+	while(length > 0) {
+		int chunk = (int)qMin<qint64>(length, 1024 * 1024 * 1024);
+		mHash.addData(pData, chunk);
+		pData += chunk;
+		length -= chunk;
+	}
+}
+
+QByteArray Sha1Hasher::Result() {
+
+	return mHash.result();
+}
+
+void Sha1Hasher::Reset() {
+
+	mHash.reset();
+}
+
+QString Sha1Hasher::GetBackendName() {
+
+	return "QCryptographicHash";
+}
+
+#endif // IMFTOOL_OPENSSL_SHA1
+
+ReadAheadReader::ReadAheadReader(const QString &rFilePath, qint64 blockSize /*= 8 * 1024 * 1024*/, int blockCount /*= 3*/, QObject *pParent /*= NULL*/) :
+QThread(pParent), mFile(rFilePath), mFileSize(0), mBlockSize(blockSize), mBlocks(qMax(2, blockCount), NULL), mBlockLength(qMax(2, blockCount), 0),
+mFreeBlocks(qMax(2, blockCount)), mUsedBlocks(0), mConsumerIndex(0), mError(0), mCanceled(0), mErrorString() {
+
+	// Page aligned blocks allow the OS to transfer directly into our buffers (no intermediate copy for unbuffered reads).
+	for(int i = 0; i < mBlocks.size(); i++) {
+		mBlocks[i] = (char*)qMallocAligned(mBlockSize, 4096);
+	}
+}
+
+ReadAheadReader::~ReadAheadReader() {
+
+	Cancel();
+	wait();
+	for(int i = 0; i < mBlocks.size(); i++) {
+		qFreeAligned(mBlocks[i]);
+	}
+}
+
+bool ReadAheadReader::Open() {
+
+	for(int i = 0; i < mBlocks.size(); i++) {
+		if(mBlocks.at(i) == NULL) {
+			mErrorString = tr("Couldn't allocate read buffer.");
+			mError = 1;
+			return false;
+		}
+	}
+	if(mFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered) == false) {
+		mErrorString = mFile.errorString();
+		mError = 1;
+		return false;
+	}
+	mFileSize = mFile.size();
+	start();
+	return true;
+}
+
+void ReadAheadReader::run() {
+
+	int index = 0;
+	forever {
+		mFreeBlocks.acquire();
+		qint64 length = 0;
+		if(mCanceled == 0) {
+			while(length < mBlockSize) {
+				qint64 count = mFile.read(mBlocks[index] + length, mBlockSize - length);
+				if(count < 0) {
+					mErrorString = mFile.errorString();
+					mError = 1;
+					length = 0;
+					break;
+				}
+				if(count == 0) break; // EOF
+				length += count;
+			}
+		}
+		mBlockLength[index] = length;
+		mUsedBlocks.release();
+		// An empty block marks EOF (or error/cancellation).
+		if(length == 0) break;
+		index = (index + 1) % mBlocks.size();
+	}
+	mFile.close();
+}
+
+bool ReadAheadReader::NextBlock(const char *&rpData, qint64 &rLength) {
+
+	mUsedBlocks.acquire();
+	rpData = mBlocks.at(mConsumerIndex);
+	rLength = mBlockLength.at(mConsumerIndex);
+	if(rLength <= 0 || mCanceled == 1) {
+		mUsedBlocks.release(); // Subsequent calls return false as well.
+		return false;
+	}
+	return true;
+}
+
+void ReadAheadReader::ReleaseBlock() {
+
+	mConsumerIndex = (mConsumerIndex + 1) % mBlocks.size();
+	mFreeBlocks.release();
+}
+
+void ReadAheadReader::Cancel() {
+
+	mCanceled = 1;
+	mFreeBlocks.release(mBlocks.size());
+}
+
+bool hash_file(const QString &rFilePath, QByteArray &rHash, QString *pErrorString /*= NULL*/, const HashProgressCallback &rProgress /*= HashProgressCallback()*/, HashFileReport *pReport /*= NULL*/) {
+
+	HashFileReport report;
+	const FileIdentity identity = FileIdentity::FromFile(QFileInfo(rFilePath));
+	ReadAheadReader reader(rFilePath);
+	if(reader.Open() == false) {
+		if(pErrorString) *pErrorString = reader.GetErrorString();
+		report.status = HashFileReport::OpenError;
+		if(pReport) *pReport = report;
+		return false;
+	}
+	Sha1Hasher hasher;
+	QElapsedTimer timer;
+	const qint64 file_size = reader.GetFileSize();
+	int last_progress = -1;
+	const char *p_data = NULL;
+	qint64 count = 0;
+	timer.start();
+	forever {
+		if(QThread::currentThread()->isInterruptionRequested()) {
+			report.status = HashFileReport::Canceled;
+			break;
+		}
+		const qint64 wait_start = timer.nsecsElapsed();
+		const bool has_data = reader.NextBlock(p_data, count);
+		report.ioWaitNs += timer.nsecsElapsed() - wait_start;
+		if(has_data == false) break;
+		hasher.AddData(p_data, count);
+		reader.ReleaseBlock();
+		report.bytesHashed += count;
+		const int progress = file_size > 0 ? (int)(report.bytesHashed * 100 / file_size) : 100;
+		if(rProgress && progress != last_progress && rProgress(report.bytesHashed, file_size) == false) {
+			report.status = HashFileReport::Canceled;
+			break;
+		}
+		last_progress = progress;
+	}
+	report.elapsedNs = qMax<qint64>(1, timer.nsecsElapsed());
+	if(report.status == HashFileReport::Canceled) {
+		reader.Cancel();
+		if(pErrorString) *pErrorString = QObject::tr("Hash calculation interrupted.");
+	}
+	else if(reader.HasError() == true) {
+		report.status = HashFileReport::ReadError;
+		if(pErrorString) *pErrorString = reader.GetErrorString();
+	}
+	if(pReport) *pReport = report;
+	if(report.status != HashFileReport::Success) return false;
+	rHash = hasher.Result();
+	HashCache::GetGlobalInstance()->Insert(QFileInfo(rFilePath), identity, rHash);
+	return true;
+}
+
+FileIdentity FileIdentity::FromFile(const QFileInfo &rFile) {
+
+	FileIdentity identity;
+	QFileInfo file(rFile.absoluteFilePath()); // Don't use cached values.
+	if(file.exists() == false || file.isFile() == false) return identity;
+	identity.size = file.size();
+	identity.modified = file.lastModified().toMSecsSinceEpoch();
+#ifdef Q_OS_UNIX
+	struct stat file_stat;
+	if(::stat(QFile::encodeName(file.absoluteFilePath()).constData(), &file_stat) == 0) {
+		identity.inode = (quint64)file_stat.st_ino ^ ((quint64)file_stat.st_dev << 32);
+	}
+#endif // Q_OS_UNIX
+	return identity;
+}
+
+HashCache::HashCache() :
+mMutex(), mEntries(), mCacheFilePath(get_app_data_location().absoluteFilePath(HASH_CACHE_FILE_NAME)), mIsDirty(false) {
+
+	Load();
+}
+
+HashCache::~HashCache() {
+
+	Save();
+}
+
+HashCache* HashCache::GetGlobalInstance() {
+
+	return theHashCache();
+}
+
+QByteArray HashCache::Lookup(const QFileInfo &rFile) {
+
+	FileIdentity identity = FileIdentity::FromFile(rFile);
+	if(identity.IsValid() == false) return QByteArray();
+	QMutexLocker locker(&mMutex);
+	QHash<QString, Entry>::const_iterator it = mEntries.constFind(rFile.absoluteFilePath());
+	if(it != mEntries.constEnd() && it->identity == identity) return it->hash;
+	return QByteArray();
+}
+
+void HashCache::Insert(const QFileInfo &rFile, const FileIdentity &rIdentity, const QByteArray &rHash) {
+
+	// The file might have been modified while it was hashed.
+	if(rIdentity.IsValid() == false || FileIdentity::FromFile(rFile) != rIdentity) return;
+	QMutexLocker locker(&mMutex);
+	if(mEntries.size() >= HASH_CACHE_MAX_ENTRIES) mEntries.clear();
+	Entry entry;
+	entry.identity = rIdentity;
+	entry.hash = rHash;
+	mEntries.insert(rFile.absoluteFilePath(), entry);
+	mIsDirty = true;
+}
+
+void HashCache::Load() {
+
+	QFile file(mCacheFilePath);
+	if(file.open(QIODevice::ReadOnly) == false) return;
+	QDataStream stream(&file);
+	quint32 magic = 0;
+	qint32 count = 0;
+	stream >> magic >> count;
+	if(magic != HASH_CACHE_MAGIC || count < 0) {
+		qWarning() << "Ignoring invalid hash cache" << mCacheFilePath;
+		return;
+	}
+	for(qint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+		QString path;
+		Entry entry;
+		stream >> path >> entry.identity.size >> entry.identity.modified >> entry.identity.inode >> entry.hash;
+		if(stream.status() == QDataStream::Ok) mEntries.insert(path, entry);
+	}
+}
+
+void HashCache::Save() {
+
+	QMutexLocker locker(&mMutex);
+	if(mIsDirty == false) return;
+	QSaveFile file(mCacheFilePath);
+	if(file.open(QIODevice::WriteOnly) == false) {
+		qWarning() << "Couldn't write hash cache" << mCacheFilePath;
+		return;
+	}
+	QDataStream stream(&file);
+	stream << (quint32)HASH_CACHE_MAGIC << (qint32)mEntries.size();
+	for(QHash<QString, Entry>::const_iterator it = mEntries.constBegin(); it != mEntries.constEnd(); ++it) {
+		stream << it.key() << it->identity.size << it->identity.modified << it->identity.inode << it->hash;
+	}
+	if(file.commit() == true) mIsDirty = false;
+}
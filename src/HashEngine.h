@@ -0,0 +1,164 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QThread>
+#include <QFile>
+#include <QSemaphore>
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QFileInfo>
+#include <functional>
+
+#ifdef IMFTOOL_OPENSSL_SHA1
+#include <openssl/evp.h>
+#else
+#include <QCryptographicHash>
+#endif // IMFTOOL_OPENSSL_SHA1
+
+
+//! Incremental SHA-1. Uses OpenSSL (SHA-NI/SIMD accelerated) if IMFTOOL_OPENSSL_SHA1 is defined, QCryptographicHash otherwise.
+class Sha1Hasher {
+
+public:
+	Sha1Hasher();
+	~Sha1Hasher();
+	void AddData(const char *pData, qint64 length);
+	//! Finalizes the digest. Call Reset() before reusing the hasher.
+	QByteArray Result();
+	void Reset();
+	static QString GetBackendName();
+
+private:
+	Q_DISABLE_COPY(Sha1Hasher);
+
+#ifdef IMFTOOL_OPENSSL_SHA1
+	EVP_MD_CTX *mpContext;
+#else
+	QCryptographicHash mHash;
+#endif // IMFTOOL_OPENSSL_SHA1
+};
+
+
+/*! \brief
+Reads a file sequentially on a separate thread into a ring of large, page aligned blocks so that IO and hash computation overlap.
+The consumer calls ReadAheadReader::NextBlock() and ReadAheadReader::ReleaseBlock() alternately.
+*/
+class ReadAheadReader : public QThread {
+
+	Q_OBJECT
+
+public:
+	ReadAheadReader(const QString &rFilePath, qint64 blockSize = 8 * 1024 * 1024, int blockCount = 3, QObject *pParent = NULL);
+	virtual ~ReadAheadReader();
+	//! Opens the file and starts reading ahead.
+	bool Open();
+	qint64 GetFileSize() const { return mFileSize; }
+	//! Blocks until the next block is available. Returns false on EOF or error. rpData and rLength are valid until ReadAheadReader::ReleaseBlock().
+	bool NextBlock(const char *&rpData, qint64 &rLength);
+	void ReleaseBlock();
+	bool HasError() const { return mError == 1; }
+	QString GetErrorString() const { return mErrorString; }
+	void Cancel();
+
+protected:
+	virtual void run();
+
+private:
+	Q_DISABLE_COPY(ReadAheadReader);
+
+	QFile mFile;
+	qint64 mFileSize;
+	const qint64 mBlockSize;
+	QVector<char*> mBlocks;
+	QVector<qint64> mBlockLength;
+	QSemaphore mFreeBlocks;
+	QSemaphore mUsedBlocks;
+	int mConsumerIndex;
+	QAtomicInteger<int> mError;
+	QAtomicInteger<int> mCanceled;
+	QString mErrorString;
+};
+
+
+//! Progress of hash_file(): bytes hashed so far and file size. Return false to cancel the calculation.
+typedef std::function<bool(qint64 bytesHashed, qint64 fileSize)> HashProgressCallback;
+
+//! Outcome and throughput of a hash_file() call.
+struct HashFileReport {
+	enum eStatus {
+		Success = 0,
+		OpenError,
+		ReadError,
+		Canceled //!< Interruption of the current thread or canceled by the HashProgressCallback.
+	};
+	HashFileReport() : status(Success), bytesHashed(0), elapsedNs(0), ioWaitNs(0) {}
+	eStatus status;
+	qint64 bytesHashed;
+	qint64 elapsedNs;
+	qint64 ioWaitNs; // time the hasher waited for the reader
+};
+
+//! Calculates the SHA-1 of a whole file using ReadAheadReader and inserts it into the HashCache. rProgress is invoked whenever the progress (percent) changes. Returns false on read error, interruption of the current thread or cancellation.
+bool hash_file(const QString &rFilePath, QByteArray &rHash, QString *pErrorString = NULL, const HashProgressCallback &rProgress = HashProgressCallback(), HashFileReport *pReport = NULL);
+
+
+//! Identifies the content of a file without reading it. If any member changes the file must be rehashed.
+struct FileIdentity {
+	FileIdentity() : size(-1), modified(-1), inode(0) {}
+	static FileIdentity FromFile(const QFileInfo &rFile);
+	bool IsValid() const { return size >= 0 && modified >= 0; }
+	bool operator==(const FileIdentity &rOther) const { return size == rOther.size && modified == rOther.modified && inode == rOther.inode; }
+	bool operator!=(const FileIdentity &rOther) const { return !(*this == rOther); }
+	qint64 size;
+	qint64 modified; // [ms since epoch]
+	quint64 inode; // 0 if not supported by the platform.
+};
+
+
+/*! \brief
+Process wide, persistent cache of SHA-1 digests keyed by absolute file path and FileIdentity.
+Consult HashCache::Lookup() before a JobCalculateHash is enqueued. JobCalculateHash inserts every digest it calculates.
+The cache is stored in the application data location. This class is thread safe.
+*/
+class HashCache {
+
+public:
+	HashCache();
+	~HashCache();
+	static HashCache* GetGlobalInstance();
+	//! Returns the cached digest or an empty QByteArray if the file is unknown or was modified.
+	QByteArray Lookup(const QFileInfo &rFile);
+	//! rIdentity must be taken BEFORE the file was hashed.
+	void Insert(const QFileInfo &rFile, const FileIdentity &rIdentity, const QByteArray &rHash);
+	//! Writes the cache to disk if it was modified.
+	void Save();
+
+private:
+	Q_DISABLE_COPY(HashCache);
+	struct Entry {
+		FileIdentity identity;
+		QByteArray hash;
+	};
+	void Load();
+
+	QMutex mMutex;
+	QHash<QString, Entry> mEntries;
+	QString mCacheFilePath;
+	bool mIsDirty;
+};
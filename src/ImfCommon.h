@@ -22,6 +22,7 @@
 #include <QObject>
 #include <QPair>
 #include <QVector>
+#include <QUuid>
 #include "openjpeg.h" // (k)
 
 
@@ -374,7 +375,9 @@ typedef struct {
 typedef struct {
 	int type; // 0 = text, 1 = image
 	bool error; // some error ocurred with the content (e.g. no image found)
-	QImage bgImage;
+	QImage bgImage; // null until decoded (see TTMLImageCache)
+	QString bgImageFile; // Mxf track file if wrapped, PNG file otherwise
+	QUuid bgImageId; // ancillary resource (wrapped only)
 	float beg; // (sec. rel. to timeline)
 	float end; // (sec. rel. to timeline)
 	QString text;
@@ -394,11 +397,6 @@ typedef struct {
 	int RepeatCount;
 } TTMLtimelineResource;
 
-typedef struct {
-	int decoded_total = 0;
-	int pending_requests = 0;
-} DecodedFrames;
-
 typedef struct {
 	QString formatted_time; // hh:mm:ss
 	QString fractional_frames; // ff.f
@@ -25,12 +25,19 @@
 #include <QMessageBox>
 #include <QProgressDialog>
 #include <QProcess>
-#include <QTemporaryFile>
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <sstream>
 
 #include "JobQueue.h"
 #include "Jobs.h"
+#include "IngestCache.h"
 #include <xercesc/parsers/XercesDOMParser.hpp>
 #include <xercesc/framework/MemBufInputSource.hpp>
+#include <xercesc/framework/MemBufFormatTarget.hpp>
+#include <xercesc/util/XMLUniDefs.hpp>
+#include <xercesc/util/XMLUni.hpp>
 
 //regxmllibc
 #include <com/sandflow/smpte/regxml/dict/MetaDictionaryCollection.h>
@@ -44,9 +51,95 @@ using namespace rxml;
 
 //WR end
 
+#define XML_SNIFF_SIZE 8192 // [Byte]
+#define METADATA_READ_THREADS 8 // Reading Mxf headers is bound by IO latency (e.g. network shares) rather than CPU.
+#define MXF_TRACK_MAX_PROXIES 64
+
+namespace {
+
+enum XmlRootType {
+	XmlRootUnknown,
+	XmlRootCpl2013,
+	XmlRootCpl2016,
+	XmlRootOpl
+};
+
+//! Classifies an XML document by local name and namespace of its root element. Only the first XML_SNIFF_SIZE bytes are read.
+XmlRootType sniff_xml_root(const QString &rFilePath) {
+
+	QFile file(rFilePath);
+	if(file.open(QIODevice::ReadOnly) == false) return XmlRootUnknown;
+	const QByteArray head = file.read(XML_SNIFF_SIZE);
+	file.close();
+	// Skip XML declaration, processing instructions, comments and DOCTYPE.
+	int pos = 0;
+	forever {
+		pos = head.indexOf('<', pos);
+		if(pos < 0 || pos + 1 >= head.size()) return XmlRootUnknown;
+		if(head.at(pos + 1) == '?') pos = head.indexOf("?>", pos);
+		else if(head.mid(pos + 1, 3) == "!--") pos = head.indexOf("-->", pos);
+		else if(head.at(pos + 1) == '!') pos = head.indexOf('>', pos);
+		else break;
+		if(pos < 0) return XmlRootUnknown;
+	}
+	const int end = head.indexOf('>', pos);
+	if(end < 0) return XmlRootUnknown;
+	const QString tag = QString::fromUtf8(head.mid(pos + 1, end - pos - 1));
+	const QString qualified_name = tag.section(QRegularExpression("[\\s/]"), 0, 0);
+	const QString local_name = qualified_name.section(':', -1);
+	const QString prefix = qualified_name.contains(':') ? qualified_name.section(':', 0, 0) : QString();
+	QRegularExpression ns_attribute(QString("(?:^|\\s)xmlns%1\\s*=\\s*([\"'])([^\"']*)\\1").arg(prefix.isEmpty() ? QString() : ":" + QRegularExpression::escape(prefix)));
+	const QString name_space = ns_attribute.match(tag).captured(2);
+	if(local_name == "CompositionPlaylist") {
+		if(name_space == XML_NAMESPACE_CPL) return XmlRootCpl2016;
+		if(name_space == XML_NAMESPACE_CPL_2013) return XmlRootCpl2013;
+	}
+	else if(local_name == "OutputProfileList" && name_space == XML_NAMESPACE_OPL) return XmlRootOpl;
+	return XmlRootUnknown;
+}
+
+//! Parses a ST 2067-3:2013 CPL as ST 2067-3:2016 CPL by rewriting the namespaces in memory. Returns an empty auto_ptr if the file can't be read, throws on parsing errors.
+std::auto_ptr<cpl2016::CompositionPlaylistType> parse_cpl2013_as_cpl2016(const QString &rFilePath) {
+
+	// This is a Q&D hack pending a more sophisticated solution using proper XSL Transformation.
+	QFile file(rFilePath);
+	if(file.open(QIODevice::ReadOnly) == false) return std::auto_ptr<cpl2016::CompositionPlaylistType>();
+	QByteArray cpl = file.readAll();
+	file.close();
+	cpl.replace(XML_NAMESPACE_CPL_2013, XML_NAMESPACE_CPL);
+	cpl.replace(XML_NAMESPACE_CC_2013, XML_NAMESPACE_CC);
+	std::istringstream stream(std::string(cpl.constData(), cpl.size()));
+	return cpl2016::parseCompositionPlaylist(stream, xml_schema::Flags::dont_validate | xml_schema::Flags::dont_initialize);
+}
+
+//! Serializes pDocument (UTF-8). Returns an empty QByteArray on error.
+QByteArray serialize_dom(const DOMDocument *pDocument) {
+
+	QByteArray ret;
+	if(pDocument == NULL) return ret;
+	static const XMLCh ls[] = {chLatin_L, chLatin_S, chNull};
+	DOMImplementationLS *p_implementation = (DOMImplementationLS*)DOMImplementationRegistry::getDOMImplementation(ls);
+	DOMLSSerializer *p_serializer = p_implementation->createLSSerializer();
+	DOMLSOutput *p_output = p_implementation->createLSOutput();
+	MemBufFormatTarget target;
+	p_output->setByteStream(&target);
+	p_output->setEncoding(XMLUni::fgUTF8EncodingString);
+	try {
+		if(p_serializer->write(pDocument, p_output) == true) ret = QByteArray((const char*)target.getRawBuffer(), (int)target.getLen());
+	}
+	catch(...) {
+		qWarning() << "Couldn't serialize essence descriptor";
+	}
+	p_output->release();
+	p_serializer->release();
+	return ret;
+}
+
+}
+
 
 ImfPackage::ImfPackage(const QDir &rWorkingDir) :
-QAbstractTableModel(NULL), mpAssetMap(NULL), mPackingLists(), mAssetList(), mRootDir(rWorkingDir), mIsDirty(false), mIsIngest(false), mpJobQueue(NULL) {
+QAbstractTableModel(NULL), mpAssetMap(NULL), mPackingLists(), mAssetList(), mAssetIndex(), mRootDir(rWorkingDir), mIsDirty(false), mIsIngest(false), mpJobQueue(NULL), mpIngestCache(NULL) {
 
 	mpAssetMap = new AssetMap(this, mRootDir.absoluteFilePath(ASSET_SEARCH_NAME));
 	QUuid pkl_id = QUuid::createUuid();
@@ -70,10 +163,11 @@ QAbstractTableModel(NULL), mpAssetMap(NULL), mPackingLists(), mAssetList(), mRoo
 	//connect(mpProgressDialog, SIGNAL(canceled()), mpJobQueue, SLOT(InterruptQueue()));
 	mpMsgBox = new QMessageBox();
 	//WR
+	mMetadataPool.setMaxThreadCount(METADATA_READ_THREADS);
 }
 
 ImfPackage::ImfPackage(const QDir &rWorkingDir, const UserText &rIssuer, const UserText &rAnnotationText /*= QString()*/) :
-QAbstractTableModel(NULL), mpAssetMap(NULL), mPackingLists(), mAssetList(), mRootDir(rWorkingDir), mIsDirty(true), mIsIngest(false), mpJobQueue(NULL) {
+QAbstractTableModel(NULL), mpAssetMap(NULL), mPackingLists(), mAssetList(), mAssetIndex(), mRootDir(rWorkingDir), mIsDirty(true), mIsIngest(false), mpJobQueue(NULL), mpIngestCache(NULL) {
 
 	mpAssetMap = new AssetMap(this, mRootDir.absoluteFilePath(ASSET_SEARCH_NAME), rAnnotationText, rIssuer);
 	QUuid pkl_id = QUuid::createUuid();
@@ -85,6 +179,16 @@ QAbstractTableModel(NULL), mpAssetMap(NULL), mPackingLists(), mAssetList(), mRoo
 	mpJobQueue->SetInterruptIfError(true);
 	connect(mpJobQueue, SIGNAL(finished()), this, SLOT(rJobQueueFinished()));
 	mpMsgBox = new QMessageBox();
+	mMetadataPool.setMaxThreadCount(METADATA_READ_THREADS);
+}
+
+ImfPackage::~ImfPackage() {
+
+	// Don't read metadata of assets that are about to be destroyed.
+	mMetadataPool.clear();
+	mMetadataPool.waitForDone();
+	SaveIngestCache();
+	delete mpIngestCache;
 }
 
 ImfError ImfPackage::Ingest() {
@@ -105,8 +209,12 @@ ImfError ImfPackage::Ingest() {
 				if(mPackingLists.at(i) != NULL) mPackingLists.at(i)->deleteLater(); // delete old Packing Lists}
 			}
 			mPackingLists.clear();
+			mMetadataPool.clear(); // Pending results are dismissed in ImfPackage::rMetadataRead().
+			if(mpIngestCache == NULL) mpIngestCache = new IngestCache(mRootDir);
+			else SaveIngestCache(); // Keep the proxies of the assets about to be dismissed.
 			beginResetModel();
 			mAssetList.clear(); // dismiss all Assets
+			mAssetIndex.clear();
 			endResetModel();
 			error = ParseAssetMap(mRootDir.absoluteFilePath(ASSET_SEARCH_NAME));
 		}
@@ -275,6 +383,15 @@ ImfError ImfPackage::ParseAssetMap(const QFileInfo &rAssetMapFilePath) {
 		//WR
 		if(asset_map->getVolumeCount() == 1) {
 			mpAssetMap = new AssetMap(this, rAssetMapFilePath, *asset_map.get()); // add new Asset Map
+			// Index the Asset Map once so that Packing List entries are resolved in constant time.
+			QHash<QUuid, const am::AssetType*> am_assets;
+			am_assets.reserve((int)asset_map->getAssetList().getAsset().size());
+			for(unsigned int i = 0; i < asset_map->getAssetList().getAsset().size(); i++) {
+				const am::AssetType &am_asset = asset_map->getAssetList().getAsset().at(i);
+				const QUuid am_asset_id = ImfXmlHelper::Convert(am_asset.getId());
+				if(am_assets.contains(am_asset_id) == false) am_assets.insert(am_asset_id, &am_asset);
+			}
+			const QString root_path = mRootDir.absolutePath().append("/");
 			// We must find all Packing Lists.
 			for(unsigned int i = 0; i < asset_map->getAssetList().getAsset().size(); i++) {
 				am::AssetType asset = asset_map->getAssetList().getAsset().at(i);
@@ -319,122 +436,96 @@ ImfError ImfPackage::ParseAssetMap(const QFileInfo &rAssetMapFilePath) {
 								AddAsset(QSharedPointer<AssetPkl>(new AssetPkl(packing_list_path, asset)), QUuid()); // PKL Id doesn't matter. It's a new Packing List which cannot be added to an existing PKL.
 								// Add all Assets found in Packing List
 								for(unsigned int i = 0; i < packing_list->getAssetList().getAsset().size(); i++) {
-									pkl2016::AssetType pkl_asset = packing_list->getAssetList().getAsset().at(i);
+									const pkl2016::AssetType &pkl_asset = packing_list->getAssetList().getAsset().at(i);
 									// Find equivalent Asset in Asset Map
-									for(unsigned int ii = 0; ii < asset_map->getAssetList().getAsset().size(); ii++) {
-										am::AssetType am_asset = asset_map->getAssetList().getAsset().at(ii);
-										if(pkl_asset.getId() == am_asset.getId()) {
-											if(am_asset.getChunkList().getChunk().size() == 1) {
-												QFileInfo new_asset_path = QFileInfo(mRootDir.absolutePath().append("/").append(am_asset.getChunkList().getChunk().back().getPath().c_str()));
-												if(pkl_asset.getType().compare(MIME_TYPE_MXF) == 0) {
-													// Add Asset MXF Track
-													QSharedPointer<AssetMxfTrack> mxf_track(new AssetMxfTrack(new_asset_path, am_asset, pkl_asset));
-													AddAsset(mxf_track, ImfXmlHelper::Convert(packing_list->getId()));
+									const am::AssetType *p_am_asset = am_assets.value(ImfXmlHelper::Convert(pkl_asset.getId()), NULL);
+									if(p_am_asset != NULL) {
+										const am::AssetType &am_asset = *p_am_asset;
+										if(am_asset.getChunkList().getChunk().size() == 1) {
+											QFileInfo new_asset_path = QFileInfo(root_path + am_asset.getChunkList().getChunk().back().getPath().c_str());
+											if(pkl_asset.getType().compare(MIME_TYPE_MXF) == 0) {
+												// Add Asset MXF Track
+												QSharedPointer<AssetMxfTrack> mxf_track(new AssetMxfTrack(new_asset_path, am_asset, pkl_asset));
+												AddAsset(mxf_track, ImfXmlHelper::Convert(packing_list->getId()));
+												bool has_essence_descriptor = false;
+												if(RestoreFromIngestCache(mxf_track, has_essence_descriptor) == false) ReadMetadata(mxf_track);
+												//WR
+												if(has_essence_descriptor == false) {
+													JobExtractEssenceDescriptor *p_ed_job_c = new JobExtractEssenceDescriptor(mxf_track->GetPath().absoluteFilePath());
+													p_ed_job_c->SetIdentifier(mxf_track->GetId());
+													connect(p_ed_job_c, SIGNAL(Result(const DOMDocument*, const QVariant&)), mxf_track.data(), SLOT(SetEssenceDescriptor(const DOMDocument*)));
+													connect(p_ed_job_c, SIGNAL(Result(const DOMDocument*, const QVariant&)), this, SLOT(rEssenceDescriptorExtracted(const DOMDocument*, const QVariant&)));
+													mpJobQueue->AddJob(p_ed_job_c);
+												}
+												//WR
+											}
+											else if(pkl_asset.getType().compare(MIME_TYPE_XML) == 0) {
+												// Add CPL or OPL
+												// The root element determines the type (opl or cpl). Every file is parsed exactly once.
+												const QString xml_file_path = new_asset_path.absoluteFilePath();
+												std::auto_ptr< cpl2016::CompositionPlaylistType> cpl_data;
+												bool is_opl = false;
+												XmlParsingError xml_error;
+												try {
+													switch(sniff_xml_root(xml_file_path)) {
+														case XmlRootCpl2016:
+															cpl_data = cpl2016::parseCompositionPlaylist(xml_file_path.toStdString(), xml_schema::Flags::dont_validate | xml_schema::Flags::dont_initialize);
+															break;
+														case XmlRootCpl2013:
+															cpl_data = parse_cpl2013_as_cpl2016(xml_file_path);
+															break;
+														case XmlRootOpl:
+															opl::parseOutputProfileList(xml_file_path.toStdString(), xml_schema::Flags::dont_validate | xml_schema::Flags::dont_initialize);
+															is_opl = true;
+															break;
+														default:
+															break;
+													}
+												}
+												catch(const xml_schema::Parsing &e) { xml_error = XmlParsingError(e); }
+												catch(const xml_schema::ExpectedElement &e) { xml_error = XmlParsingError(e); }
+												catch(const xml_schema::UnexpectedElement &e) { xml_error = XmlParsingError(e); }
+												catch(const xml_schema::ExpectedAttribute &e) { xml_error = XmlParsingError(e); }
+												catch(const xml_schema::UnexpectedEnumerator &e) { xml_error = XmlParsingError(e); }
+												catch(const xml_schema::ExpectedTextContent &e) { xml_error = XmlParsingError(e); }
+												catch(const xml_schema::NoTypeInfo &e) { xml_error = XmlParsingError(e); }
+												catch(const xml_schema::NotDerived &e) { xml_error = XmlParsingError(e); }
+												catch(const xml_schema::NoPrefixMapping &e) { xml_error = XmlParsingError(e); }
+												catch(...) { xml_error = XmlParsingError(XmlParsingError::Unknown); }
+												if(xml_error.IsError() == true) qDebug() << xml_error;
+												const bool is_cpl = cpl_data.get() != NULL;
+												if(is_cpl && !is_opl) {
+													// Add CPL
+													QSharedPointer<AssetCpl> cpl(new AssetCpl(new_asset_path, am_asset, pkl_asset));
+													AddAsset(cpl, ImfXmlHelper::Convert(packing_list->getId()));
 													//WR
-													JobExtractEssenceDescriptor *p_ed_job_c = new JobExtractEssenceDescriptor(mxf_track->GetPath().absoluteFilePath());
-													connect(p_ed_job_c, SIGNAL(Result(const DOMDocument*, const QVariant&)), mxf_track.data(), SLOT(SetEssenceDescriptor(const DOMDocument*)));
-													mpJobQueue->AddJob(p_ed_job_c);
+													mImpEditRates.push_back(ImfXmlHelper::Convert(cpl_data->getEditRate()));
+													qDebug() << "CPL Edit Rate: " << mImpEditRates.last().GetNumerator()  << mImpEditRates.last().GetDenominator();
 													//WR
 												}
-												else if(pkl_asset.getType().compare(MIME_TYPE_XML) == 0) {
-													// Add CPL or OPL
-													// We have to parse the file to determine the type (opl or cpl)
-													bool is_opl = true;
-													bool is_cpl = true;
-													bool is_cpl2013 = true;
-													std::auto_ptr< cpl2016::CompositionPlaylistType> cpl_data;
-													std::auto_ptr< cpl::CompositionPlaylistType> cpl2013_data;
-													try { cpl_data = cpl2016::parseCompositionPlaylist(new_asset_path.absoluteFilePath().toStdString(), xml_schema::Flags::dont_validate | xml_schema::Flags::dont_initialize); }
-													catch(...) { is_cpl = false; }
-													try { cpl2013_data = cpl::parseCompositionPlaylist(new_asset_path.absoluteFilePath().toStdString(), xml_schema::Flags::dont_validate | xml_schema::Flags::dont_initialize); }
-													catch(...) {is_cpl2013 = false;}
-													if (is_cpl2013) {
-														QString tempFile = nullptr;
-														bool conversionError = false;
-															try {
-																// This is a Q&D hack to convert ST 2067-3:2013 CPLs into ST 2067-3:2016 CPLs,
-																// pending a more sophisticated solution using proper XLS Transformation.
-																// QTemporaryFile was causing issues under Windows, the delete cpl2016_file_tmp command is required for Windows
-																QTemporaryFile* cpl2016_file_tmp = new QTemporaryFile();
-																if (!cpl2016_file_tmp->open()) {
-																	qDebug() << "Cant't create temp file at " << cpl2016_file_tmp->fileName();
-																	conversionError = true;
-																	break;
-																}
-																QFile f_in(new_asset_path.absoluteFilePath());
-																if (!f_in.open(QFile::ReadOnly | QFile::Text)) break;
-																QTextStream in(&f_in);
-																QString tempCPL = in.readAll();
-																tempCPL.replace("http://www.smpte-ra.org/schemas/2067-3/2013", "http://www.smpte-ra.org/schemas/2067-3/2016");
-																tempCPL.replace("http://www.smpte-ra.org/schemas/2067-2/2013", "http://www.smpte-ra.org/schemas/2067-2/2016");
-																cpl2016_file_tmp->write(tempCPL.toUtf8());
-																tempFile = cpl2016_file_tmp->fileName();
-																cpl2016_file_tmp->setAutoRemove(false);
-																if (!cpl2016_file_tmp->flush()) {
-																	qDebug() << "Cant't flush to temp file at " << cpl2016_file_tmp->fileName();
-																	conversionError = true;
-																	break;
-																}
-																cpl2016_file_tmp->close();
-																//if the QTemporaryFile instance is not explicitely deleted, it won't be accesible on Windows (weird)
-																delete cpl2016_file_tmp;
-																if (!conversionError)
-																	is_cpl = true;
-															}
-															catch (...) { is_cpl = false; conversionError = true;  qDebug() << "Transformation of 2013 CPL to 2016 CPL failed"; }
-															if (!conversionError) {
-																parse_error = XmlParsingError();
-																try { cpl_data = cpl2016::parseCompositionPlaylist(tempFile.toStdString(), xml_schema::Flags::dont_validate | xml_schema::Flags::dont_initialize); }
-																catch (const xml_schema::Parsing &e) { is_cpl = false; parse_error = XmlParsingError(e); }
-																catch (const xml_schema::ExpectedElement &e) { is_cpl = false; parse_error = XmlParsingError(e); }
-																catch (const xml_schema::UnexpectedElement &e) { is_cpl = false; parse_error = XmlParsingError(e); }
-																catch (const xml_schema::ExpectedAttribute &e) { is_cpl = false; parse_error = XmlParsingError(e); }
-																catch (const xml_schema::UnexpectedEnumerator &e) { is_cpl = false; parse_error = XmlParsingError(e); }
-																catch (const xml_schema::ExpectedTextContent &e) { is_cpl = false; parse_error = XmlParsingError(e); }
-																catch (const xml_schema::NoTypeInfo &e) { is_cpl = false; parse_error = XmlParsingError(e); }
-																catch (const xml_schema::NotDerived &e) { is_cpl = false; parse_error = XmlParsingError(e); }
-																catch (const xml_schema::NoPrefixMapping &e) { is_cpl = false; parse_error = XmlParsingError(e); }
-																catch (...) { is_cpl = false; qDebug() << "Parsing transformed 2016 CPL failed"; }
-																qDebug() << parse_error;
-																try { QFile::remove(tempFile); }
-																catch (...) {} // just ignore..
-															}
-													}
-													try { opl::parseOutputProfileList(new_asset_path.absoluteFilePath().toStdString(), xml_schema::Flags::dont_validate | xml_schema::Flags::dont_initialize); }
-													catch(...) { is_opl = false; }
-													if(is_cpl && !is_opl) {
-														// Add CPL
-														QSharedPointer<AssetCpl> cpl(new AssetCpl(new_asset_path, am_asset, pkl_asset));
-														AddAsset(cpl, ImfXmlHelper::Convert(packing_list->getId()));
-														//WR
-														mImpEditRates.push_back(ImfXmlHelper::Convert(cpl_data->getEditRate()));
-														qDebug() << "CPL Edit Rate: " << mImpEditRates.last().GetNumerator()  << mImpEditRates.last().GetDenominator();
-														//WR
-													}
-													else if(is_opl && !is_cpl) {
-														// Add Opl
-														QSharedPointer<AssetOpl> opl(new AssetOpl(new_asset_path, am_asset, pkl_asset));
-														AddAsset(opl, ImfXmlHelper::Convert(packing_list->getId()));
-													}
-													else {
-														qDebug() << "Unknown " MIME_TYPE_XML " Asset found: " << ImfXmlHelper::Convert(am_asset.getId());
-														error = ImfError(ImfError::UnknownAsset, am_asset.getId().c_str(), true);
-														QSharedPointer<Asset> unknown(new Asset(Asset::unknown, new_asset_path, am_asset, std::auto_ptr<pkl2016::AssetType>(new pkl2016::AssetType(pkl_asset))));
-														AddAsset(unknown, ImfXmlHelper::Convert(packing_list->getId()));
-													}
+												else if(is_opl && !is_cpl) {
+													// Add Opl
+													QSharedPointer<AssetOpl> opl(new AssetOpl(new_asset_path, am_asset, pkl_asset));
+													AddAsset(opl, ImfXmlHelper::Convert(packing_list->getId()));
 												}
 												else {
-													qWarning() << "Unsupported Asset type element " << pkl_asset.getType().c_str() << " found: " << ImfXmlHelper::Convert(am_asset.getId());
+													qDebug() << "Unknown " MIME_TYPE_XML " Asset found: " << ImfXmlHelper::Convert(am_asset.getId());
 													error = ImfError(ImfError::UnknownAsset, am_asset.getId().c_str(), true);
 													QSharedPointer<Asset> unknown(new Asset(Asset::unknown, new_asset_path, am_asset, std::auto_ptr<pkl2016::AssetType>(new pkl2016::AssetType(pkl_asset))));
 													AddAsset(unknown, ImfXmlHelper::Convert(packing_list->getId()));
 												}
 											}
 											else {
-												error = ImfError(ImfError::MultipleChunks, "", true);
-												continue;
+												qWarning() << "Unsupported Asset type element " << pkl_asset.getType().c_str() << " found: " << ImfXmlHelper::Convert(am_asset.getId());
+												error = ImfError(ImfError::UnknownAsset, am_asset.getId().c_str(), true);
+												QSharedPointer<Asset> unknown(new Asset(Asset::unknown, new_asset_path, am_asset, std::auto_ptr<pkl2016::AssetType>(new pkl2016::AssetType(pkl_asset))));
+												AddAsset(unknown, ImfXmlHelper::Convert(packing_list->getId()));
 											}
 										}
+										else {
+											error = ImfError(ImfError::MultipleChunks, "", true);
+											continue;
+										}
 									}
 								}
 								int count = 0;
@@ -446,32 +537,12 @@ ImfError ImfPackage::ParseAssetMap(const QFileInfo &rAssetMapFilePath) {
 									}
 									count ++;
 								}*/
-								foreach(QSharedPointer<Asset> asset, mAssetList) {
-									// TTML XF assets only: Set Edit Rate in metadata object to CPL Edit Rate, re-calculate duration in CPL Edit Rate units
-									// Uses the first CPL Edit Rate in mImpEditRates, this can be an issue in multi-edit rate IMPs
-									QSharedPointer <AssetMxfTrack> assetMxfTrack;
-									try {
-										assetMxfTrack = qSharedPointerCast<AssetMxfTrack>(asset);
-									}
-									catch(...) {
-										qDebug() << "Error in qSharedPointerCast";
-										break;
-									}
-									if (assetMxfTrack && !mImpEditRates.isEmpty()){
-										if (assetMxfTrack->GetEssenceType() == Metadata::TimedText) {
-											if (!assetMxfTrack->GetTimedTextFrameRate().IsValid()) break;  //CPLs arbitrarily expose EssenceType == Metadata::TimedText
-											qDebug() << "Metadata::TimedText" << assetMxfTrack->GetId();
-											assetMxfTrack->SetCplEditRate(mImpEditRates.first());
-											assetMxfTrack->SetEditRate(mImpEditRates.first());
-											if (assetMxfTrack->GetTimedTextFrameRate() != assetMxfTrack->GetEditRate()) {
-												assetMxfTrack->SetDuration(Duration(ceil(assetMxfTrack->GetOriginalDuration().GetCount() / assetMxfTrack->GetTimedTextFrameRate().GetQuotient() * assetMxfTrack->GetEditRate().GetQuotient())));
-												qDebug() << "Warning: SampleRate of Asset" << assetMxfTrack->GetId() << "does not match CPL EditRate!";
-											} else {
-												assetMxfTrack->SetDuration(assetMxfTrack->GetOriginalDuration());
-											}
-										}
-									}
-								}
+								// The Timed Text edit rate fixup (see ImfPackage::ApplyCplEditRate()) is done when the metadata arrives.
+								// Metadata restored from the ingest cache has arrived already.
+								for(int k = 0; k < mAssetList.size(); k++) {
+									QSharedPointer<AssetMxfTrack> restored_track = mAssetList.at(k).objectCast<AssetMxfTrack>();
+									if(restored_track && restored_track->IsMetadataPending() == false) ApplyCplEditRate(restored_track);
+								}
 							}
 							else {
 								qDebug() << parse_error;
@@ -540,6 +611,7 @@ bool ImfPackage::AddAsset(const QSharedPointer<Asset> &rAsset, const QUuid &rPac
 					connect(rAsset.data(), SIGNAL(AssetModified(Asset *)), this, SLOT(rAssetModified(Asset *)));
 					beginInsertRows(QModelIndex(), mAssetList.size(), mAssetList.size());
 					mAssetList.push_back(rAsset);
+					mAssetIndex.insert(rAsset->GetId(), mAssetList.size() - 1);
 					endInsertRows();
 					rAsset->AffinityWon(p_packing_list);
 					rAsset->AffinityWon(mpAssetMap);
@@ -554,6 +626,7 @@ bool ImfPackage::AddAsset(const QSharedPointer<Asset> &rAsset, const QUuid &rPac
 				connect(rAsset.data(), SIGNAL(AssetModified(Asset *)), this, SLOT(rAssetModified(Asset *)));
 				beginInsertRows(QModelIndex(), mAssetList.size(), mAssetList.size());
 				mAssetList.push_back(rAsset);
+				mAssetIndex.insert(rAsset->GetId(), mAssetList.size() - 1);
 				endInsertRows();
 				rAsset->AffinityWon(mpAssetMap);
 			}
@@ -572,9 +645,8 @@ bool ImfPackage::AddAsset(const QSharedPointer<Asset> &rAsset, const QUuid &rPac
 
 QSharedPointer<Asset> ImfPackage::GetAsset(const QUuid &rUuid) {
 
-	for(int i = 0; i < mAssetList.size(); i++) {
-		if(rUuid == mAssetList.at(i)->GetId()) return mAssetList.at(i);
-	}
+	const int index = mAssetIndex.value(rUuid, -1);
+	if(index >= 0) return mAssetList.at(index);
 	return QSharedPointer<Asset>();
 }
 
@@ -594,11 +666,150 @@ void ImfPackage::RemoveAsset(const QUuid &rUuid) {
 			disconnect(mAssetList.at(i).data(), NULL, this, NULL);
 			beginRemoveRows(QModelIndex(), i, i);
 			mAssetList.removeAt(i);
+			RebuildAssetIndex(); // Subsequent rows have moved.
 			endRemoveRows();
 		}
 	}
 }
 
+void ImfPackage::ReadMetadata(const QSharedPointer<AssetMxfTrack> &rAsset) {
+
+	JobReadMetadata *p_job = new JobReadMetadata(rAsset->GetPath().absoluteFilePath());
+	p_job->SetIdentifier(rAsset->GetId());
+	connect(p_job, SIGNAL(Result(const Metadata&, const QVariant&)), this, SLOT(rMetadataRead(const Metadata&, const QVariant&)));
+	mMetadataPool.start(p_job);
+}
+
+void ImfPackage::WaitForMetadata(const QUuid &rCplAssetId) {
+
+	QSharedPointer<Asset> asset_cpl = GetAsset(rCplAssetId);
+	if(asset_cpl.isNull() == true) return;
+	QFile cpl_file(asset_cpl->GetPath().absoluteFilePath());
+	if(cpl_file.open(QFile::ReadOnly | QFile::Text) == false) return;
+	// Only the referenced track files are needed, WidgetComposition parses the Cpl afterwards.
+	const QString cpl_text = QString::fromUtf8(cpl_file.readAll());
+	const QRegularExpression track_file_id("<(?:\\w+:)?TrackFileId>\\s*urn:uuid:([0-9a-fA-F-]{36})\\s*<");
+	QList<QUuid> pending_tracks;
+	QRegularExpressionMatchIterator it = track_file_id.globalMatch(cpl_text);
+	while(it.hasNext()) {
+		const QUuid id(it.next().captured(1));
+		QSharedPointer<AssetMxfTrack> asset = GetAsset(id).objectCast<AssetMxfTrack>();
+		if(asset && asset->IsMetadataPending() == true && pending_tracks.contains(id) == false) pending_tracks.append(id);
+	}
+	if(pending_tracks.isEmpty() == true) return;
+
+	const int track_count = pending_tracks.size();
+	QProgressDialog progress_dialog(tr("Reading metadata of %1 referenced tracks...").arg(track_count), QString(), 0, track_count);
+	progress_dialog.setWindowModality(Qt::ApplicationModal);
+	progress_dialog.setMinimumSize(500, 150);
+	progress_dialog.setMinimumDuration(500);
+	progress_dialog.setValue(0);
+	while(true) {
+		for(int i = pending_tracks.size() - 1; i >= 0; i--) {
+			QSharedPointer<AssetMxfTrack> asset = GetAsset(pending_tracks.at(i)).objectCast<AssetMxfTrack>();
+			if(asset.isNull() == true || asset->IsMetadataPending() == false) pending_tracks.removeAt(i);
+		}
+		if(pending_tracks.isEmpty() == true) break;
+		if(progress_dialog.value() != track_count - pending_tracks.size()) {
+			progress_dialog.setValue(track_count - pending_tracks.size());
+			continue; // A modal dialog processes events in setValue(), results may have been delivered.
+		}
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents); // Delivers the queued results of mMetadataPool.
+	}
+}
+
+void ImfPackage::rMetadataRead(const Metadata &rMetadata, const QVariant &rIdentifier) {
+
+	const QUuid id = rIdentifier.toUuid();
+	QSharedPointer<AssetMxfTrack> asset = GetAsset(id).objectCast<AssetMxfTrack>();
+	if(asset && asset->IsMetadataPending() == true) {
+		// Cache the metadata as read (before the CPL edit rate is applied).
+		if(mpIngestCache && rMetadata.type != Metadata::Unknown_Type) mpIngestCache->InsertMetadata(id, asset->GetPath(), rMetadata);
+		asset->SetMetadata(rMetadata);
+		ApplyCplEditRate(asset);
+		const int row = mAssetIndex.value(id);
+		emit dataChanged(index(row, ImfPackage::ColumnIcon), index(row, ImfPackage::ColumnMax - 1));
+	}
+}
+
+void ImfPackage::rEssenceDescriptorExtracted(const DOMDocument *pDocument, const QVariant &rIdentifier) {
+
+	const QUuid id = rIdentifier.toUuid();
+	QSharedPointer<Asset> asset = GetAsset(id);
+	if(mpIngestCache && asset && pDocument) {
+		const QByteArray essence_descriptor = serialize_dom(pDocument);
+		if(essence_descriptor.isEmpty() == false) mpIngestCache->InsertEssenceDescriptor(id, asset->GetPath(), essence_descriptor);
+	}
+}
+
+bool ImfPackage::RestoreFromIngestCache(const QSharedPointer<AssetMxfTrack> &rAsset, bool &rHasEssenceDescriptor) {
+
+	rHasEssenceDescriptor = false;
+	IngestCache::Entry entry;
+	if(mpIngestCache == NULL || mpIngestCache->Lookup(rAsset->GetId(), rAsset->GetPath(), entry) == false) return false;
+	if(entry.essenceDescriptor.isEmpty() == false) {
+		XercesDOMParser parser;
+		parser.setDoNamespaces(true);
+		MemBufInputSource source((const XMLByte*)entry.essenceDescriptor.constData(), entry.essenceDescriptor.size(), "ingest_cache", false);
+		try {
+			parser.parse(source);
+			if(parser.getErrorCount() == 0 && parser.getDocument() && parser.getDocument()->getDocumentElement()) {
+				rAsset->SetEssenceDescriptor(parser.getDocument()); // Imports the nodes.
+				rHasEssenceDescriptor = true;
+			}
+		}
+		catch(...) {
+			qWarning() << "Ignoring cached essence descriptor of" << rAsset->GetId();
+		}
+	}
+	rAsset->SetProxies(entry.proxies);
+	if(entry.hasMetadata == false) return false;
+	rAsset->SetMetadata(entry.metadata);
+	return true;
+}
+
+void ImfPackage::SaveIngestCache() {
+
+	if(mpIngestCache == NULL) return;
+	for(int i = 0; i < mAssetList.size(); i++) {
+		QSharedPointer<AssetMxfTrack> mxf_track = mAssetList.at(i).objectCast<AssetMxfTrack>();
+		if(mxf_track && mxf_track->GetIsNew() == false) {
+			const QHash<qint64, QImage> proxies = mxf_track->GetProxies();
+			if(proxies.isEmpty() == false) mpIngestCache->InsertProxies(mxf_track->GetId(), mxf_track->GetPath(), proxies);
+		}
+	}
+	mpIngestCache->Save();
+}
+
+void ImfPackage::ApplyCplEditRate(const QSharedPointer<AssetMxfTrack> &rAsset) {
+
+	// TTML XF assets only: Set Edit Rate in metadata object to CPL Edit Rate, re-calculate duration in CPL Edit Rate units
+	// Uses the first CPL Edit Rate in mImpEditRates, this can be an issue in multi-edit rate IMPs
+	if(rAsset && !mImpEditRates.isEmpty()) {
+		if(rAsset->GetEssenceType() == Metadata::TimedText) {
+			if(!rAsset->GetTimedTextFrameRate().IsValid()) return;  //CPLs arbitrarily expose EssenceType == Metadata::TimedText
+			qDebug() << "Metadata::TimedText" << rAsset->GetId();
+			rAsset->SetCplEditRate(mImpEditRates.first());
+			rAsset->SetEditRate(mImpEditRates.first());
+			if(rAsset->GetTimedTextFrameRate() != rAsset->GetEditRate()) {
+				rAsset->SetDuration(Duration(ceil(rAsset->GetOriginalDuration().GetCount() / rAsset->GetTimedTextFrameRate().GetQuotient() * rAsset->GetEditRate().GetQuotient())));
+				qDebug() << "Warning: SampleRate of Asset" << rAsset->GetId() << "does not match CPL EditRate!";
+			} else {
+				rAsset->SetDuration(rAsset->GetOriginalDuration());
+			}
+		}
+	}
+}
+
+void ImfPackage::RebuildAssetIndex() {
+
+	mAssetIndex.clear();
+	mAssetIndex.reserve(mAssetList.size());
+	for(int i = 0; i < mAssetList.size(); i++) {
+		mAssetIndex.insert(mAssetList.at(i)->GetId(), i);
+	}
+}
+
 void ImfPackage::RemoveAsset(int index) {
 
 	if(index < mAssetList.size()) {
@@ -716,6 +927,10 @@ QVariant ImfPackage::data(const QModelIndex &rIndex, int role /*= Qt::DisplayRol
 					}
 				}
 			}
+			else if(role == Qt::ToolTipRole) {
+				QSharedPointer<AssetMxfTrack> p_asset = mAssetList.at(row).objectCast<AssetMxfTrack>();
+				if(p_asset && p_asset->IsMetadataPending() == true) return QVariant(tr("Reading metadata..."));
+			}
 		}
 		else if(column == ImfPackage::ColumnMetadata) {
 			if(role == UserRoleMetadata) {
@@ -808,15 +1023,14 @@ bool ImfPackage::setData(const QModelIndex &rIndex, const QVariant &rValue, int
 void ImfPackage::rAssetModified(Asset *pAsset) {
 
 	if(pAsset) {
-		for(int i = 0; i < mAssetList.size(); i++) {
-			if(*pAsset == *mAssetList.at(i)) {
-				if(mIsIngest == false) {
-					bool old_dirty = mIsDirty;
-					mIsDirty = true;
-					if(old_dirty != true) emit DirtyChanged(true);
-				}
-				emit dataChanged(index(i, ImfPackage::ColumnIcon), index(i, ImfPackage::ColumnMax - 1));
+		const int i = mAssetIndex.value(pAsset->GetId(), -1);
+		if(i >= 0) {
+			if(mIsIngest == false) {
+				bool old_dirty = mIsDirty;
+				mIsDirty = true;
+				if(old_dirty != true) emit DirtyChanged(true);
 			}
+			emit dataChanged(index(i, ImfPackage::ColumnIcon), index(i, ImfPackage::ColumnMax - 1));
 		}
 	}
 }
@@ -868,6 +1082,7 @@ void ImfPackage::rJobQueueFinished() {
 		mpMsgBox->setIcon(QMessageBox::Critical);
 		mpMsgBox->exec();
 	}
+	SaveIngestCache();
 }
 //WR
 
@@ -1121,8 +1336,8 @@ Asset(Asset::opl, rFilePath, rId, rAnnotationText) {
 }
 
 AssetMxfTrack::AssetMxfTrack(const QFileInfo &rFilePath, const am::AssetType &rAmAsset, const pkl2016::AssetType &rPklAsset) :
-Asset(Asset::mxf, rFilePath, rAmAsset, std::auto_ptr<pkl2016::AssetType>(new pkl2016::AssetType(rPklAsset))), mMetadata(), mSourceFiles(), mFirstProxyImage(), mMetadataExtr() {
-	mMetadataExtr.ReadMetadata(mMetadata, rFilePath.absoluteFilePath());
+Asset(Asset::mxf, rFilePath, rAmAsset, std::auto_ptr<pkl2016::AssetType>(new pkl2016::AssetType(rPklAsset))), mMetadata(), mIsMetadataPending(true), mSourceFiles(), mFirstProxyImage(), mMetadataExtr() {
+	// The metadata is read asynchronously (see ImfPackage::ReadMetadata()).
 	SetDefaultProxyImages();
 	//WR begin
 	//New UUID for SourceENcoding
@@ -1134,13 +1349,51 @@ Asset(Asset::mxf, rFilePath, rAmAsset, std::auto_ptr<pkl2016::AssetType>(new pkl
 }
 
 AssetMxfTrack::AssetMxfTrack(const QFileInfo &rFilePath, const QUuid &rId, const UserText &rAnnotationText /*= QString()*/) :
-Asset(Asset::mxf, rFilePath, rId, rAnnotationText), mMetadata(), mSourceFiles(), mFirstProxyImage() {
+Asset(Asset::mxf, rFilePath, rId, rAnnotationText), mMetadata(), mIsMetadataPending(false), mSourceFiles(), mFirstProxyImage() {
 	mSourceEncoding = QUuid::createUuid();
 	mEssenceDescriptor = new cpl2016::EssenceDescriptorBaseType(ImfXmlHelper::Convert(mSourceEncoding));
 	//leave ED empty because file does not exist yet on the file system
 
 }
 
+void AssetMxfTrack::SetMetadata(const Metadata &rMetadata) {
+
+	mMetadata = rMetadata;
+	mIsMetadataPending = false;
+	SetDefaultProxyImages();
+}
+
+QImage AssetMxfTrack::GetProxy(qint64 frameNr) const {
+
+	QMutexLocker locker(&mProxyMutex);
+	if(mProxies.contains(frameNr) == false) return QImage();
+	mProxyUsage.removeOne(frameNr);
+	mProxyUsage.append(frameNr);
+	return mProxies.value(frameNr);
+}
+
+void AssetMxfTrack::InsertProxy(qint64 frameNr, const QImage &rProxy) {
+
+	QMutexLocker locker(&mProxyMutex);
+	if(mProxies.contains(frameNr) == true) mProxyUsage.removeOne(frameNr);
+	else if(mProxies.size() >= MXF_TRACK_MAX_PROXIES) mProxies.remove(mProxyUsage.takeFirst());
+	mProxies.insert(frameNr, rProxy);
+	mProxyUsage.append(frameNr);
+}
+
+QHash<qint64, QImage> AssetMxfTrack::GetProxies() const {
+
+	QMutexLocker locker(&mProxyMutex);
+	return mProxies;
+}
+
+void AssetMxfTrack::SetProxies(const QHash<qint64, QImage> &rProxies) {
+
+	QMutexLocker locker(&mProxyMutex);
+	mProxies = rProxies;
+	mProxyUsage = rProxies.keys();
+}
+
 void AssetMxfTrack::SetSourceFiles(const QStringList &rSourceFiles) {
 
 	if(Exists() == false) {
@@ -1271,53 +1524,10 @@ Error AssetMxfTrack::ExtractEssenceDescriptor(const QString &filePath) {
 	if(file.open(QIODevice::ReadOnly) == false) {
 		return Error(Error::SourceFileOpenError, file.fileName());
 	}
+	file.close();
 	Error error;
 
-	QList<QString> dicts_fname = QList<QString>()
-		<< "www-smpte-ra-org-reg-395-2014-13-1-aaf.xml"
-		<< "www-smpte-ra-org-reg-2003-2012.xml"
-		<< "www-smpte-ra-org-reg-335-2012.xml"
-		<< "www-smpte-ra-org-reg-335-2012-13-1-aaf.xml"
-		;
-
-	XMLPlatformUtils::Initialize();
-
-	XercesDOMParser *parser = new XercesDOMParser();
-
-	parser->setDoNamespaces(true);
-
-	MetaDictionaryCollection mds;
-
-	qDebug() << dicts_fname.size();
-	for (int i = 0; i < dicts_fname.size(); i++) {
-
-		QString dict_path = QApplication::applicationDirPath() + QString("/regxmllib/") + dicts_fname[i];
-		parser->parse(dict_path.toStdString().c_str());
-		DOMDocument *doc = parser->getDocument();
-		MetaDictionary *md = new MetaDictionary();
-		XMLImporter::fromDOM(*doc, *md);
-		mds.addDictionary(md);
-	}
-
-	XMLCh tempStr[3] = { chLatin_L, chLatin_S, chNull };
-	DOMImplementation *impl = DOMImplementationRegistry::getDOMImplementation(tempStr);
-	DOMLSOutput       *output = ((DOMImplementationLS*)impl)->createLSOutput();
-
-	DOMDocument *doc = impl->createDocument();
-
-	std::ifstream f(filePath.toStdString().c_str(), std::ifstream::in | std::ifstream::binary);
-
-	if (!f.good()) {
-		qDebug() << "Can't read file:" << filePath;
-		error = Error(Error::EssenceDescriptorExtraction);
-
-	}
-	static const rxml::UL ESSENCE_DESCRIPTOR_KEY = "urn:smpte:ul:060e2b34.02010101.0d010101.01012400";
-	const rxml::AUID* ed_auid = new rxml::AUID(ESSENCE_DESCRIPTOR_KEY);
-	DOMDocumentFragment* frag = MXFFragmentBuilder::fromInputStream(f, mds, NULL, ed_auid, *doc);
-
-	doc->appendChild(frag);
-
+	DOMDocument *doc = extract_essence_descriptor(filePath, error);
 
 	if(error.IsError() == false) {
 		SetEssenceDescriptor(doc);
@@ -1326,14 +1536,6 @@ Error AssetMxfTrack::ExtractEssenceDescriptor(const QString &filePath) {
 	//doc->release();
 
 
-	/* free heap */
-
-	for (std::map<std::string, MetaDictionary*>::const_iterator it = mds.getDictionatries().begin();
-		it != mds.getDictionatries().end();
-		it++) {
-		delete it->second;
-	}
-	XMLPlatformUtils::Terminate();
 	return error;
 }
 
@@ -27,6 +27,8 @@
 #include <QFileInfo>
 #include <QStringList>
 #include <QList>
+#include <QHash>
+#include <QThreadPool>
 #include <QByteArray>
 #include <QTime>
 #include <QSharedPointer>
@@ -34,6 +36,7 @@
 #include <QAbstractTableModel>
 #include <QUndoCommand>
 #include <QVector>
+#include <QMutex>
 
 #include "JP2K_Preview.h"
 #include <xercesc/dom/DOM.hpp>
@@ -45,7 +48,9 @@ XERCES_CPP_NAMESPACE_USE
 
 
 class Asset;
+class AssetMxfTrack;
 class AssetMap;
+class IngestCache;
 class PackingList;
 class QAbstractItemModel;
 //WR
@@ -77,7 +82,7 @@ public:
 	ImfPackage(const QDir &rWorkingDir);
 	//! Create new IMF package.
 	ImfPackage(const QDir &rWorkingDir, const UserText &rIssuer, const UserText &rAnnotationText = QString());
-	virtual ~ImfPackage() {}
+	virtual ~ImfPackage();
 	//! Check if Imf Package is in an unsaved state
 	bool IsDirty() const { return mIsDirty; }
 	//! Ingests an existing Imf package from file system.
@@ -98,6 +103,8 @@ public:
 	void RemoveAsset(int index);
 	//! Adds Asset. An Asset can only be added once.
 	bool AddAsset(const QSharedPointer<Asset> &rAsset, const QUuid &rPackingListId);
+	//! Waits until the metadata of the Mxf tracks referenced by Cpl rCplAssetId was read (see AssetMxfTrack::IsMetadataPending()). Shows a progress dialog and keeps the event loop running.
+	void WaitForMetadata(const QUuid &rCplAssetId);
 	//! Returns next best Packing List if index is 0.
 	QUuid GetPackingListId(int index = 0);
 	//WR
@@ -119,6 +126,8 @@ signals:
 
 	private slots:
 	void rAssetModified(Asset *pAsset);
+	void rMetadataRead(const Metadata &rMetadata, const QVariant &rIdentifier);
+	void rEssenceDescriptorExtracted(const DOMDocument *pDocument, const QVariant &rIdentifier);
 	//WR
 	void rJobQueueFinished();
 	//WR
@@ -129,10 +138,21 @@ private:
 	QUuid GetPackingListId(PackingList *pPackingList);
 	//! Parses the Ingest Dir (all Assets are added). Expects a valid Asset Map file path.
 	ImfError ParseAssetMap(const QFileInfo &rAssetMapFilePath);
+	//! Must be called whenever rows of mAssetList move.
+	void RebuildAssetIndex();
+	//! Reads the metadata of rAsset asynchronously. ImfPackage::rMetadataRead() receives the result.
+	void ReadMetadata(const QSharedPointer<AssetMxfTrack> &rAsset);
+	//! Timed Text tracks only: Sets the first CPL edit rate and recalculates the duration.
+	void ApplyCplEditRate(const QSharedPointer<AssetMxfTrack> &rAsset);
+	//! Restores metadata, essence descriptor and proxies of rAsset from the IngestCache. Returns false if the metadata must be read.
+	bool RestoreFromIngestCache(const QSharedPointer<AssetMxfTrack> &rAsset, bool &rHasEssenceDescriptor);
+	//! Hands the proxies decoded so far to the IngestCache and writes it.
+	void SaveIngestCache();
 
 	AssetMap						*mpAssetMap;
 	QList<PackingList*>				mPackingLists;
 	QList<QSharedPointer<Asset> >	mAssetList;
+	QHash<QUuid, int>				mAssetIndex; // Asset id -> row in mAssetList
 	const QDir						mRootDir;
 	bool mIsDirty;
 	bool mIsIngest; // Used for suppressing DirtyChanged signals during ingest.
@@ -142,6 +162,8 @@ private:
 	JobQueue *mpJobQueue;
 	QVector<EditRate> mImpEditRates; //required for creating TT assets
 	//WR
+	QThreadPool mMetadataPool;
+	IngestCache *mpIngestCache; // NULL unless ingested
 };
 
 
@@ -350,7 +372,7 @@ class AssetMxfTrack : public Asset {
 	Q_OBJECT
 
 public:
-	//! Import Mxf Track. All imported Tracks are finalized.
+	//! Import Mxf Track. All imported Tracks are finalized. The metadata is pending until AssetMxfTrack::SetMetadata() is invoked.
 	AssetMxfTrack(const QFileInfo &rFilePath, const am::AssetType &rAmAsset, const pkl2016::AssetType &rPklAsset);
 	//! Create New Mxf Track.
 	AssetMxfTrack(const QFileInfo &rFilePath, const QUuid &rId, const UserText &rAnnotationText = QString());
@@ -359,6 +381,10 @@ public:
 	virtual ~AssetMxfTrack() {}
 	//! Returns current metadata.
 	Metadata GetMetadata() const { return mMetadata; }
+	//! Sets the metadata read from the finalized Mxf file.
+	void SetMetadata(const Metadata &rMetadata);
+	//! Returns true while the metadata of an imported Mxf track hasn't been read yet.
+	bool IsMetadataPending() const { return mIsMetadataPending; }
 	//! Returns the Essence type of this Mxf track.
 	Metadata::eEssenceType GetEssenceType() const { return mMetadata.type; }
 	//! Returns the source files.
@@ -381,6 +407,12 @@ public:
 	QString GetProfile() const { return mMetadata.profile; }
 	EditRate GetTimedTextFrameRate() const {return mMetadata.effectiveFrameRate;};
 	QImage GetProxyImage() const { return mFirstProxyImage; }
+	//! Returns the timeline proxy decoded for frameNr or a null image. Thread safe.
+	QImage GetProxy(qint64 frameNr) const;
+	//! Keeps a decoded timeline proxy (see JP2K_Preview::getProxy()). Evicts the least recently used proxy if full. Thread safe.
+	void InsertProxy(qint64 frameNr, const QImage &rProxy);
+	QHash<qint64, QImage> GetProxies() const;
+	void SetProxies(const QHash<qint64, QImage> &rProxies);
 	//WR begin
 	//Getter methods for the corresponding members
 	cpl2016::EssenceDescriptorBaseType* GetEssenceDescriptor() { return mEssenceDescriptor;};
@@ -423,9 +455,13 @@ private:
 
 	JPEG2000 *mpJP2K; // (k) JP2K decoder
 	Metadata		mMetadata;
+	bool			mIsMetadataPending;
 	QStringList mSourceFiles;
 	QImage			mFirstProxyImage;
 	MetadataExtractor mMetadataExtr;
+	mutable QMutex	mProxyMutex;
+	QHash<qint64, QImage> mProxies; // frame number -> timeline proxy
+	mutable QList<qint64> mProxyUsage; // frame numbers of mProxies, least recently used first
 //WR begin
 	//These are member variables for the corresponding CPL elements
 	cpl2016::EssenceDescriptorBaseType* mEssenceDescriptor;
@@ -0,0 +1,191 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "IngestCache.h"
+#include "global.h"
+#include <QDataStream>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QDebug>
+
+#define INGEST_CACHE_DIR_NAME "ingest_cache"
+#define INGEST_CACHE_MAGIC 0x49474331 // "IGC1"
+
+
+namespace {
+
+void write_metadata(QDataStream &rStream, const Metadata &rMetadata) {
+
+	rStream << (qint32)rMetadata.type
+		<< rMetadata.editRate.GetNumerator() << rMetadata.editRate.GetDenominator()
+		<< (qint32)rMetadata.aspectRatio.Numerator << (qint32)rMetadata.aspectRatio.Denominator
+		<< rMetadata.storedWidth << rMetadata.storedHeight << rMetadata.displayWidth << rMetadata.displayHeight
+		<< (qint32)rMetadata.colorEncoding << (qint32)rMetadata.colorSpace << (qint32)rMetadata.colorPrimaries << (qint32)rMetadata.transferCharcteristics
+		<< rMetadata.horizontalSubsampling << rMetadata.componentDepth << rMetadata.duration.GetCount()
+		<< rMetadata.audioChannelCount << rMetadata.audioQuantization;
+	rStream << rMetadata.soundfieldGroup.GetName() << (qint32)rMetadata.soundfieldGroup.GetChannelCount();
+	for(int i = 0; i < rMetadata.soundfieldGroup.GetChannelCount(); i++) rStream << (quint32)rMetadata.soundfieldGroup.GetChannel(i);
+	rStream << rMetadata.fileName << rMetadata.filePath << rMetadata.fileType << rMetadata.profile
+		<< rMetadata.languageTag << rMetadata.mcaTitle << rMetadata.mcaTitleVersion << rMetadata.mcaAudioContentKind << rMetadata.mcaAudioElementKind
+		<< rMetadata.effectiveFrameRate.GetNumerator() << rMetadata.effectiveFrameRate.GetDenominator() << rMetadata.originalDuration.GetCount()
+		<< rMetadata.componentMinRef << rMetadata.componentMaxRef << rMetadata.assetId;
+}
+
+void read_metadata(QDataStream &rStream, Metadata &rMetadata) {
+
+	qint32 type = 0, edit_rate_n = 0, edit_rate_d = 0, aspect_n = 0, aspect_d = 0;
+	qint32 color_encoding = 0, color_space = 0, color_primaries = 0, transfer_characteristics = 0;
+	qint64 duration = 0;
+	rStream >> type >> edit_rate_n >> edit_rate_d >> aspect_n >> aspect_d
+		>> rMetadata.storedWidth >> rMetadata.storedHeight >> rMetadata.displayWidth >> rMetadata.displayHeight
+		>> color_encoding >> color_space >> color_primaries >> transfer_characteristics
+		>> rMetadata.horizontalSubsampling >> rMetadata.componentDepth >> duration
+		>> rMetadata.audioChannelCount >> rMetadata.audioQuantization;
+	rMetadata.type = (Metadata::eEssenceType)type;
+	rMetadata.editRate = EditRate(ASDCP::Rational(edit_rate_n, edit_rate_d));
+	rMetadata.aspectRatio = ASDCP::Rational(aspect_n, aspect_d);
+	rMetadata.colorEncoding = (Metadata::eColorEncoding)color_encoding;
+	rMetadata.colorSpace = (Metadata::eColorSpace)color_space;
+	rMetadata.colorPrimaries = (SMPTE::eColorPrimaries)color_primaries;
+	rMetadata.transferCharcteristics = (SMPTE::eTransferCharacteristic)transfer_characteristics;
+	rMetadata.duration = Duration(duration);
+
+	QString soundfield_group_name;
+	qint32 channel_count = 0;
+	rStream >> soundfield_group_name >> channel_count;
+	rMetadata.soundfieldGroup = SoundfieldGroup::GetSoundFieldGroup(soundfield_group_name);
+	for(qint32 i = 0; i < channel_count && rStream.status() == QDataStream::Ok; i++) {
+		quint32 channel = 0;
+		rStream >> channel;
+		if(channel != 0) rMetadata.soundfieldGroup.AddChannel(i, (SoundfieldGroup::eChannel)channel);
+	}
+
+	qint32 effective_n = 0, effective_d = 0;
+	qint64 original_duration = 0;
+	rStream >> rMetadata.fileName >> rMetadata.filePath >> rMetadata.fileType >> rMetadata.profile
+		>> rMetadata.languageTag >> rMetadata.mcaTitle >> rMetadata.mcaTitleVersion >> rMetadata.mcaAudioContentKind >> rMetadata.mcaAudioElementKind
+		>> effective_n >> effective_d >> original_duration
+		>> rMetadata.componentMinRef >> rMetadata.componentMaxRef >> rMetadata.assetId;
+	rMetadata.effectiveFrameRate = EditRate(ASDCP::Rational(effective_n, effective_d));
+	rMetadata.originalDuration = Duration(original_duration);
+}
+
+}
+
+
+IngestCache::IngestCache(const QDir &rRootDir) :
+mEntries(), mCacheFilePath(), mIsDirty(false) {
+
+	// One cache file per working directory.
+	const QByteArray key = QCryptographicHash::hash(rRootDir.absolutePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+	QDir cache_dir(get_app_data_location());
+	if(cache_dir.mkpath(INGEST_CACHE_DIR_NAME) == true) {
+		mCacheFilePath = cache_dir.absoluteFilePath(QString(INGEST_CACHE_DIR_NAME) + "/" + QString::fromLatin1(key) + ".dat");
+		Load();
+	}
+	else qWarning() << "Couldn't create ingest cache directory in" << cache_dir.absolutePath();
+}
+
+IngestCache::~IngestCache() {
+
+	Save();
+}
+
+bool IngestCache::Lookup(const QUuid &rAssetId, const QFileInfo &rFile, Entry &rEntry) const {
+
+	QHash<QUuid, Entry>::const_iterator it = mEntries.constFind(rAssetId);
+	if(it == mEntries.constEnd()) return false;
+	const FileIdentity identity = FileIdentity::FromFile(rFile);
+	if(identity.IsValid() == false || it->identity != identity) return false;
+	rEntry = *it;
+	return true;
+}
+
+IngestCache::Entry* IngestCache::GetEntry(const QUuid &rAssetId, const QFileInfo &rFile) {
+
+	const FileIdentity identity = FileIdentity::FromFile(rFile);
+	if(identity.IsValid() == false) return NULL;
+	Entry &r_entry = mEntries[rAssetId];
+	if(r_entry.identity != identity) {
+		r_entry = Entry();
+		r_entry.identity = identity;
+	}
+	return &r_entry;
+}
+
+void IngestCache::InsertMetadata(const QUuid &rAssetId, const QFileInfo &rFile, const Metadata &rMetadata) {
+
+	Entry *p_entry = GetEntry(rAssetId, rFile);
+	if(p_entry == NULL) return;
+	p_entry->hasMetadata = true;
+	p_entry->metadata = rMetadata;
+	mIsDirty = true;
+}
+
+void IngestCache::InsertEssenceDescriptor(const QUuid &rAssetId, const QFileInfo &rFile, const QByteArray &rEssenceDescriptor) {
+
+	Entry *p_entry = GetEntry(rAssetId, rFile);
+	if(p_entry == NULL) return;
+	p_entry->essenceDescriptor = rEssenceDescriptor;
+	mIsDirty = true;
+}
+
+void IngestCache::InsertProxies(const QUuid &rAssetId, const QFileInfo &rFile, const QHash<qint64, QImage> &rProxies) {
+
+	Entry *p_entry = GetEntry(rAssetId, rFile);
+	if(p_entry == NULL || p_entry->proxies.keys().toSet() == rProxies.keys().toSet()) return;
+	p_entry->proxies = rProxies;
+	mIsDirty = true;
+}
+
+void IngestCache::Load() {
+
+	QFile file(mCacheFilePath);
+	if(file.open(QIODevice::ReadOnly) == false) return;
+	QDataStream stream(&file);
+	quint32 magic = 0;
+	qint32 count = 0;
+	stream >> magic >> count;
+	if(magic != INGEST_CACHE_MAGIC || count < 0) {
+		qWarning() << "Ignoring invalid ingest cache" << mCacheFilePath;
+		return;
+	}
+	for(qint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+		QUuid id;
+		Entry entry;
+		stream >> id >> entry.identity.size >> entry.identity.modified >> entry.identity.inode >> entry.hasMetadata;
+		if(entry.hasMetadata == true) read_metadata(stream, entry.metadata);
+		stream >> entry.essenceDescriptor >> entry.proxies;
+		if(stream.status() == QDataStream::Ok) mEntries.insert(id, entry);
+	}
+}
+
+void IngestCache::Save() {
+
+	if(mIsDirty == false || mCacheFilePath.isEmpty() == true) return;
+	QSaveFile file(mCacheFilePath);
+	if(file.open(QIODevice::WriteOnly) == false) {
+		qWarning() << "Couldn't write ingest cache" << mCacheFilePath;
+		return;
+	}
+	QDataStream stream(&file);
+	stream << (quint32)INGEST_CACHE_MAGIC << (qint32)mEntries.size();
+	for(QHash<QUuid, Entry>::const_iterator it = mEntries.constBegin(); it != mEntries.constEnd(); ++it) {
+		stream << it.key() << it->identity.size << it->identity.modified << it->identity.inode << it->hasMetadata;
+		if(it->hasMetadata == true) write_metadata(stream, it->metadata);
+		stream << it->essenceDescriptor << it->proxies;
+	}
+	if(file.commit() == true) mIsDirty = false;
+}
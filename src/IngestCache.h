@@ -0,0 +1,62 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include "HashEngine.h"
+#include "MetadataExtractorCommon.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QUuid>
+#include <QImage>
+#include <QByteArray>
+
+
+/*! \brief
+Persistent cache of everything ImfPackage::Ingest() derives from the Mxf tracks of one IMP: metadata, essence descriptors (RegXML) and timeline proxy images.
+Entries are keyed by asset id and dismissed as soon as the FileIdentity (size, mtime, inode) of the track file changes.
+Every working directory gets its own cache file in the application data location. The cache is written in IngestCache::Save() and on destruction.
+*/
+class IngestCache {
+
+public:
+	struct Entry {
+		Entry() : identity(), hasMetadata(false), metadata(), essenceDescriptor(), proxies() {}
+		FileIdentity identity;
+		bool hasMetadata;
+		Metadata metadata; // As read by MetadataExtractor (before any CPL edit rate was applied).
+		QByteArray essenceDescriptor; // RegXML (UTF-8), empty if not extracted yet.
+		QHash<qint64, QImage> proxies; // frame number -> proxy image
+	};
+	IngestCache(const QDir &rRootDir);
+	~IngestCache();
+	//! Returns false if the asset is unknown or its file was modified.
+	bool Lookup(const QUuid &rAssetId, const QFileInfo &rFile, Entry &rEntry) const;
+	void InsertMetadata(const QUuid &rAssetId, const QFileInfo &rFile, const Metadata &rMetadata);
+	void InsertEssenceDescriptor(const QUuid &rAssetId, const QFileInfo &rFile, const QByteArray &rEssenceDescriptor);
+	void InsertProxies(const QUuid &rAssetId, const QFileInfo &rFile, const QHash<qint64, QImage> &rProxies);
+	//! Writes the cache to disk if it was modified.
+	void Save();
+
+private:
+	Q_DISABLE_COPY(IngestCache);
+	//! Returns the entry for rAssetId. The entry is reset if the file was modified. Returns NULL if the file doesn't exist.
+	Entry* GetEntry(const QUuid &rAssetId, const QFileInfo &rFile);
+	void Load();
+
+	QHash<QUuid, Entry> mEntries;
+	QString mCacheFilePath;
+	bool mIsDirty;
+};
@@ -0,0 +1,329 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "JP2K_ColorConversion.h"
+#include "JP2K_Preview.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JP2K_COLOR_CONVERSION_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+
+inline float clamp_f(float value, float min, float max) {
+
+	return value < min ? min : (value > max ? max : value);
+}
+
+inline uchar to_8bit(float value, int precShift) {
+
+	int out = (int)value >> precShift;
+	return (uchar)(out < 0 ? 0 : (out > 255 ? 255 : out));
+}
+
+// Loads one pixel as RGB code values.
+template<bool Ycc>
+inline void load_pixel(const OPJ_INT32 *pC0, const OPJ_INT32 *pC1, const OPJ_INT32 *pC2, int x, int chromaShiftX,
+	float yOffset, float yScale, float chromaMid, float crR, float cbG, float crG, float cbB, float rgbScale, float rgbBias, float &rR, float &rG, float &rB) {
+
+	if (Ycc) {
+		const float y = ((float)pC0[x] - yOffset) * yScale;
+		const float cb = (float)pC1[x >> chromaShiftX] - chromaMid;
+		const float cr = (float)pC2[x >> chromaShiftX] - chromaMid;
+		rR = y + crR * cr;
+		rG = y - cbG * cb - crG * cr;
+		rB = y + cbB * cb;
+	}
+	else {
+		rR = qMax(0.f, (float)pC0[x] * rgbScale + rgbBias);
+		rG = qMax(0.f, (float)pC1[x] * rgbScale + rgbBias);
+		rB = qMax(0.f, (float)pC2[x] * rgbScale + rgbBias);
+	}
+}
+
+}
+
+JP2K_ColorConversion::JP2K_ColorConversion() :
+mpKernel(NULL), mWidth(0), mHeight(0), mChromaStride(0), mChromaShiftX(0), mChromaShiftY(0), mPrecShift(0), mMaxCv(0), mRgbScale(1), mRgbBias(0),
+mYOffset(0), mYScale(1), mChromaMid(0), mCrR(0), mCbG(0), mCrG(0), mCbB(0), mpEotf(NULL), mEotfScale(0), mOetfScale(0), mOutputLut(),
+mOutputLutMax(-1), mOutputLutShift(-1) {
+
+	mpComp[0] = mpComp[1] = mpComp[2] = NULL;
+	for (int i = 0; i < 9; i++) mMatrix[i] = 0;
+}
+
+const char* JP2K_ColorConversion::GetBackendName() {
+
+#ifdef JP2K_COLOR_CONVERSION_SSE2
+	return "SSE2";
+#else
+	return "Scalar";
+#endif
+}
+
+bool JP2K_ColorConversion::Prepare(const JP2 &rJP2, const OPENJPEG_H::opj_image_t *pImage) {
+
+	mpKernel = NULL;
+	if (pImage == NULL || pImage->comps == NULL || pImage->numcomps < 3) return false;
+	for (int i = 0; i < 3; i++) {
+		mpComp[i] = pImage->comps[i].data;
+		if (mpComp[i] == NULL) return false;
+	}
+	mWidth = pImage->comps[0].w;
+	mHeight = pImage->comps[0].h;
+
+	bool ycc = false;
+	switch (rJP2.ColorEncoding) {
+	case Metadata::RGBA: ycc = false; break;
+	case Metadata::CDCI: ycc = true; break;
+	default: return false; // unknown ColorEncoding
+	}
+
+	const int src_bitdepth = qMax(8, rJP2.src_bitdepth);
+	const int maxcv = (1 << src_bitdepth) - 1;
+	mMaxCv = (float)maxcv;
+	mPrecShift = src_bitdepth - 8;
+
+	// RGB
+	mRgbScale = 1;
+	mRgbBias = 0;
+	if (rJP2.convert_to_709 && rJP2.ComponentMinRef && rJP2.ComponentMaxRef) { // QE.2 If ComponentMinRef is != 0, it's Legal Range. Don't convert if ComponentMaxRef is (accidentally) zero, or not set.
+		mRgbScale = (float)maxcv / ((float)rJP2.ComponentMaxRef - (float)rJP2.ComponentMinRef);
+		mRgbBias = -(float)rJP2.ComponentMinRef * mRgbScale;
+	}
+
+	// YCbCr
+	if (ycc) {
+		if (rJP2.Kg == 0) return false; // unknown primaries
+		const int dx = pImage->comps[1].dx;
+		const int dy = pImage->comps[1].dy;
+		if ((dx != 1 && dx != 2) || (dy != 1 && dy != 2)) return false;
+		mChromaShiftX = dx - 1;
+		mChromaShiftY = dy - 1;
+		mChromaStride = pImage->comps[1].w;
+
+		const int offset = 16 << (src_bitdepth - 8);
+		const int range_y = 219 << (src_bitdepth - 8);
+		const int range_c = (maxcv + 1 - 2 * offset);
+		const float c_scale = (float)maxcv / range_c;
+		mYOffset = (float)offset;
+		mYScale = (float)maxcv / range_y;
+		mChromaMid = (float)((maxcv + 1) / 2);
+		mCrR = 2 * (1 - rJP2.Kr) * c_scale;
+		mCbG = 2 * rJP2.Kb * (1 - rJP2.Kb) / rJP2.Kg * c_scale;
+		mCrG = 2 * rJP2.Kr * (1 - rJP2.Kr) / rJP2.Kg * c_scale;
+		mCbB = 2 * (1 - rJP2.Kb) * c_scale;
+	}
+	else {
+		mChromaShiftX = 0;
+		mChromaShiftY = 0;
+		mChromaStride = mWidth;
+	}
+
+	// linearize, convert primaries and apply BT.709 oetf?
+	bool linear = false;
+	float gain = 1;
+	if (rJP2.convert_to_709) {
+		const TransferLuts *p_luts = TransferLuts::GetGlobalInstance();
+		switch (rJP2.transferCharactersitics) {
+		case SMPTE::TransferCharacteristic_ITU709:
+		case SMPTE::TransferCharacteristic_IEC6196624_xvYCC:
+			break;
+		case SMPTE::TransferCharacteristic_ITU2020:
+			mpEotf = p_luts->GetEotf2020(); // 0...1
+			linear = true;
+			break;
+		case SMPTE::TransferCharacteristic_SMPTEST2084:
+			mpEotf = p_luts->GetEotfPQ(); // 0...10 000
+			gain = 0.01f; // convert to 0.0..100.0 ( 1.0 = 100 nits)
+			linear = true;
+			break;
+		default: return false;
+		}
+	}
+	if (linear) {
+		switch (rJP2.colorPrimaries) {
+		case SMPTE::ColorPrimaries_ITU2020: {
+			// convert from BT.2020 -> BT.709
+			const float matrix[9] = { 1.6605f, -0.5877f, -0.0728f, -0.1246f, 1.1330f, -0.0084f, -0.0182f, -0.1006f, 1.1187f };
+			for (int i = 0; i < 9; i++) mMatrix[i] = matrix[i] * gain;
+			break;
+		}
+		case SMPTE::ColorPrimaries_P3D65: {
+			// convert from DCI-P3 -> BT.709
+			const float matrix[9] = { 1.2248f, -0.2249f, -0.0001f, -0.042f, 1.042f, 0.f, -0.0196f, -0.0786f, 1.0983f };
+			for (int i = 0; i < 9; i++) mMatrix[i] = matrix[i] * gain;
+			break;
+		}
+		default: return false;
+		}
+		mEotfScale = (float)(TransferLuts::size - 1) / (float)maxcv;
+		mOetfScale = (float)(TransferLuts::size - 1);
+		UpdateOutputLut(maxcv, mPrecShift);
+	}
+
+	if (ycc) mpKernel = linear ? &ConvertRow<true, true> : &ConvertRow<true, false>;
+	else mpKernel = linear ? &ConvertRow<false, true> : &ConvertRow<false, false>;
+	return true;
+}
+
+void JP2K_ColorConversion::UpdateOutputLut(int max, int precShift) {
+
+	if (max == mOutputLutMax && precShift == mOutputLutShift) return;
+	const float *p_oetf_709 = TransferLuts::GetGlobalInstance()->GetOetf709();
+	mOutputLut.resize(TransferLuts::size);
+	for (int i = 0; i < TransferLuts::size; i++) {
+		mOutputLut[i] = to_8bit(p_oetf_709[i] * max, precShift);
+	}
+	mOutputLutMax = max;
+	mOutputLutShift = precShift;
+}
+
+void JP2K_ColorConversion::ConvertRows(int firstRow, int lastRow, uchar *pBits, int bytesPerLine) const {
+
+	if (mpKernel == NULL) return;
+	for (int row = qMax(0, firstRow); row < qMin(lastRow, mHeight); row++) {
+		mpKernel(*this, row, pBits + (qint64)row * bytesPerLine);
+	}
+}
+
+template<bool Ycc, bool Linear>
+void JP2K_ColorConversion::ConvertRow(const JP2K_ColorConversion &rCc, int row, uchar *pDst) {
+
+	// keep everything in locals, the compiler can't prove that pDst doesn't alias members
+	const int width = rCc.mWidth;
+	const int chroma_row = row >> rCc.mChromaShiftY;
+	const int chroma_shift_x = rCc.mChromaShiftX;
+	const OPJ_INT32 *p_c0 = rCc.mpComp[0] + (qint64)row * width;
+	const OPJ_INT32 *p_c1 = rCc.mpComp[1] + (qint64)chroma_row * rCc.mChromaStride;
+	const OPJ_INT32 *p_c2 = rCc.mpComp[2] + (qint64)chroma_row * rCc.mChromaStride;
+	const float y_offset = rCc.mYOffset, y_scale = rCc.mYScale, chroma_mid = rCc.mChromaMid;
+	const float cr_r = rCc.mCrR, cb_g = rCc.mCbG, cr_g = rCc.mCrG, cb_b = rCc.mCbB;
+	const float rgb_scale = rCc.mRgbScale, rgb_bias = rCc.mRgbBias;
+	const float max_cv = rCc.mMaxCv, eotf_scale = rCc.mEotfScale, oetf_scale = rCc.mOetfScale;
+	const float *p_eotf = rCc.mpEotf;
+	const float *m = rCc.mMatrix;
+	const uchar *p_out_lut = rCc.mOutputLut.constData();
+	const int prec_shift = rCc.mPrecShift;
+
+	int x = 0;
+#ifdef JP2K_COLOR_CONVERSION_SSE2
+	const __m128 v_zero = _mm_setzero_ps();
+	const __m128 v_one = _mm_set1_ps(1.f);
+	const __m128i v_shift = _mm_cvtsi32_si128(prec_shift);
+	for (; x + 4 <= width; x += 4, pDst += 12) {
+
+		__m128 r, g, b;
+		if (Ycc) {
+			const __m128 y = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(p_c0 + x))), _mm_set1_ps(y_offset)), _mm_set1_ps(y_scale));
+			__m128i cb_i, cr_i;
+			if (chroma_shift_x) { // x is even: Cb0 Cb0 Cb1 Cb1
+				cb_i = _mm_loadl_epi64((const __m128i*)(p_c1 + (x >> 1)));
+				cr_i = _mm_loadl_epi64((const __m128i*)(p_c2 + (x >> 1)));
+				cb_i = _mm_unpacklo_epi32(cb_i, cb_i);
+				cr_i = _mm_unpacklo_epi32(cr_i, cr_i);
+			}
+			else {
+				cb_i = _mm_loadu_si128((const __m128i*)(p_c1 + x));
+				cr_i = _mm_loadu_si128((const __m128i*)(p_c2 + x));
+			}
+			const __m128 cb = _mm_sub_ps(_mm_cvtepi32_ps(cb_i), _mm_set1_ps(chroma_mid));
+			const __m128 cr = _mm_sub_ps(_mm_cvtepi32_ps(cr_i), _mm_set1_ps(chroma_mid));
+			r = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(cr_r), cr));
+			g = _mm_sub_ps(_mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(cb_g), cb)), _mm_mul_ps(_mm_set1_ps(cr_g), cr));
+			b = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(cb_b), cb));
+		}
+		else {
+			const __m128 scale = _mm_set1_ps(rgb_scale), bias = _mm_set1_ps(rgb_bias);
+			r = _mm_max_ps(v_zero, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(p_c0 + x))), scale), bias));
+			g = _mm_max_ps(v_zero, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(p_c1 + x))), scale), bias));
+			b = _mm_max_ps(v_zero, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(p_c2 + x))), scale), bias));
+		}
+
+		if (Linear) {
+			// linearize (lut gather is scalar)
+			const __m128 v_max_cv = _mm_set1_ps(max_cv), v_eotf_scale = _mm_set1_ps(eotf_scale);
+			int index[12];
+			_mm_storeu_si128((__m128i*)(index), _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(r, v_zero), v_max_cv), v_eotf_scale)));
+			_mm_storeu_si128((__m128i*)(index + 4), _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(g, v_zero), v_max_cv), v_eotf_scale)));
+			_mm_storeu_si128((__m128i*)(index + 8), _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b, v_zero), v_max_cv), v_eotf_scale)));
+			r = _mm_setr_ps(p_eotf[index[0]], p_eotf[index[1]], p_eotf[index[2]], p_eotf[index[3]]);
+			g = _mm_setr_ps(p_eotf[index[4]], p_eotf[index[5]], p_eotf[index[6]], p_eotf[index[7]]);
+			b = _mm_setr_ps(p_eotf[index[8]], p_eotf[index[9]], p_eotf[index[10]], p_eotf[index[11]]);
+
+			// convert primaries and clamp between 0...1
+			const __m128 out_r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(m[0])), _mm_mul_ps(g, _mm_set1_ps(m[1]))), _mm_mul_ps(b, _mm_set1_ps(m[2])));
+			const __m128 out_g = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(m[3])), _mm_mul_ps(g, _mm_set1_ps(m[4]))), _mm_mul_ps(b, _mm_set1_ps(m[5])));
+			const __m128 out_b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(m[6])), _mm_mul_ps(g, _mm_set1_ps(m[7]))), _mm_mul_ps(b, _mm_set1_ps(m[8])));
+			const __m128 v_oetf_scale = _mm_set1_ps(oetf_scale);
+			_mm_storeu_si128((__m128i*)(index), _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(out_r, v_zero), v_one), v_oetf_scale)));
+			_mm_storeu_si128((__m128i*)(index + 4), _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(out_g, v_zero), v_one), v_oetf_scale)));
+			_mm_storeu_si128((__m128i*)(index + 8), _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(out_b, v_zero), v_one), v_oetf_scale)));
+
+			// unlinearize and convert to 8 bit
+			for (int i = 0; i < 4; i++) {
+				pDst[i * 3] = p_out_lut[index[i]];
+				pDst[i * 3 + 1] = p_out_lut[index[i + 4]];
+				pDst[i * 3 + 2] = p_out_lut[index[i + 8]];
+			}
+		}
+		else {
+			// convert to 8 bit, the saturating packs clamp between 0...255
+			const __m128i r_i = _mm_sra_epi32(_mm_cvttps_epi32(r), v_shift);
+			const __m128i g_i = _mm_sra_epi32(_mm_cvttps_epi32(g), v_shift);
+			const __m128i b_i = _mm_sra_epi32(_mm_cvttps_epi32(b), v_shift);
+			const __m128i rg = _mm_packs_epi32(r_i, g_i);
+			const __m128i bb = _mm_packs_epi32(b_i, b_i);
+			uchar packed[16]; // r0 r1 r2 r3 g0 g1 g2 g3 b0 b1 b2 b3 ...
+			_mm_storeu_si128((__m128i*)packed, _mm_packus_epi16(rg, bb));
+			for (int i = 0; i < 4; i++) {
+				pDst[i * 3] = packed[i];
+				pDst[i * 3 + 1] = packed[i + 4];
+				pDst[i * 3 + 2] = packed[i + 8];
+			}
+		}
+	}
+#endif // JP2K_COLOR_CONVERSION_SSE2
+
+	for (; x < width; x++, pDst += 3) {
+
+		float r, g, b;
+		load_pixel<Ycc>(p_c0, p_c1, p_c2, x, chroma_shift_x, y_offset, y_scale, chroma_mid, cr_r, cb_g, cr_g, cb_b, rgb_scale, rgb_bias, r, g, b);
+		if (Linear) {
+			// linearize
+			r = p_eotf[(int)(clamp_f(r, 0, max_cv) * eotf_scale)];
+			g = p_eotf[(int)(clamp_f(g, 0, max_cv) * eotf_scale)];
+			b = p_eotf[(int)(clamp_f(b, 0, max_cv) * eotf_scale)];
+
+			// convert primaries and clamp between 0...1
+			const float out_r = clamp_f(r * m[0] + g * m[1] + b * m[2], 0, 1);
+			const float out_g = clamp_f(r * m[3] + g * m[4] + b * m[5], 0, 1);
+			const float out_b = clamp_f(r * m[6] + g * m[7] + b * m[8], 0, 1);
+
+			// unlinearize and convert to 8 bit
+			pDst[0] = p_out_lut[(int)(out_r * oetf_scale)];
+			pDst[1] = p_out_lut[(int)(out_g * oetf_scale)];
+			pDst[2] = p_out_lut[(int)(out_b * oetf_scale)];
+		}
+		else {
+			pDst[0] = to_8bit(r, prec_shift);
+			pDst[1] = to_8bit(g, prec_shift);
+			pDst[2] = to_8bit(b, prec_shift);
+		}
+	}
+}
@@ -0,0 +1,74 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QtGlobal>
+#include <QVector>
+#include "openjpeg.h"
+
+class JP2;
+
+/*! \brief
+Converts a decoded opj_image_t into QImage::Format_RGB888 scanlines.
+JP2K_ColorConversion::Prepare() selects a row kernel specialised for color encoding and transfer characteristic once per frame.
+The kernels process four pixels at a time using SSE2 where available and fall back to scalar code otherwise.
+*/
+class JP2K_ColorConversion {
+
+public:
+	JP2K_ColorConversion();
+	//! Takes the conversion parameters from rJP2 and the geometry from pImage. Returns false if the color encoding, transfer characteristic or primaries are not supported.
+	bool Prepare(const JP2 &rJP2, const OPENJPEG_H::opj_image_t *pImage);
+	int GetWidth() const { return mWidth; }
+	int GetHeight() const { return mHeight; }
+	//! Converts the rows [firstRow, lastRow) into pBits (RGB888). May be called concurrently for disjoint row ranges.
+	void ConvertRows(int firstRow, int lastRow, uchar *pBits, int bytesPerLine) const;
+	//! "SSE2" or "Scalar".
+	static const char* GetBackendName();
+
+private:
+	typedef void(*RowKernel)(const JP2K_ColorConversion &rConversion, int row, uchar *pDst);
+	template<bool Ycc, bool Linear> static void ConvertRow(const JP2K_ColorConversion &rConversion, int row, uchar *pDst);
+	void UpdateOutputLut(int max, int precShift);
+
+	RowKernel mpKernel;
+	int mWidth;
+	int mHeight;
+	const OPJ_INT32 *mpComp[3];
+	int mChromaStride;
+	int mChromaShiftX; // 1 for 4:2:2 and 4:2:0
+	int mChromaShiftY; // 1 for 4:2:0
+	int mPrecShift; // source bit depth -> 8 bit
+	float mMaxCv;
+	// RGB: value * mRgbScale + mRgbBias (legal range -> full range)
+	float mRgbScale;
+	float mRgbBias;
+	// YCbCr -> RGB
+	float mYOffset;
+	float mYScale;
+	float mChromaMid;
+	float mCrR;
+	float mCbG;
+	float mCrG;
+	float mCbB;
+	// linearization
+	const float *mpEotf;
+	float mEotfScale; // code value -> lut index
+	float mMatrix[9]; // source primaries -> BT.709, includes the gain of the eotf
+	float mOetfScale; // linear value -> lut index
+	QVector<uchar> mOutputLut; // BT.709 oetf and 8 bit quantization
+	int mOutputLutMax;
+	int mOutputLutShift;
+};
@@ -18,145 +18,252 @@
 #include "global.h"
 #include <QRunnable>
 #include <QTime>
+#include <QThread>
+#include <QElapsedTimer>
 #include "openjpeg.h"
 #include "AS_DCP_internal.h"
-#include <QThreadpool>  
 
 //#define DEBUG_JP2K
 
- // #################################################### MXFP_decode #######################################################
-JP2K_Decoder::JP2K_Decoder(QSharedPointer<DecodedFrames> &rdecoded_shared, QSharedPointer<FrameRequest> &rRequest, float* &Roetf_709_shared, float* &Reotf_2020_shared, float* &Reotf_PQ_shared) {
+namespace
+{
 
-	// set stuff
-	decoded_shared = rdecoded_shared;
-	request = rRequest;
-	oetf_709 = Roetf_709_shared;
-	eotf_2020 = Reotf_2020_shared;
-	eotf_PQ = Reotf_PQ_shared;
+// Upper limit for the memory occupied by frames in flight [byte].
+const qint64 frame_memory_budget = 1536ll * 1024 * 1024;
+// Consecutive frames fetched with a single read during playback.
+const int read_ahead_frames = 8;
 
-	max_f = 1 << bitdepth;
-	max_f_ = (float)(max_f)-1.0;
+//! Runs one request on the next free decoder of the pool.
+class JP2K_DecodeTask : public QRunnable {
 
-	reader = new AS_02::JP2K::MXFReader();
+public:
+	JP2K_DecodeTask(JP2K_DecoderPool *pPool, const QSharedPointer<FrameRequest> &rRequest) :
+		mpPool(pPool), mRequest(rRequest) { setAutoDelete(true); }
+	virtual void run() {
+		JP2K_Decoder *p_decoder = mpPool->AcquireDecoder();
+		p_decoder->decode(mRequest);
+		mpPool->ReleaseDecoder(p_decoder);
+	}
 
-	pDecompressor = OPENJPEG_H::opj_create_decompress(OPJ_CODEC_J2K); // create new decompresser
+private:
+	JP2K_DecoderPool *mpPool;
+	QSharedPointer<FrameRequest> mRequest;
+};
 
-	//register callbacks (for debugging)
-	OPENJPEG_H::opj_set_info_handler(pDecompressor, info_callback, 0);
-	OPENJPEG_H::opj_set_warning_handler(pDecompressor, warning_callback, 0);
-	OPENJPEG_H::opj_set_error_handler(pDecompressor, error_callback, 0);
+//! Hands the request back to the player. Everything written to the request before is visible to the player once it sees the new state.
+void publish_request(const QSharedPointer<FrameRequest> &rRequest, FrameRequest::eState state) {
+
+	rRequest->state.storeRelease(state);
+	if (rRequest->completed) rRequest->completed->release();
 }
 
-void JP2K_Decoder::run() {
+}
 
-	// create new frame buffer
-	buff = new ASDCP::JP2K::FrameBuffer();
+ // #################################################### JP2K_Decoder #######################################################
+JP2K_Decoder::JP2K_Decoder(JP2K_DecoderPool *pPool) :
+JP2(), mpPool(pPool) {
 
-	//register callbacks (for debugging)
-#ifdef DEBUG_JP2K
-	OPENJPEG_H::opj_set_info_handler(pDecompressor, info_callback, 0);
-	OPENJPEG_H::opj_set_warning_handler(pDecompressor, warning_callback, 0);
-	OPENJPEG_H::opj_set_error_handler(pDecompressor, error_callback, 0);
-#endif
+	OPENJPEG_H::opj_set_default_decoder_parameters(&params);
+	psImage = NULL;
+	pStream = NULL;
+	pDecompressor = NULL;
+}
 
-	if (request->asset != current_asset) { // asset has changed -> update reader!
-		if (current_asset) { // close previous reader
-			reader->Close();
-			reader->~MXFReader();
-		} // else : first reader 
+JP2K_Decoder::~JP2K_Decoder() {
 
-		// create new reader
-		reader = new AS_02::JP2K::MXFReader();
+}
 
-		Result_t result_o = reader->OpenRead(request->asset->GetPath().absoluteFilePath().toStdString()); // open file for reading
-		if (!ASDCP_SUCCESS(result_o)) {
+void JP2K_Decoder::decode(const QSharedPointer<FrameRequest> &rRequest) {
 
-			request->errorMsg = QString("Failed to open reader: %1").arg(result_o.Label());
-			request->error = true; // an error occured processing the frame
-			return;
-		}
-		else {
-			current_asset = request->asset;
-		}
-	} // else : correct reader is alrady open
-
-	// calculate neccessary buffer size
-	Result_t f_next = reader->AS02IndexReader().Lookup((request->frameNr + 1), IndexF2);
-	if (ASDCP_SUCCESS(f_next)) { // next frame
-		Result_t f_this = reader->AS02IndexReader().Lookup(request->frameNr, IndexF1);
-		if (ASDCP_SUCCESS(f_this)) { // current frame
-			buff->Capacity((IndexF2.StreamOffset - IndexF1.StreamOffset) - 20); // set buffer size
+	QSharedPointer<FrameRequest> request = rRequest;
+
+	// the player drops frames it can't present in time
+	if (!request->state.testAndSetAcquire(FrameRequest::Pending, FrameRequest::Decoding)) return;
+	QElapsedTimer timer; // decoding latency drives the quality ladder of the player
+	timer.start();
+
+	convert_to_709 = request->convert709; // read by the color conversion, the decoder is owned by this thread while decoding
+
+	// frames decoded before (scrubbing, playback or proxies) aren't decoded again
+	const JP2K_FrameKey frame_key(request->asset ? request->asset->GetId() : QUuid(), request->frameNr, request->layer, request->convert709, request->qualityLayers);
+	QImage cached_frame;
+	if (JP2K_FrameCache::GetGlobalInstance()->Lookup(frame_key, cached_frame)) {
+		request->decoded = cached_frame;
+		publish_request(request, FrameRequest::Done); // image is ready
+		return;
+	}
+
+	QSharedPointer<JP2K_SharedReader> shared_reader = mpPool->GetReader(request->asset, request->errorMsg);
+	if (!shared_reader) {
+		publish_request(request, FrameRequest::Failed); // an error occured processing the frame
+		return;
+	}
+	current_asset = request->asset;
+
+	{
+		QMutexLocker reader_locker(&shared_reader->mutex);
+
+		// try reading requested frame number, consecutive requests are served from one read (see JP2K_FrameReader::SetReadAhead())
+		QString error_msg;
+		if (shared_reader->reader.ReadFrame(request->frameNr, mCodeStream, error_msg)) {
+			pMemoryStream.pData = (OPJ_UINT8*)mCodeStream.pData;
+			pMemoryStream.dataSize = mCodeStream.size;
 		}
 		else {
-			buff->Capacity(default_buffer_size); // set default size
+			request->errorMsg = QString("%1 -> Slow HDD? (speed: ~%2 Mb/s)").arg(error_msg).arg((request->fps * pMemoryStream.dataSize) / 1024 / 1024);
+			publish_request(request, FrameRequest::Failed); // an error occured processing the frame
+			return;
 		}
 	}
-	else {
-		buff->Capacity(default_buffer_size); // set default size
-	}
 
-	// try reading requested frame number
-	Result_t res = reader->ReadFrame(request->frameNr, *buff, NULL, NULL);
-	if (ASDCP_SUCCESS(res)) {
-		pMemoryStream.pData = (unsigned char*)buff->Data();
-		pMemoryStream.dataSize = buff->Size();
-	}
-	else {
-		request->errorMsg = QString("%1 -> Slow HDD? (speed: ~%2 Mb/s)").arg(res.Label()).arg((request->fps * pMemoryStream.dataSize) / 1024 / 1024);
-		request->error = true; // an error occured processing the frame
-		return;
-	}
-	
+	// A codec can only decode one codestream, the stream wraps our reused frame buffer.
 	pMemoryStream.offset = 0;
 	pStream = opj_stream_create_default_memory_stream(&pMemoryStream, OPJ_TRUE);
 	params.cp_reduce = request->layer; // set current layer
+	params.cp_layer = request->qualityLayers; // 0: all quality layers
 	pDecompressor = OPENJPEG_H::opj_create_decompress(OPJ_CODEC_J2K); // create new decompresser
+	psImage = NULL;
+
+	//register callbacks (for debugging)
+#ifdef DEBUG_JP2K
+	OPENJPEG_H::opj_set_info_handler(pDecompressor, info_callback, 0);
+	OPENJPEG_H::opj_set_warning_handler(pDecompressor, warning_callback, 0);
+	OPENJPEG_H::opj_set_error_handler(pDecompressor, error_callback, 0);
+#endif
+
+	FrameRequest::eState result = FrameRequest::Failed; // an error occured processing the frame
 
 	// Setup the decoder
 	if (!OPENJPEG_H::opj_setup_decoder(pDecompressor, &params)) {
 
 		request->errorMsg = "Error setting up the decoder!";
-		request->error = true; // an error occured processing the frame
-
-		OPENJPEG_H::opj_stream_destroy(pStream);
-		OPENJPEG_H::opj_destroy_codec(pDecompressor);
-		return;
 	}
-
 	// try reading header
-	if (!OPENJPEG_H::opj_read_header(pStream, pDecompressor, &psImage)) {
+	else if (!OPENJPEG_H::opj_read_header(pStream, pDecompressor, &psImage)) {
 
 		request->errorMsg = QString("Failed to read header -> Slow HDD? (speed: ~%1 Mb/s)").arg((request->fps * pMemoryStream.dataSize) / 1024 / 1024);
-		request->error = true; // an error occured processing the frame
-
-		OPENJPEG_H::opj_stream_destroy(pStream);
-		OPENJPEG_H::opj_destroy_codec(pDecompressor);
-		return;
 	}
-
 	// try decoding image
-	if (!OPENJPEG_H::opj_decode(pDecompressor, pStream, psImage)) {
+	else if (!OPENJPEG_H::opj_decode(pDecompressor, pStream, psImage)) {
 
 		request->errorMsg = "Failed to decode JPX image";
-		request->error = true; // an error occured processing the frame
-
-		buff->~FrameBuffer();
-		OPENJPEG_H::opj_destroy_codec(pDecompressor);
-		OPENJPEG_H::opj_stream_destroy(pStream);
-		OPENJPEG_H::opj_image_destroy(psImage);
-		return;
 	}
-
-	// success:
-	request->decoded = DataToQImage(); // create image
-	request->done = true; // image is ready
-	
-	decoded_shared->decoded_total++;
-	decoded_shared->pending_requests--;
+	else {
+		// success:
+		request->decoded = DataToQImage(); // create image
+		JP2K_FrameCache::GetGlobalInstance()->Insert(frame_key, request->decoded);
+		request->decodeTime_us = timer.nsecsElapsed() / 1000;
+		result = FrameRequest::Done; // image is ready
+	}
 
 	// clean up
-	buff->~FrameBuffer();
 	OPENJPEG_H::opj_stream_destroy(pStream);
 	OPENJPEG_H::opj_destroy_codec(pDecompressor);
-	OPENJPEG_H::opj_image_destroy(psImage); // free allocated memory
-}
\ No newline at end of file
+	if (psImage) OPENJPEG_H::opj_image_destroy(psImage); // free allocated memory
+	pStream = NULL;
+	pDecompressor = NULL;
+	psImage = NULL;
+	mCodeStream = JP2K_CodeStream(); // return the buffer to the pool
+
+	publish_request(request, result);
+}
+
+ // #################################################### JP2K_DecoderPool #######################################################
+JP2K_DecoderPool::JP2K_DecoderPool() :
+mThreadPool(), mDecoders(), mFreeDecoders(),
+mDecoderMutex(), mDecoderReleased(), mReaders(), mReaderMutex() {
+
+	Resize(qMax(1, QThread::idealThreadCount()));
+}
+
+JP2K_DecoderPool::~JP2K_DecoderPool() {
+
+	CancelPending();
+	mThreadPool.waitForDone();
+	DeleteDecoders();
+	CloseReaders();
+}
+
+int JP2K_DecoderPool::OptimalSize(int width, int height) {
+
+	const int cores = qMax(1, QThread::idealThreadCount());
+	if (width <= 0 || height <= 0) return cores;
+	// opj_image_t (3 x int32 per pixel) + QImage (RGB888) + codestream
+	const qint64 frame_memory = (qint64)width * height * (3 * 4 + 3 + 2);
+	return (int)qBound<qint64>(1, frame_memory_budget / frame_memory, cores);
+}
+
+void JP2K_DecoderPool::Resize(int decoderCount) {
+
+	decoderCount = qMax(1, decoderCount);
+	CancelPending();
+	mThreadPool.waitForDone();
+	DeleteDecoders();
+	QMutexLocker locker(&mDecoderMutex);
+	for (int i = 0; i < decoderCount; i++) {
+		JP2K_Decoder *p_decoder = new JP2K_Decoder(this);
+		mDecoders.push_back(p_decoder);
+		mFreeDecoders.push_back(p_decoder);
+	}
+	mThreadPool.setMaxThreadCount(decoderCount);
+}
+
+void JP2K_DecoderPool::DeleteDecoders() {
+
+	QMutexLocker locker(&mDecoderMutex);
+	qDeleteAll(mDecoders);
+	mDecoders.clear();
+	mFreeDecoders.clear();
+}
+
+void JP2K_DecoderPool::Decode(const QSharedPointer<FrameRequest> &rRequest) {
+
+	mThreadPool.start(new JP2K_DecodeTask(this, rRequest), QThread::HighPriority);
+}
+
+void JP2K_DecoderPool::CancelPending() {
+
+	mThreadPool.clear();
+}
+
+JP2K_Decoder* JP2K_DecoderPool::AcquireDecoder() {
+
+	QMutexLocker locker(&mDecoderMutex);
+	// The thread pool never runs more tasks than decoders exist, we don't wait in practice.
+	while (mFreeDecoders.isEmpty()) mDecoderReleased.wait(&mDecoderMutex);
+	return mFreeDecoders.takeLast();
+}
+
+void JP2K_DecoderPool::ReleaseDecoder(JP2K_Decoder *pDecoder) {
+
+	QMutexLocker locker(&mDecoderMutex);
+	mFreeDecoders.push_back(pDecoder);
+	mDecoderReleased.wakeOne();
+}
+
+QSharedPointer<JP2K_SharedReader> JP2K_DecoderPool::GetReader(const QSharedPointer<AssetMxfTrack> &rAsset, QString &rErrorMsg) {
+
+	if (!rAsset) {
+		rErrorMsg = "Asset is invalid!";
+		return QSharedPointer<JP2K_SharedReader>();
+	}
+	QMutexLocker locker(&mReaderMutex);
+	QSharedPointer<JP2K_SharedReader> shared_reader = mReaders.value(rAsset.data());
+	if (shared_reader) return shared_reader;
+
+	shared_reader = QSharedPointer<JP2K_SharedReader>(new JP2K_SharedReader);
+	shared_reader->asset = rAsset;
+	if (!shared_reader->reader.Open(rAsset->GetPath().absoluteFilePath(), rErrorMsg)) { // open file for reading
+		return QSharedPointer<JP2K_SharedReader>();
+	}
+	shared_reader->reader.SetReadAhead(read_ahead_frames);
+	mReaders.insert(rAsset.data(), shared_reader);
+	return shared_reader;
+}
+
+void JP2K_DecoderPool::CloseReaders() {
+
+	QMutexLocker locker(&mReaderMutex);
+	// Decoders still using a reader keep it alive through their QSharedPointer.
+	mReaders.clear();
+}
@@ -16,26 +16,75 @@
 #pragma once
 #include <QObject>
 #include <QRunnable>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
 #include <QDebug>
 #include "ImfPackage.h"
 #include "JP2K_Preview.h"
 
 class FrameRequest;
-class JP2Ktest;
+class JP2K_DecoderPool;
 
-class JP2K_Decoder : public QObject, public QRunnable, public JP2 {
-
-	Q_OBJECT
+//! Decoding state of one worker of the JP2K_DecoderPool. Codestream buffers come from the JP2K_BufferPool, the memory stream is reused for every request.
+class JP2K_Decoder : public JP2 {
 
 public:
-	JP2K_Decoder(QSharedPointer<DecodedFrames>&, QSharedPointer<FrameRequest>&, float*&, float*&, float*&);
+	JP2K_Decoder(JP2K_DecoderPool *pPool);
+	~JP2K_Decoder();
+	//! Decodes the requested frame, sets FrameRequest::decoded or FrameRequest::errorMsg and publishes FrameRequest::state. Canceled requests are skipped.
+	void decode(const QSharedPointer<FrameRequest> &rRequest);
+
 private:
+	Q_DISABLE_COPY(JP2K_Decoder);
+	JP2K_DecoderPool *mpPool;
+};
+
+
+//! One frame reader per asset, shared by all decoders. ReadFrame() must be called with the mutex locked.
+struct JP2K_SharedReader {
+	QSharedPointer<AssetMxfTrack> asset;
+	JP2K_FrameReader reader;
+	QMutex mutex;
+};
+
 
-	QSharedPointer<DecodedFrames> decoded_shared;
-	QSharedPointer<FrameRequest> request;
+/*! \brief
+Owns a fixed number of JP2K_Decoder instances and the threads executing them.
+The number of decoders is derived from the number of cores and the frame size (see JP2K_DecoderPool::OptimalSize()).
+*/
+class JP2K_DecoderPool {
+
+public:
+	JP2K_DecoderPool();
+	~JP2K_DecoderPool();
+	//! Number of decoders that run in parallel without exceeding the memory budget for frames of the given size.
+	static int OptimalSize(int width, int height);
+	//! Waits for running requests and recreates the decoders. Decoder parameters must be set again afterwards.
+	void Resize(int decoderCount);
+	int GetDecoderCount() const { return mDecoders.size(); }
+	JP2K_Decoder* GetDecoder(int index) { return mDecoders.at(index); }
+	//! Queues a decoding request.
+	void Decode(const QSharedPointer<FrameRequest> &rRequest);
+	//! Removes all requests which are not started yet.
+	void CancelPending();
+	//! Returns the reader for the asset (opens it if necessary). Returns a NULL pointer if the asset couldn't be opened.
+	QSharedPointer<JP2K_SharedReader> GetReader(const QSharedPointer<AssetMxfTrack> &rAsset, QString &rErrorMsg);
+	//! Closes all readers (e.g. new playlist).
+	void CloseReaders();
+	JP2K_Decoder* AcquireDecoder();
+	void ReleaseDecoder(JP2K_Decoder *pDecoder);
+
+private:
+	Q_DISABLE_COPY(JP2K_DecoderPool);
+	void DeleteDecoders();
 
-protected:
-	void run();
-signals:
-	void finished();
-};
\ No newline at end of file
+	QThreadPool mThreadPool;
+	QList<JP2K_Decoder*> mDecoders;
+	QList<JP2K_Decoder*> mFreeDecoders;
+	QMutex mDecoderMutex;
+	QWaitCondition mDecoderReleased;
+	QHash<AssetMxfTrack*, QSharedPointer<JP2K_SharedReader> > mReaders;
+	QMutex mReaderMutex;
+};
@@ -0,0 +1,86 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "JP2K_FrameCache.h"
+#include <QGlobalStatic>
+#include <QMutexLocker>
+#include <climits>
+
+Q_GLOBAL_STATIC(JP2K_FrameCache, theJP2K_FrameCache)
+
+
+JP2K_FrameCache::JP2K_FrameCache() :
+mMutex(), mFrames((int)(default_max_bytes / 1024)), mHits(0), mMisses(0) {
+
+}
+
+JP2K_FrameCache* JP2K_FrameCache::GetGlobalInstance() {
+
+	return theJP2K_FrameCache();
+}
+
+bool JP2K_FrameCache::Lookup(const JP2K_FrameKey &rKey, QImage &rImage) {
+
+	QMutexLocker locker(&mMutex);
+	QImage *p_image = mFrames.object(rKey); // moves the frame to the front
+	if(p_image == NULL) {
+		mMisses++;
+		return false;
+	}
+	mHits++;
+	rImage = *p_image; // implicitly shared
+	return true;
+}
+
+void JP2K_FrameCache::Insert(const JP2K_FrameKey &rKey, const QImage &rImage) {
+
+	if(rImage.isNull() == true) return;
+	const int cost = qMax(1, rImage.byteCount() / 1024);
+	QMutexLocker locker(&mMutex);
+	mFrames.insert(rKey, new QImage(rImage), cost); // Frames exceeding the whole budget are dropped.
+}
+
+void JP2K_FrameCache::SetMaxBytes(qint64 maxBytes) {
+
+	QMutexLocker locker(&mMutex);
+	mFrames.setMaxCost((int)qBound<qint64>(0, maxBytes / 1024, INT_MAX));
+}
+
+void JP2K_FrameCache::Clear() {
+
+	QMutexLocker locker(&mMutex);
+	mFrames.clear();
+	mHits = 0;
+	mMisses = 0;
+}
+
+JP2K_FrameCache::Statistics JP2K_FrameCache::GetStatistics() const {
+
+	QMutexLocker locker(&mMutex);
+	Statistics statistics;
+	statistics.hits = mHits;
+	statistics.misses = mMisses;
+	statistics.bytes = (qint64)mFrames.totalCost() * 1024;
+	statistics.maxBytes = (qint64)mFrames.maxCost() * 1024;
+	statistics.frames = mFrames.count();
+	return statistics;
+}
+
+QString JP2K_FrameCache::GetStatusString() const {
+
+	const Statistics statistics = GetStatistics();
+	return QString("Cache: %1% hits, %2 / %3 MB (%4 frames)").arg(statistics.GetHitRate() * 100., 0, 'f', 1)
+		.arg(statistics.bytes / (1024 * 1024)).arg(statistics.maxBytes / (1024 * 1024)).arg(statistics.frames);
+}
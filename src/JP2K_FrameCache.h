@@ -0,0 +1,81 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QtGlobal>
+#include <QUuid>
+#include <QImage>
+#include <QCache>
+#include <QMutex>
+#include <QString>
+#include <QHash>
+
+
+//! Identifies a decoded frame: asset, frame number within the asset, resolution level (cp_reduce), quality layers (cp_layer) and color pipeline.
+struct JP2K_FrameKey {
+	JP2K_FrameKey() : asset(), frameNr(-1), layer(0), convertTo709(false), qualityLayers(0) {}
+	JP2K_FrameKey(const QUuid &rAsset, qint64 frameNr, int layer, bool convertTo709, int qualityLayers = 0) : asset(rAsset), frameNr(frameNr), layer(layer), convertTo709(convertTo709), qualityLayers(qualityLayers) {}
+	bool operator==(const JP2K_FrameKey &rOther) const { return asset == rOther.asset && frameNr == rOther.frameNr && layer == rOther.layer && convertTo709 == rOther.convertTo709 && qualityLayers == rOther.qualityLayers; }
+	QUuid asset;
+	qint64 frameNr;
+	int layer;
+	bool convertTo709;
+	int qualityLayers; // 0: all
+};
+
+inline uint qHash(const JP2K_FrameKey &rKey, uint seed = 0) {
+
+	return qHash(rKey.asset, seed) ^ qHash(rKey.frameNr, seed) ^ (uint)(rKey.layer << 1) ^ (uint)rKey.convertTo709 ^ (uint)(rKey.qualityLayers << 4);
+}
+
+
+/*! \brief
+Process wide LRU cache of decoded frames shared by the preview (scrubbing), the player decoders and the timeline proxies.
+The cache is bounded by a memory budget (see JP2K_FrameCache::SetMaxBytes()). Only complete frames are inserted. This class is thread safe.
+*/
+class JP2K_FrameCache {
+
+public:
+	struct Statistics {
+		Statistics() : hits(0), misses(0), bytes(0), maxBytes(0), frames(0) {}
+		double GetHitRate() const { return hits + misses > 0 ? (double)hits / (hits + misses) : 0.; }
+		quint64 hits;
+		quint64 misses;
+		qint64 bytes;
+		qint64 maxBytes;
+		int frames;
+	};
+	static const qint64 default_max_bytes = 768ll * 1024 * 1024;
+	//! Use JP2K_FrameCache::GetGlobalInstance().
+	JP2K_FrameCache();
+	static JP2K_FrameCache* GetGlobalInstance();
+	//! Returns false on a cache miss.
+	bool Lookup(const JP2K_FrameKey &rKey, QImage &rImage);
+	void Insert(const JP2K_FrameKey &rKey, const QImage &rImage);
+	//! Evicts least recently used frames if the new budget is smaller.
+	void SetMaxBytes(qint64 maxBytes);
+	void Clear();
+	Statistics GetStatistics() const;
+	//! Hit rate and memory use, e.g. for a status bar.
+	QString GetStatusString() const;
+
+private:
+	Q_DISABLE_COPY(JP2K_FrameCache);
+
+	mutable QMutex mMutex;
+	QCache<JP2K_FrameKey, QImage> mFrames; // cost: KiB
+	quint64 mHits;
+	quint64 mMisses;
+};
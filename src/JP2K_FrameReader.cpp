@@ -0,0 +1,380 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "JP2K_FrameReader.h"
+#include "HashEngine.h"
+#include <QGlobalStatic>
+#include <QMutexLocker>
+#include <QHash>
+#include <QFileInfo>
+#include <QDebug>
+#include <cstring>
+
+#define BUFFER_ALIGNMENT 4096
+#define BUFFER_GRANULARITY (1024 * 1024) // Buffer sizes are rounded up so that frames of similar size share buffers.
+#define FALLBACK_BUFFER_SIZE (30 * 1024 * 1024) // Only used if the index doesn't bound the frame size.
+#define KLV_HEADER_MAX_SIZE 25 // 16 byte key + 9 byte BER length
+#define INDEX_TABLE_CACHE_MAX_ENTRIES 64
+
+//#define DEBUG_JP2K
+
+
+namespace {
+
+//! Parsed index tables keyed by absolute file path. An entry is dismissed if the FileIdentity of the file changed.
+class IndexTableCache {
+
+public:
+	struct Entry {
+		Entry() : identity(), offsets(), isPlainKlv(false) {}
+		FileIdentity identity;
+		QSharedPointer<const QVector<qint64> > offsets;
+		bool isPlainKlv;
+	};
+	bool Lookup(const QString &rFilePath, const FileIdentity &rIdentity, Entry &rEntry) {
+		QMutexLocker locker(&mMutex);
+		QHash<QString, Entry>::const_iterator it = mEntries.constFind(rFilePath);
+		if(rIdentity.IsValid() == false || it == mEntries.constEnd() || it->identity != rIdentity) return false;
+		rEntry = *it;
+		return true;
+	}
+	void Insert(const QString &rFilePath, const Entry &rEntry) {
+		if(rEntry.identity.IsValid() == false) return;
+		QMutexLocker locker(&mMutex);
+		if(mEntries.size() >= INDEX_TABLE_CACHE_MAX_ENTRIES) mEntries.clear();
+		mEntries.insert(rFilePath, rEntry);
+	}
+
+private:
+	QMutex mMutex;
+	QHash<QString, Entry> mEntries;
+};
+
+//! Parses key and BER length of a JPEG 2000 picture element (SMPTE ST 422). Returns the size of key and length or 0 if pData doesn't start with a picture element.
+int parse_picture_element(const uchar *pData, qint64 available, qint64 &rValueLength) {
+
+	// GC essence element key, byte 12: item type (0x15 picture)
+	static const uchar key_prefix[12] = {0x06, 0x0e, 0x2b, 0x34, 0x01, 0x02, 0x01, 0x01, 0x0d, 0x01, 0x03, 0x01};
+	if(available < 17 || memcmp(pData, key_prefix, sizeof(key_prefix)) != 0 || pData[12] != 0x15) return 0;
+	const uchar first = pData[16];
+	if((first & 0x80) == 0) {
+		rValueLength = first;
+		return 17;
+	}
+	const int count = first & 0x7f;
+	if(count < 1 || count > 8 || available < 17 + count) return 0;
+	quint64 length = 0;
+	for(int i = 0; i < count; i++) length = (length << 8) | pData[17 + i];
+	if(length > (quint64)Q_INT64_C(0x7fffffffffffffff)) return 0;
+	rValueLength = (qint64)length;
+	return 17 + count;
+}
+
+}
+
+Q_GLOBAL_STATIC(IndexTableCache, theIndexTableCache)
+Q_GLOBAL_STATIC(JP2K_BufferPool, theJP2K_BufferPool)
+
+
+JP2K_BufferPool::JP2K_BufferPool() :
+mMutex(), mIdle(), mIdleBytes(0) {
+
+}
+
+JP2K_BufferPool::~JP2K_BufferPool() {
+
+	for(int i = 0; i < mIdle.size(); i++) {
+		qFreeAligned(mIdle.at(i)->pData);
+		delete mIdle.at(i);
+	}
+}
+
+JP2K_BufferPool* JP2K_BufferPool::GetGlobalInstance() {
+
+	return theJP2K_BufferPool();
+}
+
+QSharedPointer<JP2K_Buffer> JP2K_BufferPool::Acquire(qint64 size) {
+
+	if(size <= 0) return QSharedPointer<JP2K_Buffer>();
+	const qint64 capacity = (size + BUFFER_GRANULARITY - 1) / BUFFER_GRANULARITY * BUFFER_GRANULARITY;
+	JP2K_Buffer *p_buffer = NULL;
+	{
+		QMutexLocker locker(&mMutex);
+		// Best fit, don't waste large (batch) buffers on single frames.
+		int best = -1;
+		for(int i = 0; i < mIdle.size(); i++) {
+			const qint64 idle_capacity = mIdle.at(i)->capacity;
+			if(idle_capacity >= capacity && idle_capacity <= 2 * capacity && (best < 0 || idle_capacity < mIdle.at(best)->capacity)) best = i;
+		}
+		if(best >= 0) {
+			p_buffer = mIdle.takeAt(best);
+			mIdleBytes -= p_buffer->capacity;
+		}
+	}
+	if(p_buffer == NULL) {
+		uchar *p_data = (uchar*)qMallocAligned(capacity, BUFFER_ALIGNMENT);
+		if(p_data == NULL) return QSharedPointer<JP2K_Buffer>();
+		p_buffer = new JP2K_Buffer;
+		p_buffer->pData = p_data;
+		p_buffer->capacity = capacity;
+	}
+	return QSharedPointer<JP2K_Buffer>(p_buffer, &JP2K_BufferPool::Recycle);
+}
+
+void JP2K_BufferPool::Recycle(JP2K_Buffer *pBuffer) {
+
+	if(theJP2K_BufferPool.isDestroyed() == false) {
+		theJP2K_BufferPool()->Release(pBuffer);
+	}
+	else { // application exit
+		qFreeAligned(pBuffer->pData);
+		delete pBuffer;
+	}
+}
+
+void JP2K_BufferPool::Release(JP2K_Buffer *pBuffer) {
+
+	QMutexLocker locker(&mMutex);
+	if(mIdleBytes + pBuffer->capacity > max_idle_bytes) {
+		qFreeAligned(pBuffer->pData);
+		delete pBuffer;
+		return;
+	}
+	mIdle.push_back(pBuffer);
+	mIdleBytes += pBuffer->capacity;
+}
+
+JP2K_FrameReader::JP2K_FrameReader() :
+mFilePath(), mFile(), mpAsdcpReader(NULL), mIndex(), mIsPlainKlv(false), mReadAhead(0), mPrefetchedFirst(-1), mPrefetched() {
+
+}
+
+JP2K_FrameReader::~JP2K_FrameReader() {
+
+	Close();
+}
+
+bool JP2K_FrameReader::Open(const QString &rMxfFilePath, QString &rErrorMsg) {
+
+	Close();
+	mFilePath = QFileInfo(rMxfFilePath).absoluteFilePath();
+	mFile.setFileName(mFilePath);
+	if(mFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered) == false) {
+		rErrorMsg = QString("Failed to open %1: %2").arg(mFilePath).arg(mFile.errorString());
+		return false;
+	}
+	const FileIdentity identity = FileIdentity::FromFile(QFileInfo(mFilePath));
+	IndexTableCache::Entry entry;
+	if(theIndexTableCache()->Lookup(mFilePath, identity, entry) == false) {
+		// Parse the index table once.
+		if(OpenAsdcp(rErrorMsg) == false) {
+			Close();
+			return false;
+		}
+		const ui32_t duration = mpAsdcpReader->AS02IndexReader().GetDuration();
+		QVector<qint64> *p_offsets = new QVector<qint64>(duration);
+		ASDCP::MXF::IndexTableSegment::IndexEntry index_entry;
+		for(ui32_t i = 0; i < duration; i++) {
+			if(ASDCP_FAILURE(mpAsdcpReader->AS02IndexReader().Lookup(i, index_entry))) {
+				rErrorMsg = QString("Frame does not exist: %1").arg(i);
+				delete p_offsets;
+				Close();
+				return false;
+			}
+			(*p_offsets)[i] = index_entry.StreamOffset;
+		}
+		entry.identity = identity;
+		entry.offsets = QSharedPointer<const QVector<qint64> >(p_offsets);
+		// Frames are read directly if the index points at plain picture elements.
+		uchar header[KLV_HEADER_MAX_SIZE];
+		qint64 value_length = 0;
+		QString error_msg;
+		entry.isPlainKlv = duration > 0 && ReadAt(p_offsets->first(), header, sizeof(header), error_msg) == true && parse_picture_element(header, sizeof(header), value_length) > 0;
+		theIndexTableCache()->Insert(mFilePath, entry);
+	}
+	mIndex = entry.offsets;
+	mIsPlainKlv = entry.isPlainKlv;
+	return true;
+}
+
+void JP2K_FrameReader::Close() {
+
+	mPrefetched.clear();
+	mPrefetchedFirst = -1;
+	mIndex.clear();
+	mIsPlainKlv = false;
+	if(mpAsdcpReader) {
+		mpAsdcpReader->Close();
+		delete mpAsdcpReader;
+		mpAsdcpReader = NULL;
+	}
+	mFile.close();
+}
+
+bool JP2K_FrameReader::OpenAsdcp(QString &rErrorMsg) {
+
+	if(mpAsdcpReader) return true;
+	mpAsdcpReader = new AS_02::JP2K::MXFReader();
+	Result_t result = mpAsdcpReader->OpenRead(mFilePath.toStdString());
+	if(ASDCP_FAILURE(result)) {
+		rErrorMsg = QString("Failed to open reader: %1").arg(result.Label());
+		delete mpAsdcpReader;
+		mpAsdcpReader = NULL;
+		return false;
+	}
+	return true;
+}
+
+void JP2K_FrameReader::SetReadAhead(int frameCount) {
+
+	mReadAhead = qMax(0, frameCount);
+}
+
+bool JP2K_FrameReader::ReadFrame(qint64 frameNr, JP2K_CodeStream &rCodeStream, QString &rErrorMsg) {
+
+	const qint64 prefetched_index = frameNr - mPrefetchedFirst;
+	if(mPrefetchedFirst >= 0 && prefetched_index >= 0 && prefetched_index < mPrefetched.size()) {
+		rCodeStream = mPrefetched.at(prefetched_index);
+		return true;
+	}
+	QList<JP2K_CodeStream> code_streams;
+	if(mPrefetchedFirst >= 0 && frameNr < mPrefetchedFirst && frameNr >= mPrefetchedFirst - mReadAhead) {
+		// Late request of a parallel decoder: keep the batch.
+		if(ReadFrames(frameNr, 1, code_streams, rErrorMsg) == false) return false;
+		rCodeStream = code_streams.first();
+		return true;
+	}
+	mPrefetched.clear(); // Releases the previous batch.
+	mPrefetchedFirst = -1;
+	if(ReadFrames(frameNr, 1 + mReadAhead, code_streams, rErrorMsg) == false) return false;
+	rCodeStream = code_streams.first();
+	if(code_streams.size() > 1) {
+		mPrefetched = code_streams;
+		mPrefetchedFirst = frameNr;
+	}
+	return true;
+}
+
+bool JP2K_FrameReader::ReadFrames(qint64 firstFrameNr, int count, QList<JP2K_CodeStream> &rCodeStreams, QString &rErrorMsg) {
+
+	rCodeStreams.clear();
+	if(IsOpen() == false) {
+		rErrorMsg = "Reader is not open!";
+		return false;
+	}
+	const QVector<qint64> &offsets = *mIndex;
+	const qint64 frame_count = offsets.size();
+	if(firstFrameNr < 0 || firstFrameNr >= frame_count || count < 1) {
+		rErrorMsg = QString("Frame does not exist: %1").arg(firstFrameNr);
+		return false;
+	}
+	count = (int)qMin<qint64>(count, frame_count - firstFrameNr);
+
+	if(mIsPlainKlv == true) {
+		// The packet of a frame ends where the next one starts. The end of the last packet is taken from its KLV header.
+		const qint64 start = offsets.at(firstFrameNr);
+		qint64 end = -1;
+		while(count > 0) {
+			const qint64 last = firstFrameNr + count - 1;
+			if(last + 1 < frame_count) end = offsets.at(last + 1);
+			else {
+				uchar header[KLV_HEADER_MAX_SIZE];
+				qint64 value_length = 0;
+				const int header_length = ReadAt(offsets.at(last), header, sizeof(header), rErrorMsg) ? parse_picture_element(header, sizeof(header), value_length) : 0;
+				end = header_length > 0 ? offsets.at(last) + header_length + value_length : -1;
+			}
+			if(count == 1 || (end > start && end - start <= max_batch_bytes)) break;
+			count--;
+		}
+		if(end > start && end - start <= max_batch_bytes) {
+			QSharedPointer<JP2K_Buffer> buffer = JP2K_BufferPool::GetGlobalInstance()->Acquire(end - start);
+			if(!buffer) {
+				rErrorMsg = QString("Couldn't allocate %1 bytes for frame %2").arg(end - start).arg(firstFrameNr);
+				return false;
+			}
+			if(ReadAt(start, buffer->pData, end - start, rErrorMsg) == false) return false;
+			for(int i = 0; i < count; i++) {
+				const qint64 frame_nr = firstFrameNr + i;
+				const qint64 packet_start = offsets.at(frame_nr) - start;
+				const qint64 packet_end = (i + 1 < count ? offsets.at(frame_nr + 1) : end) - start;
+				qint64 value_length = 0;
+				const int header_length = packet_end > packet_start ? parse_picture_element(buffer->pData + packet_start, packet_end - packet_start, value_length) : 0;
+				JP2K_CodeStream code_stream;
+				if(header_length > 0 && value_length > 0 && header_length + value_length <= packet_end - packet_start) {
+					code_stream.buffer = buffer;
+					code_stream.pData = buffer->pData + packet_start + header_length;
+					code_stream.size = value_length;
+				}
+				else if(ReadFrameAsdcp(frame_nr, code_stream, rErrorMsg) == false) return false; // e.g. an encrypted frame
+				rCodeStreams.push_back(code_stream);
+			}
+			return true;
+		}
+#ifdef DEBUG_JP2K
+		qDebug() << "Frame" << firstFrameNr << "isn't bounded by the index table, reading through ASDCP";
+#endif
+	}
+
+	for(int i = 0; i < count; i++) {
+		JP2K_CodeStream code_stream;
+		if(ReadFrameAsdcp(firstFrameNr + i, code_stream, rErrorMsg) == false) return false;
+		rCodeStreams.push_back(code_stream);
+	}
+	return true;
+}
+
+bool JP2K_FrameReader::ReadFrameAsdcp(qint64 frameNr, JP2K_CodeStream &rCodeStream, QString &rErrorMsg) {
+
+	if(OpenAsdcp(rErrorMsg) == false) return false;
+	const QVector<qint64> &offsets = *mIndex;
+	// The distance to the next packet (or to the end of the file) bounds the size of the codestream.
+	qint64 capacity = (frameNr + 1 < offsets.size() ? offsets.at(frameNr + 1) : mFile.size()) - offsets.at(frameNr);
+	if(capacity <= 0 || capacity > max_batch_bytes) capacity = FALLBACK_BUFFER_SIZE;
+	QSharedPointer<JP2K_Buffer> buffer = JP2K_BufferPool::GetGlobalInstance()->Acquire(capacity);
+	if(!buffer) {
+		rErrorMsg = QString("Couldn't allocate %1 bytes for frame %2").arg(capacity).arg(frameNr);
+		return false;
+	}
+	ASDCP::JP2K::FrameBuffer frame_buffer;
+	frame_buffer.SetData(buffer->pData, (ui32_t)buffer->capacity); // not owned, the buffer returns to the pool
+	Result_t result = mpAsdcpReader->ReadFrame((ui32_t)frameNr, frame_buffer, NULL, NULL);
+	if(ASDCP_FAILURE(result)) {
+		rErrorMsg = QString("Error reading frame %1: %2").arg(frameNr).arg(result.Label());
+		return false;
+	}
+	rCodeStream.buffer = buffer;
+	rCodeStream.pData = buffer->pData;
+	rCodeStream.size = frame_buffer.Size();
+	return true;
+}
+
+bool JP2K_FrameReader::ReadAt(qint64 position, uchar *pData, qint64 size, QString &rErrorMsg) {
+
+	if(mFile.seek(position) == false) {
+		rErrorMsg = QString("Couldn't seek to %1: %2").arg(position).arg(mFile.errorString());
+		return false;
+	}
+	qint64 length = 0;
+	while(length < size) {
+		const qint64 count = mFile.read((char*)pData + length, size - length);
+		if(count <= 0) {
+			rErrorMsg = QString("Couldn't read %1 bytes at %2: %3").arg(size).arg(position).arg(count < 0 ? mFile.errorString() : QString("end of file"));
+			return false;
+		}
+		length += count;
+	}
+	return true;
+}
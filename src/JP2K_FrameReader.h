@@ -0,0 +1,108 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include "AS_02.h"
+#include <QtGlobal>
+#include <QString>
+#include <QFile>
+#include <QList>
+#include <QVector>
+#include <QMutex>
+#include <QSharedPointer>
+
+
+//! Aligned memory block handed out by the JP2K_BufferPool.
+struct JP2K_Buffer {
+	uchar *pData;
+	qint64 capacity;
+};
+
+
+/*! \brief
+Process wide pool of aligned codestream buffers. Buffers are recycled instead of freed, so scrubbing and playback don't allocate per frame.
+Idle buffers exceeding JP2K_BufferPool::max_idle_bytes are freed. This class is thread safe.
+*/
+class JP2K_BufferPool {
+
+public:
+	static const qint64 max_idle_bytes = 256ll * 1024 * 1024;
+	//! Use JP2K_BufferPool::GetGlobalInstance().
+	JP2K_BufferPool();
+	~JP2K_BufferPool();
+	static JP2K_BufferPool* GetGlobalInstance();
+	//! Returns a buffer of at least size bytes. The buffer returns to the pool when the last reference is dropped. Returns a NULL pointer if the memory couldn't be allocated.
+	QSharedPointer<JP2K_Buffer> Acquire(qint64 size);
+
+private:
+	Q_DISABLE_COPY(JP2K_BufferPool);
+	static void Recycle(JP2K_Buffer *pBuffer);
+	void Release(JP2K_Buffer *pBuffer);
+
+	QMutex mMutex;
+	QList<JP2K_Buffer*> mIdle;
+	qint64 mIdleBytes;
+};
+
+
+//! Codestream of one frame. Points into a pooled buffer that may hold several frames (see JP2K_FrameReader::ReadFrames()).
+struct JP2K_CodeStream {
+	JP2K_CodeStream() : buffer(), pData(NULL), size(0) {}
+	bool IsValid() const { return pData != NULL && size > 0; }
+	QSharedPointer<JP2K_Buffer> buffer; // keeps pData alive
+	const uchar *pData;
+	qint64 size;
+};
+
+
+/*! \brief
+Reads the JP2K codestreams of a frame wrapped AS-02 track.
+The index table is parsed once per file and shared by all readers of the file. The size of a frame is taken from its KLV header (no guessing), frames are read into buffers of the JP2K_BufferPool.
+Consecutive frames are fetched with a single read (see JP2K_FrameReader::ReadFrames() and JP2K_FrameReader::SetReadAhead()).
+Falls back to ASDCP if the essence isn't stored as plain KLV packets (e.g. encrypted essence). This class is not thread safe.
+*/
+class JP2K_FrameReader {
+
+public:
+	static const qint64 max_batch_bytes = 128ll * 1024 * 1024; // upper limit of a single read
+	JP2K_FrameReader();
+	~JP2K_FrameReader();
+	bool Open(const QString &rMxfFilePath, QString &rErrorMsg);
+	void Close();
+	bool IsOpen() const { return !mIndex.isNull(); }
+	QString GetFilePath() const { return mFilePath; }
+	qint64 GetFrameCount() const { return mIndex ? mIndex->size() : 0; }
+	//! Number of frames following a requested frame that are read along with it and kept for subsequent requests (0: no read ahead, default). Use for playback.
+	void SetReadAhead(int frameCount);
+	bool ReadFrame(qint64 frameNr, JP2K_CodeStream &rCodeStream, QString &rErrorMsg);
+	//! Reads up to count consecutive frames starting at firstFrameNr. Fewer frames are returned if the range exceeds the track or JP2K_FrameReader::max_batch_bytes.
+	bool ReadFrames(qint64 firstFrameNr, int count, QList<JP2K_CodeStream> &rCodeStreams, QString &rErrorMsg);
+
+private:
+	Q_DISABLE_COPY(JP2K_FrameReader);
+	bool ReadAt(qint64 position, uchar *pData, qint64 size, QString &rErrorMsg);
+	//! Reads frameNr through ASDCP into a pooled buffer.
+	bool ReadFrameAsdcp(qint64 frameNr, JP2K_CodeStream &rCodeStream, QString &rErrorMsg);
+	bool OpenAsdcp(QString &rErrorMsg);
+
+	QString mFilePath;
+	QFile mFile;
+	AS_02::JP2K::MXFReader *mpAsdcpReader; // opened on demand
+	QSharedPointer<const QVector<qint64> > mIndex; // file offset of the KLV packet of every frame
+	bool mIsPlainKlv;
+	int mReadAhead;
+	qint64 mPrefetchedFirst;
+	QList<JP2K_CodeStream> mPrefetched;
+};
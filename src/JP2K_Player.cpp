@@ -22,103 +22,89 @@
 #include <QThreadpool>  
 //#define DEBUG_MSGS
 
-JP2K_Player::JP2K_Player() {
-
-	decoded_shared = static_cast<QSharedPointer<DecodedFrames>>(new DecodedFrames);
-
-	timer = new QTime();
-	timer->start();
-
-	// create lookup tables
-	max_f = 1 << bitdepth;
-	max_f_ = (float)(max_f)-1.0;
-
-	oetf_709 = new float[max_f];
+namespace
+{
 
-	float alpha = 1.09929682680944;
-	float beta = 0.018053968510807;
-	eotf_2020 = new float[max_f];
+// Upper limit for the memory occupied by decoded frames waiting for presentation [byte].
+const qint64 look_ahead_memory_budget = 1024ll * 1024 * 1024;
+// The play loop wakes up at least this often [us].
+const qint64 max_wait_us = 50000;
+// Presentation is rescheduled if a frame is shown later than this [us].
+const qint64 max_latency_us = 500000;
+// Playback stops if no frame was decoded within this time [us].
+const qint64 stall_timeout_us = 5000000;
+// Largest resolution reduction of the quality ladder (see WidgetVideoPreview).
+const int max_reduction = 5;
 
-	float m1 = 0.1593017578125;
-	float m2 = 78.84375;
-	float c1 = 0.8359375;
-	float c2 = 18.8515625;
-	float c3 = 18.6875;
-	eotf_PQ = new float[max_f];
+}
 
-	for (int i = 0; i < max_f; i++) {
+ // #################################################### JP2K_FrameRing #######################################################
+void JP2K_FrameRing::Clear() {
 
-		float input = (float)(i / max_f_); // convert input to value between 0...1
+	while (!IsEmpty()) PopFront();
+	mHead = 0;
+	mTail = 0;
+}
 
-		// BT.709 - OETF (Inverse of BT.1886 EOTF)
-		oetf_709[i] = pow(input, 1.0f / 2.4f);
+void JP2K_FrameRing::Push(const QSharedPointer<FrameRequest> &rRequest) {
 
-		// BT.2020 - EOTF
-		if (input < (4.5 * beta)) {
-			eotf_2020[i] = input / 4.5;
-		}
-		else {
-			eotf_2020[i] = pow(((input + (alpha - 1)) / alpha), 1.0 / 0.45);
-		}
+	Q_ASSERT(!IsFull());
+	mSlots[(int)(mTail % capacity)] = rRequest;
+	mTail++;
+}
 
-		// PQ
-		eotf_PQ[i] = pow(((pow(input, (1.0 / m2)) - c1)) / (c2 - c3 *pow(input, (1.0 / m2))), 1.0 / m1) * 10000;
-	}
+void JP2K_FrameRing::PopFront() {
 
-	eotf_PQ[0] = 0;
+	Q_ASSERT(!IsEmpty());
+	QSharedPointer<FrameRequest> &r_slot = mSlots[(int)(mHead % capacity)];
+	r_slot->state.testAndSetRelaxed(FrameRequest::Pending, FrameRequest::Canceled); // a running decoder finishes into the orphaned request
+	r_slot.clear();
+	mHead++;
+}
 
-	threadPool = new QThreadPool();
+ // #################################################### JP2K_Player #######################################################
+JP2K_Player::JP2K_Player() :
+state_mutex(QMutex::Recursive) {
 
-	// create request array
-	for (int i = 0; i < decoders; i++) {
-		request_queue[i] = new FrameRequest();
-		pointer_queue[i] = static_cast<QSharedPointer<FrameRequest>>(request_queue[i]);
-		decoder_queue[i] = new JP2K_Decoder(decoded_shared, pointer_queue[i], oetf_709, eotf_2020, eotf_PQ);
-		decoder_queue[i]->setAutoDelete(false);
-	}
+	completed = QSharedPointer<QSemaphore>(new QSemaphore(0));
+	decoderPool = new JP2K_DecoderPool();
+	clock.start();
+	buildQualityLadder();
 }
 
 JP2K_Player::~JP2K_Player()
 {
-	timer->~QTime();
-	for (int i = 0; i < decoders; i++) {
-		request_queue[i]->~FrameRequest();
-		threadPool->cancel(decoder_queue[i]);
-	}
-	threadPool->~QThreadPool();
-
-	delete oetf_709;
-	delete eotf_2020;
-	delete eotf_PQ;
+	ring.Clear();
+	delete decoderPool; // waits for running decoders, they hold their own reference to the request
 }
 
 void JP2K_Player::startPlay(){
 
-	// reset all requests
-	for (int i = 0; i < decoders; i++) {
-		request_queue[i]->decoded = nullimage;
-		request_queue[i]->done = false;
-		request_queue[i]->error = false;
-		request_queue[i]->errorMsg.clear();
-		request_queue[i]->frameNr = -1;
-		request_queue[i]->fps = fps;
-	}
-
-	clean();
+	{
+		QMutexLocker locker(&state_mutex);
+		clean();
 
-	if (playlist.length() > 0) {
+		if (playlist.length() == 0) {
+			emit playerInfo("No/empty playlist!");
+			return;
+		}
+		setQualityRung(adaptive_quality ? initialRung() : 0);
+		look_ahead = qBound(minLookAhead(), fps, maxLookAhead());
+		on_time_count = 0;
+		last_progress_us = clock.nsecsElapsed() / 1000;
+		next_info_us = 0;
+		completed->tryAcquire(completed->available()); // completions of the previous play cycle
 		buffering = true;
-		playing = true;
-		playLoop();
-	}
-	else {
-		emit playerInfo("No/empty playlist!");
+		playing.storeRelease(1);
 	}
+	playLoop();
 }
 
 // lets the player know where the slider is at the moment
 void JP2K_Player::setPos(qint64 rframeNr, qint64 rTframeNr, int rplaylist_index) {
 
+	QMutexLocker locker(&state_mutex);
+
 	decoding_index = rplaylist_index; 
 	playing_index = rplaylist_index; 
 	playlist_index = rplaylist_index; 
@@ -135,21 +121,20 @@ void JP2K_Player::setPos(qint64 rframeNr, qint64 rTframeNr, int rplaylist_index)
 
 void JP2K_Player::clean() {
 
-	playing = false;
+	QMutexLocker locker(&state_mutex);
+
+	playing.storeRelease(0);
 
 	// cancel all decoding processes
-	for (int i = 0; i < decoders; i++) {
-		threadPool->cancel(decoder_queue[i]);
-	}
+	decoderPool->CancelPending();
+	ring.Clear();
 
 	// reset vars
-	decoded_shared->decoded_total = 0;
-	decoded_shared->pending_requests = 0;
-
 	player_position_counter = 0;
 	requested_frames_total = 0;
 	played_frames_total = 0;
-	request_index = 0;
+	dropped_frames_total = 0;
+	buffering = true;
 
 	if (!started_playing) { // reset values to last cursor position!
 		decoding_index = playlist_index;
@@ -172,167 +157,325 @@ void JP2K_Player::clean() {
 	started_playing = false;
 }
 
+bool JP2K_Player::hasFramesToRequest() const {
 
-void JP2K_Player::playLoop(){
-	while (playing) {
+	return frame_decoding_total_float <= last_frame_total && decoding_index < playlist.size();
+}
 
-		timer->restart(); // measure loop cycle duration
+void JP2K_Player::scheduleRequests() {
 
-		// calculate buffer fill time
-		if (decoded_shared->pending_requests >= (float)fps*1.2) {
+	while (ring.GetSize() < look_ahead && hasFramesToRequest()) {
 
-			int new_fps = fps - (decoded_shared->pending_requests - fps);
+		QSharedPointer<FrameRequest> request(new FrameRequest());
+		request->frameNr = playlist.at(decoding_index).in + ((int)frame_decoding_asset_float - playlist.at(decoding_index).in) % playlist.at(decoding_index).Duration;
+		request->TframeNr = (int)(frame_decoding_total_float);
+		request->layer = quality_ladder.at(quality_rung).reduce;
+		request->qualityLayers = quality_ladder.at(quality_rung).qualityLayers;
+		request->convert709 = convert709;
+		request->rung = quality_rung;
+		request->fps = fps;
+		request->completed = completed;
+		ring.Push(request);
 
-			if (new_fps == 0) {
-				emit ShowMsgBox(QString("No images where decoded within one second.\nPlease consider selecting a smaller resolution. This may significantly increase decoding speed!"), 0);
-			}
-			else {
-				emit ShowMsgBox(QString("There are %1 pending requests! Reduce frame rate from %2 to %3?").arg(decoded_shared->pending_requests).arg(fps).arg(new_fps), new_fps);
-			}
+		// check if asset is valid
+		if (playlist.at(decoding_index).asset) { // asset is valid -> decode it!
 
-			playing = false;
-			this->thread()->quit();
-			return;
+			request->asset = playlist.at(decoding_index).asset; // set asset in request
+			decoderPool->Decode(request);
+		}
+		else { // asset is invalid? -> set error image
+			request->decoded = QImage(":/frame_blank.png");
+			request->state.storeRelease(FrameRequest::Done);
 		}
 
-		// calculate buffer size
-		buffer_size = decoded_shared->decoded_total - played_frames_total;
-		emit playerInfo(QString("Buffer: %1").arg(buffer_size));
+		requested_frames_total++;
 
-		// request new frame
-		if (buffer_size <= fps && frame_decoding_total_float <= last_frame_total && decoding_index < playlist.size()) {
+		// attempt "real speed" playback?
+		if (realspeed) {
+			frame_decoding_asset_float += skip_frames;
+			frame_decoding_total_float += skip_frames;
+		}
+		else { // frame by frame playback
+			frame_decoding_asset_float++;
+			frame_decoding_total_float++;
+		}
+		if (frame_decoding_asset_float >= playlist[decoding_index].out) {
+			if (decoding_index < (playlist.length() - 1)) {
+				decoding_index++; // move on to next asset
+				frame_decoding_asset_float = (frame_decoding_asset_float - playlist.at(decoding_index - 1).out) + playlist.at(decoding_index).in;
+			}
+		}
+	}
+}
 
-			request_index = requested_frames_total % decoders;
-			
-			request_queue[request_index]->frameNr = playlist.at(decoding_index).in + ((int)frame_decoding_asset_float - playlist.at(decoding_index).in) % playlist.at(decoding_index).Duration;
-			//request_queue[request_index]->frameNr = (int)frame_decoding_asset_float;
-			request_queue[request_index]->TframeNr = (int)(frame_decoding_total_float);
-			request_queue[request_index]->error = false;
-			request_queue[request_index]->layer = layer;
+void JP2K_Player::cancelOverdue(qint64 now_us) {
 
-			// check if asset is valid
-			if (playlist.at(decoding_index).asset) { // asset is valid -> open reader!
+	// Decoding them would delay the frames which can still be shown in time.
+	const qint64 period_us = 1000000 / qMax(1, fps);
+	for (int i = 0; i < ring.GetSize(); i++) {
+		if (clock_origin_us + (played_frames_total + i) * period_us >= now_us) break;
+		ring.At(i)->state.testAndSetRelaxed(FrameRequest::Pending, FrameRequest::Canceled);
+	}
+}
 
-				request_queue[request_index]->asset = playlist.at(decoding_index).asset; // set asset in request
-				request_queue[request_index]->done = false;
-				threadPool->start(decoder_queue[request_index], QThread::HighPriority);
-			}
-			else { // asset is invalid? -> set error image
-				request_queue[request_index]->done = true;
-				request_queue[request_index]->decoded = QImage(":/frame_blank.png");
+int JP2K_Player::readyCount() const {
 
-				decoded_shared->decoded_total++;
-				decoded_shared->pending_requests--;
-			}
+	int ready = 0;
+	while (ready < ring.GetSize() && ring.At(ready)->state.loadAcquire() >= FrameRequest::Done) ready++;
+	return ready;
+}
 
-			requested_frames_total++;
-			decoded_shared->pending_requests++;
+void JP2K_Player::advancePlayhead() {
 
-			// attempt "real speed" playback?
-			if (realspeed) {
-				frame_decoding_asset_float += skip_frames;
-				frame_decoding_total_float += skip_frames;
-			}
-			else { // frame by frame playback
-				frame_decoding_asset_float++;
-				frame_decoding_total_float++;
-			}
-			if (frame_decoding_asset_float >= playlist[decoding_index].out) {
-				if (decoding_index < (playlist.length() - 1)) {
-					decoding_index++; // move on to next asset
-					frame_decoding_asset_float = (frame_decoding_asset_float - playlist.at(decoding_index - 1).out) + playlist.at(decoding_index).in;
-				}
-			}
-		}
-		else {
-			buffering = false; // start playing out frames (again)
+	// show player position every fps nr of frames
+	if (player_position_counter >= fps) {
+		emit currentPlayerPosition((int)frame_playing_total_float, false); // update every second
+		if (show_subtitles) emit playTTML();
+		player_position_counter = 0;
+	}
+
+	if (frame_playing_asset_float >= playlist[playing_index].out) {
+		if (playing_index < (playlist.length() - 1)) {
+
+			playing_index++; // move on to next asset
+			frame_playing_asset_float = (frame_playing_asset_float - playlist.at(playing_index - 1).out) + playlist.at(playing_index).in;
 		}
+	}
 
-		// play out frames?
-		if (!buffering && (decoded_shared->decoded_total > fps || frame_decoding_total_float >= last_frame_total) && buffer_size > 0) {
+	// attempt "real speed" playback?
+	if (realspeed) {
+		frame_playing_total_float += skip_frames;
+		frame_playing_asset_float += skip_frames;
+	}
+	else { // frame by frame playback
+		frame_playing_total_float++;
+		frame_playing_asset_float++;
+	}
 
-			// show player position every fps nr of frames
-			if (player_position_counter >= fps) {
-				emit currentPlayerPosition((int)frame_playing_total_float, false); // update every second
-				if (show_subtitles) emit playTTML();
-				player_position_counter = 0;
-			}
+	player_position_counter++; // count to fps, then move frame indicator
+	played_frames_total++; // total number of frames played out (or dropped) in current play-cycle
+	started_playing = true;
+}
 
-			if (request_queue[played_frames_total % decoders]->done) { // frame exists -> show it
+void JP2K_Player::adaptLookAhead(bool late) {
 
-				emit showFrame(request_queue[played_frames_total % decoders]->decoded);
+	if (late) { // absorb the decoding jitter with more frames in flight
+		look_ahead = qMin(look_ahead + 2, maxLookAhead());
+		on_time_count = 0;
+	}
+	else if (++on_time_count >= qMax(1, fps)) { // one second in time -> give back memory
+		look_ahead = qMax(look_ahead - 1, minLookAhead());
+		on_time_count = 0;
+	}
+}
 
-				if (frame_playing_total_float >= last_frame_total) { // last frame was played!
-					
-					if(player_position_counter > 0) emit currentPlayerPosition(last_frame_total, true); // set last position
-					emit playbackEnded();
+int JP2K_Player::minLookAhead() const {
 
-					setPos(playlist.at(0).in, 0, 0);
+	return qMin(decoderPool->GetDecoderCount() + 1, (int)JP2K_FrameRing::capacity);
+}
 
-					clean();
-					return;
-				}
+int JP2K_Player::maxLookAhead() const {
 
-				if (frame_playing_asset_float >= playlist[playing_index].out) {
-					if (playing_index < (playlist.length() - 1)) {
+	const qint64 layer_bytes = frame_bytes >> (2 * quality_ladder.at(quality_rung).reduce); // every layer halves width and height
+	const qint64 max_frames = layer_bytes > 0 ? look_ahead_memory_budget / layer_bytes : JP2K_FrameRing::capacity;
+	return qMax(minLookAhead(), (int)qMin<qint64>(max_frames, JP2K_FrameRing::capacity));
+}
 
-						playing_index++; // move on to next asset
-						frame_playing_asset_float = (frame_playing_asset_float - playlist.at(playing_index - 1).out) + playlist.at(playing_index).in;
-					}
-				}
+void JP2K_Player::waitForDecoder(qint64 timeout_us) {
 
-				// attempt "real speed" playback?
-				if (realspeed) {
-					frame_playing_total_float += skip_frames;
-					frame_playing_asset_float += skip_frames;
-				}
-				else { // frame by frame playback
-					frame_playing_total_float++;
-					frame_playing_asset_float++;
-				}
+	if (timeout_us <= 0) return;
+	const int timeout_ms = (int)qMin<qint64>((timeout_us + 999) / 1000, max_wait_us / 1000);
+	if (completed->tryAcquire(1, timeout_ms)) {
+		completed->tryAcquire(completed->available()); // the loop checks all requests anyway
+		last_progress_us = clock.nsecsElapsed() / 1000;
+	}
+}
+
+void JP2K_Player::buildQualityLadder() {
+
+	// Every resolution is tried with all quality layers first, then with the first quality layer only.
+	quality_ladder.clear();
+	for (int reduce = layer; reduce <= qMax(layer, max_reduction); reduce++) {
+		quality_ladder.push_back(JP2K_QualityRung(reduce, 0));
+		if (reduce < max_reduction) quality_ladder.push_back(JP2K_QualityRung(reduce, 1));
+	}
+	quality_rung = 0;
+	quality_frames = 0;
+	quality_drops = 0;
+}
+
+qint64 JP2K_Player::qualityBudget() const {
+
+	return decoderPool->GetDecoderCount() * (1000000 / qMax(1, fps)); // the decoders run in parallel
+}
+
+int JP2K_Player::initialRung() const {
+
+	const qint64 budget_us = qualityBudget();
+	for (int i = 0; i < quality_ladder.size(); i++) {
+		if (quality_ladder.at(i).cost_us < 0 || quality_ladder.at(i).cost_us <= budget_us * 9 / 10) return i;
+	}
+	return quality_ladder.size() - 1;
+}
+
+void JP2K_Player::setQualityRung(int rung) {
+
+	quality_rung = qBound(0, rung, quality_ladder.size() - 1);
+	quality_frames = 0;
+	quality_drops = 0;
+	look_ahead = qMin(look_ahead, maxLookAhead());
+}
+
+void JP2K_Player::adaptQuality(const FrameRequest &rRequest, bool dropped) {
+
+	if (!adaptive_quality) return;
+	if (rRequest.decodeTime_us >= 0 && rRequest.rung < quality_ladder.size()) {
+		qint64 &r_cost_us = quality_ladder[rRequest.rung].cost_us;
+		r_cost_us = r_cost_us < 0 ? rRequest.decodeTime_us : (3 * r_cost_us + rRequest.decodeTime_us) / 4; // moving average
+	}
+	if (rRequest.rung != quality_rung) return; // requested before the last change
+
+	quality_frames++;
+	if (dropped) quality_drops++;
+	if (quality_frames < qMax(minLookAhead(), fps / 2)) return; // wait for enough frames of the current rung
+
+	const qint64 budget_us = qualityBudget();
+	const JP2K_QualityRung &r_current = quality_ladder.at(quality_rung);
+	if ((quality_drops * 20 > quality_frames || r_current.cost_us > budget_us * 9 / 10) && quality_rung < quality_ladder.size() - 1) {
+		setQualityRung(quality_rung + 1); // falling behind -> decode faster
+	}
+	else if (quality_frames >= qMax(1, fps)) { // evaluated once per second
+		if (quality_drops == 0 && quality_rung > 0 && r_current.cost_us >= 0) {
+			const JP2K_QualityRung &r_better = quality_ladder.at(quality_rung - 1);
+			// unknown costs are estimated: a resolution step quadruples the pixels, all quality layers at most double the work
+			const qint64 estimate_us = r_better.cost_us >= 0 ? r_better.cost_us : r_current.cost_us * (r_better.reduce < r_current.reduce ? 4 : 2);
+			if (estimate_us < budget_us * 3 / 4) {
+				setQualityRung(quality_rung - 1); // pipeline caught up -> better quality
+				return;
 			}
-			else if (request_queue[played_frames_total % decoders]->error) { // an error occured during the decoding process!
-					
-				if (player_position_counter > 0) emit currentPlayerPosition((int)frame_playing_total_float, false); // set player position
-				emit playerInfo(QString("DECODING ERROR: %1, FRAME: %2").arg(request_queue[played_frames_total % decoders]->errorMsg).arg(request_queue[played_frames_total % decoders]->frameNr));
+		}
+		quality_frames = 0;
+		quality_drops = 0;
+	}
+}
+
+QString JP2K_Player::qualityString() const {
+
+	const JP2K_QualityRung &r_rung = quality_ladder.at(quality_rung);
+	QString quality = QString("Quality: 1/%1").arg(1 << r_rung.reduce);
+	if (r_rung.qualityLayers > 0) quality.append(QString(" (%1 layer)").arg(r_rung.qualityLayers));
+	return quality;
+}
+
+void JP2K_Player::playLoop(){
+
+	while (playing.loadAcquire()) {
+
+		qint64 wait_us = max_wait_us;
+		{
+			QMutexLocker locker(&state_mutex);
+			if (!playing.loadAcquire()) break; // stopped by the gui thread
+
+			scheduleRequests();
+
+			const qint64 now_us = clock.nsecsElapsed() / 1000;
+			const qint64 period_us = 1000000 / qMax(1, fps);
+
+			if (ring.IsEmpty() && !hasFramesToRequest()) { // playback has ended!
+
+				if (player_position_counter > 0) emit currentPlayerPosition(last_frame_total, true); // set last position
 				emit playbackEnded();
+				emit playerInfo("playback ended!");
+
+				setPos(playlist.at(0).in, 0, 0);
 
 				clean();
 				return;
 			}
-			else { // frame not found!
-				emit showFrame(nullimage);
-				emit playerInfo("PLAYER ERROR: decoded frame not found!");
+
+			if (now_us - last_progress_us > stall_timeout_us) { // decoders are stuck or far too slow
+
+				emit ShowMsgBox(QString("No images where decoded within %1 seconds.\nPlease consider selecting a smaller resolution. This may significantly increase decoding speed!").arg(stall_timeout_us / 1000000), 0);
+				playing.storeRelease(0);
+				this->thread()->quit();
+				return;
 			}
 
-			player_position_counter++; // count to fps, then move frame indicator
-			played_frames_total++; // total number of frames played out in current play-cycle
-			started_playing = true;
-		}
-		else if (frame_playing_total_float >= last_frame_total) { // playback has ended!
+			if (now_us >= next_info_us) {
+				QString info = QString("Buffer: %1/%2 | Dropped: %3 | %4").arg(readyCount()).arg(look_ahead).arg(dropped_frames_total).arg(JP2K_FrameCache::GetGlobalInstance()->GetStatusString());
+				if (adaptive_quality) info.append(" | ").append(qualityString());
+				emit playerInfo(info);
+				next_info_us = now_us + 1000000;
+			}
+
+			if (buffering) { // fill the look ahead before the clock starts
 
-			emit currentPlayerPosition(last_frame_total, true); // update every second
-			emit playbackEnded();
-			emit playerInfo("playback ended!");
+				if (readyCount() == ring.GetSize() && (ring.GetSize() >= look_ahead || !hasFramesToRequest())) {
+					buffering = false;
+					clock_origin_us = now_us - played_frames_total * period_us;
+					wait_us = 0;
+				}
+			}
+			else if (!ring.IsEmpty()) {
+				cancelOverdue(now_us);
 
-			setPos(playlist.at(0).in, 0, 0);
+				QSharedPointer<FrameRequest> front = ring.At(0);
+				const qint64 deadline_us = clock_origin_us + played_frames_total * period_us;
 
-			clean();
-			return;
+				switch (front->state.loadAcquire()) {
+				case FrameRequest::Done:
+					if (now_us < deadline_us) { // wait for presentation time
+						wait_us = deadline_us - now_us;
+						break;
+					}
+					{
+						const qint64 latency_us = now_us - deadline_us;
+						emit showFrame(front->decoded);
+						ring.PopFront();
+						if (latency_us > max_latency_us) clock_origin_us += latency_us; // e.g. disk stalled -> reschedule instead of dropping all frames in flight
+						adaptLookAhead(latency_us > period_us);
+						adaptQuality(*front, false);
+						advancePlayhead();
+						last_progress_us = now_us;
+						wait_us = 0;
+					}
+					break;
+				case FrameRequest::Canceled: // too late, drop it!
+					ring.PopFront();
+					dropped_frames_total++;
+					adaptLookAhead(true);
+					adaptQuality(*front, true);
+					advancePlayhead();
+					wait_us = 0;
+					break;
+				case FrameRequest::Failed: // an error occured during the decoding process!
+
+					if (player_position_counter > 0) emit currentPlayerPosition((int)frame_playing_total_float, false); // set player position
+					emit playerInfo(QString("DECODING ERROR: %1, FRAME: %2").arg(front->errorMsg).arg(front->frameNr));
+					emit playbackEnded();
+
+					clean();
+					return;
+				default: // decoder is busy
+					if (now_us < deadline_us) wait_us = deadline_us - now_us;
+					break;
+				}
+			}
 		}
 
 		QApplication::processEvents();
 
-		if (timer->elapsed() < ms_wait) {
-			QThread::currentThread()->msleep((ms_wait - timer->elapsed()));
-		}
+		waitForDecoder(wait_us); // sleeps until the next frame is decoded or due
 	}
 }
 
 // CPL selected/changed
 void JP2K_Player::setPlaylist(QVector<VideoResource> &rPlaylist) {
 
+	QMutexLocker locker(&state_mutex);
+
 	playlist = rPlaylist;
+	decoderPool->CloseReaders(); // assets may have been removed
 	if(playlist.length() == 0) emit playerInfo("No/empty playlist!");
 
 	last_frame_total = 0; //playlist.length() - 1;
@@ -348,6 +491,7 @@ void JP2K_Player::setPlaylist(QVector<VideoResource> &rPlaylist) {
 	int count = 0;
 	bool found = false;
 	skip_frames = 1;
+	frame_bytes = 0;
 
 	while (count < rPlaylist.length() && found == false) {
 		if (rPlaylist.at(count).asset) {
@@ -397,39 +541,47 @@ void JP2K_Player::setPlaylist(QVector<VideoResource> &rPlaylist) {
 			default: break;
 			}
 
+			frame_bytes = (qint64)rPlaylist.at(count).asset->GetMetadata().storedWidth * rPlaylist.at(count).asset->GetMetadata().storedHeight * 3; // RGB888
+
+			// one decoder per core unless the frames are too large to keep that many in flight
+			decoderPool->Resize(JP2K_DecoderPool::OptimalSize(rPlaylist.at(count).asset->GetMetadata().storedWidth, rPlaylist.at(count).asset->GetMetadata().storedHeight));
+
 			// set params in decoders
-			for (int i = 0; i < decoders; i++) {
+			for (int i = 0; i < decoderPool->GetDecoderCount(); i++) {
+				JP2K_Decoder *decoder = decoderPool->GetDecoder(i);
 
 				// color transformation
-				decoder_queue[i]->ColorEncoding = rPlaylist.at(count).asset->GetMetadata().colorEncoding;
-				decoder_queue[i]->colorPrimaries = colorPrimaries;
-				decoder_queue[i]->transferCharactersitics = rPlaylist.at(count).asset->GetMetadata().transferCharcteristics;
-				decoder_queue[i]->src_bitdepth = src_bitdepth;
+				decoder->ColorEncoding = rPlaylist.at(count).asset->GetMetadata().colorEncoding;
+				decoder->colorPrimaries = colorPrimaries;
+				decoder->transferCharactersitics = rPlaylist.at(count).asset->GetMetadata().transferCharcteristics;
+				decoder->src_bitdepth = src_bitdepth;
 
-				decoder_queue[i]->ComponentMinRef = ComponentMinRef;
-				decoder_queue[i]->ComponentMaxRef = ComponentMaxRef;
-				decoder_queue[i]->RGBmaxcv = RGBmaxcv;
-				decoder_queue[i]->RGBrange = RGBrange;
+				decoder->ComponentMinRef = ComponentMinRef;
+				decoder->ComponentMaxRef = ComponentMaxRef;
+				decoder->RGBmaxcv = RGBmaxcv;
+				decoder->RGBrange = RGBrange;
 
 				// YCbCr -> RGB conv. params.
-				decoder_queue[i]->Kr = Kr;
-				decoder_queue[i]->Kg = Kg;
-				decoder_queue[i]->Kb = Kb;
+				decoder->Kr = Kr;
+				decoder->Kg = Kg;
+				decoder->Kb = Kb;
 
-				decoder_queue[i]->prec_shift = prec_shift;
-				decoder_queue[i]->max = max;
+				decoder->prec_shift = prec_shift;
+				decoder->max = max;
 			}
 		}
 		count++;
 	}
+	buildQualityLadder(); // costs of the previous frame size don't apply
 
 	clean();
 }
 
 void JP2K_Player::setFps(int set_fps){
 
+	QMutexLocker locker(&state_mutex);
+
 	//qDebug() << "set fps to" << set_fps;
-	ms_wait = qRound(1000 / (double)set_fps);
 	fps = set_fps;
 	if(video_framerate > 0) skip_frames = (video_framerate / (double)fps);
 
@@ -437,12 +589,20 @@ void JP2K_Player::setFps(int set_fps){
 }
 
 void JP2K_Player::setLayer(int rLayer){
+	QMutexLocker locker(&state_mutex);
 	layer = rLayer;
+	buildQualityLadder();
+}
+
+void JP2K_Player::setAdaptiveQuality(bool adaptive) {
+
+	QMutexLocker locker(&state_mutex);
+	adaptive_quality = adaptive;
+	setQualityRung(0);
 }
 
 void JP2K_Player::convert_to_709(bool convert) {
 
-	for (int i = 0; i < decoders; i++) {
-		decoder_queue[i]->convert_to_709 = convert; // set in decoder [i]
-	}
+	QMutexLocker locker(&state_mutex);
+	convert709 = convert; // applies to frames requested from now on (see FrameRequest::convert709)
 }
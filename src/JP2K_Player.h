@@ -15,6 +15,11 @@
  */
 #pragma once
 #include <QObject>
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QVector>
 #include <chrono>
 #include "ImfPackage.h"
 #include "JP2K_Decoder.h"
@@ -22,18 +27,65 @@
 class JP2K_Player;
 class JP2K_Decoder;
 
+//! A frame to decode. The decoder owns the request until it publishes FrameRequest::state, the player reads the result afterwards.
 class FrameRequest
 {
 public:
+	enum eState {
+		Pending = 0, // queued
+		Decoding, // a decoder has started
+		Done, // decoded is valid
+		Failed, // errorMsg is valid
+		Canceled // dropped by the player before a decoder started
+	};
+	FrameRequest() : frameNr(-1), TframeNr(-1), decoded(), state(Pending), errorMsg(), asset(), fps(0), layer(0), qualityLayers(0), convert709(true), rung(0), decodeTime_us(-1), completed() {}
 	qint64 frameNr; // current frame in asset
 	qint64 TframeNr; // current frame in track
 	QImage decoded; // decoded image
-	bool done; // set to 'true' when decoding completed
-	bool error; // set to 'true' in case of error
+	QAtomicInt state; // eState: written by the decoder with release semantics, read by the player with acquire semantics
 	QString errorMsg; // error details
 	QSharedPointer<AssetMxfTrack> asset; // reference to asset
 	int fps; // current playback rate
 	int layer; // current layer to decode
+	int qualityLayers; // quality layers to decode (0: all)
+	bool convert709; // convert to Rec.709 (setting of the player when the frame was requested)
+	int rung; // quality ladder rung of the player when the frame was requested
+	qint64 decodeTime_us; // set by the decoder, -1 if the frame wasn't decoded (e.g. cache hit)
+	QSharedPointer<QSemaphore> completed; // released when state changes to Done or Failed
+};
+
+/*! \brief
+Frame requests in presentation order. Not thread safe: the player guards it with JP2K_Player::state_mutex, the player thread pushes and pops and the gui thread clears it (JP2K_Player::clean()).
+Decoders never touch the ring, they hand over their results through FrameRequest::state. A request popped before its decoder started is canceled, late results of dropped requests are discarded with the request.
+*/
+class JP2K_FrameRing {
+
+public:
+	static const int capacity = 64;
+	JP2K_FrameRing() : mSlots(capacity), mHead(0), mTail(0) {}
+	//! Cancels and removes all requests.
+	void Clear();
+	int GetSize() const { return (int)(mTail - mHead); }
+	bool IsFull() const { return GetSize() >= capacity; }
+	bool IsEmpty() const { return mTail == mHead; }
+	void Push(const QSharedPointer<FrameRequest> &rRequest);
+	//! index 0 is the next frame to present.
+	QSharedPointer<FrameRequest> At(int index) const { return mSlots.at((int)((mHead + index) % capacity)); }
+	//! Removes the next frame. Cancels it if no decoder has started yet.
+	void PopFront();
+
+private:
+	QVector<QSharedPointer<FrameRequest> > mSlots;
+	qint64 mHead;
+	qint64 mTail;
+};
+
+//! A step of the quality ladder of the JP2K_Player. Rungs are ordered from best quality to fastest decoding.
+struct JP2K_QualityRung {
+	JP2K_QualityRung(int reduce = 0, int qualityLayers = 0) : reduce(reduce), qualityLayers(qualityLayers), cost_us(-1) {}
+	int reduce; // resolution reduction (cp_reduce)
+	int qualityLayers; // quality layers to decode (cp_layer, 0: all)
+	qint64 cost_us; // average decoding time of a frame, -1: not measured yet
 };
 
 class JP2K_Player : public QObject
@@ -45,14 +97,15 @@ public:
 
 	// methods
 	void setFps(int fps);
-	void setLayer(int layer); // layer to decode
+	void setLayer(int layer); // layer to decode (best quality of the adaptive quality)
+	void setAdaptiveQuality(bool adaptive); // move along the quality ladder to hold the frame rate
 	void setPlaylist(QVector<VideoResource>& rPlaylist);
 	void setPos(qint64 frameNr, qint64 frame_total, int playlist_index);
 	void clean();
 	void convert_to_709(bool convert);
 
 	float frame_playing_total_float = 0; // current playing position (within track)
-	bool playing = false; // currently playing
+	QAtomicInt playing; // currently playing, cleared by the gui thread to stop the play loop
 	bool realspeed = false; // play every frame or skip frames
 	float skip_frames = 0; // play every x frames when realspeed == true
 	bool show_subtitles = true; // display subtitles during playback
@@ -61,14 +114,28 @@ private:
 
 	// methods
 	void playLoop();
+	bool hasFramesToRequest() const;
+	void scheduleRequests(); // keeps look_ahead frames requested
+	void cancelOverdue(qint64 now_us); // cancels requests which weren't started before their presentation time
+	int readyCount() const; // finished requests at the front of the ring
+	void advancePlayhead(); // moves the playing position by one presented (or dropped) frame
+	void adaptLookAhead(bool late);
+	int minLookAhead() const; // keeps all decoders busy
+	int maxLookAhead() const; // limited by the ring and by the memory of the decoded frames
+	void waitForDecoder(qint64 timeout_us); // sleeps until a decoder finishes a frame or the timeout expires
+	void buildQualityLadder(); // from the current layer down to the smallest resolution
+	qint64 qualityBudget() const; // decoding time per frame the decoders can afford at fps
+	int initialRung() const; // best rung known to hold the frame rate
+	void setQualityRung(int rung);
+	void adaptQuality(const FrameRequest &rRequest, bool dropped); // called for every presented or dropped frame
+	QString qualityString() const;
 
 	// decoders
-	static const int decoders = 50;
-	QThreadPool* threadPool; // threadpool used by the n decoders
-	FrameRequest* request_queue[decoders]; // array were n frame requests are stored
-	JP2K_Decoder* decoder_queue[decoders]; // array were n decoder instances are stored
-	QSharedPointer<FrameRequest> pointer_queue[decoders];
-	QSharedPointer<DecodedFrames> decoded_shared; // decoding status shared among player and all decoders
+	JP2K_FrameRing ring; // requested frames in presentation order
+	QSharedPointer<QSemaphore> completed; // released by the decoders for every finished frame
+	JP2K_DecoderPool* decoderPool; // decoders and threads, sized to the frame dimensions
+	bool convert709 = true; // re-applied when the decoder pool is resized
+	QMutex state_mutex; // recursive, guards the player state shared with the gui thread (playlist, positions, ring). Never held while waiting for decoders.
 
 	// player settings
 	int layer = 0; // quality layer to decode (best = 0, default = 5)
@@ -76,10 +143,10 @@ private:
 	qint64 TframeNr = 0; // player position within track
 	int playlist_index = 0; // playlist asset index
 	int fps = 0; // nr of images to play/request per second
-	int ms_wait = 1000; // default wait intervall between cycles in play-loop
 	QImage nullimage; // empty image
-	QTime* timer; // timer used for play-loop
+	QElapsedTimer clock; // presentation clock
 	qreal video_framerate = 0;
+	qint64 frame_bytes = 0; // memory of a decoded frame (full resolution)
 
 	// player control
 	qint64 last_frame_total = 0; // last frame in track
@@ -89,33 +156,35 @@ private:
 	float frame_decoding_asset_float = 0; // current decoding position (within asset)
 	float frame_decoding_total_float = 0; // current decoding position (within track)
 	int decoding_index = 0; // decoding asset at this playlist index
-	int request_index = 0; // [0...decoders]
+	int request_index = 0; // [0...request_slots]
 
 	// playing
 	int playing_index = 0; // playing asset at this playlist index
-	int played_frames_total = 0;  // [0...decoders]
+	int played_frames_total = 0; // frames presented or dropped during play cycle
+	int dropped_frames_total = 0; // frames dropped during play cycle
 	int player_position_counter = 0; // count from 0...fps, then move frame indicator
 	int requested_frames_total = 0; // total requests sent during play cycle
-	int last_frame_played = 0;
+	qint64 clock_origin_us = 0; // presentation time of frame 0 of the play cycle
+	qint64 last_progress_us = 0; // presentation clock when a frame was last decoded or presented
+	qint64 next_info_us = 0; // presentation clock when playerInfo is sent next
 
 	// playlist
 	QVector<VideoResource> playlist; // all playlist elements
 
 	// buffer management
-	int buffer_size = 0; // current buffer size
+	int look_ahead = 0; // frames requested ahead of the playing position, adapted to the decoding speed
+	int on_time_count = 0; // frames presented in time since look_ahead was last changed
 	bool buffering = true; // currently buffering?
-	int buffer_fill_count = 0; // play-loop cycles it took to fill the buffer to fps
 
-	// luts
-	static const int bitdepth = 16;
-	int max_f; // (float)pow(2, bitdepth)
-	float max_f_; // max_f - 1;
-	float* oetf_709;
-	float* eotf_2020;
-	float* eotf_PQ;
+	// adaptive quality
+	bool adaptive_quality = true;
+	QVector<JP2K_QualityRung> quality_ladder;
+	int quality_rung = 0; // current rung (0: decode at layer)
+	int quality_frames = 0; // frames of the current rung presented or dropped since the last evaluation
+	int quality_drops = 0; // frames of the current rung dropped since the last evaluation
 
 	signals :
-	void ShowMsgBox(const QString&, int); // Show MsgBox if set playback speed exceeds processing power
+	void ShowMsgBox(const QString&, int); // Show MsgBox if the decoders stall
 	void playerInfo(const QString&); // send QString from player to WidgetVideoPreview
 	void showFrame(const QImage&); // send QImage to WdigetImagePreview
 	void currentPlayerPosition(qint64,bool); // set frame indicator position
@@ -18,151 +18,164 @@
 #include <QTime>
 #include "openjpeg.h"
 #include "AS_DCP_internal.h"
+#include <QGlobalStatic>
+#include <QRunnable>
+#include <QSemaphore>
 
-// timeline preview constructor
-JP2K_Preview::JP2K_Preview() {
-	setUp();
-}
+Q_GLOBAL_STATIC(TransferLuts, theTransferLuts)
 
-JP2K_Preview::~JP2K_Preview()
+namespace
 {
-	if(!current_asset.isNull())
-	{
-		reader->Close();
-		reader->~MXFReader();
-	}else
-	{
-		qDebug() << "no reader found!";
-	}
-	
-	delete eotf_709;
-	delete oetf_709;
-	delete eotf_2020;
-	delete oetf_2020;
-	delete eotf_PQ;
-	delete oetf_PQ;
-}
 
-void JP2K_Preview::setUp() {
+const int min_rows_per_band = 64; // smaller bands don't pay off the thread handover
 
-	mDecode_time.start();
+//! Converts a band of rows and signals completion.
+class ConvertRowsTask : public QRunnable {
 
-	params.cp_reduce = 3; // (default)
-	mCpus = opj_get_num_cpus();
+public:
+	ConvertRowsTask(const JP2K_ColorConversion &rConversion, int firstRow, int lastRow, uchar *pBits, int bytesPerLine, QSemaphore &rDone) :
+		mrConversion(rConversion), mFirstRow(firstRow), mLastRow(lastRow), mpBits(pBits), mBytesPerLine(bytesPerLine), mrDone(rDone) {}
+	virtual void run() {
+		mrConversion.ConvertRows(mFirstRow, mLastRow, mpBits, mBytesPerLine);
+		mrDone.release();
+	}
 
-	pDecompressor = OPENJPEG_H::opj_create_decompress(OPJ_CODEC_J2K);
+private:
+	const JP2K_ColorConversion &mrConversion;
+	int mFirstRow;
+	int mLastRow;
+	uchar *mpBits;
+	int mBytesPerLine;
+	QSemaphore &mrDone;
+};
 
-	opj_codec_set_threads(pDecompressor, mCpus);
+}
 
-	// Setup the decoder (first time), using user parameters
-	if (!OPENJPEG_H::opj_setup_decoder(pDecompressor, &params)) {
-		mMsg = "Error setting up decoder!"; // ERROR
-		opj_destroy_codec(pDecompressor);
-	}
+TransferLuts::TransferLuts() {
 
-	// create lookup tables
-	max_f = 1 << bitdepth;
-	max_f_ = (float)(max_f)-1.0;
-
-	eotf_709 = new float[max_f];
-	oetf_709 = new float[max_f];
+	const float max_f_ = (float)(size)-1.0;
 
 	float alpha = 1.09929682680944;
 	float beta = 0.018053968510807;
-	eotf_2020 = new float[max_f];
-	oetf_2020 = new float[max_f];
 
 	float m1 = 0.1593017578125;
 	float m2 = 78.84375;
 	float c1 = 0.8359375;
 	float c2 = 18.8515625;
 	float c3 = 18.6875;
-	eotf_PQ = new float[max_f];
-	oetf_PQ = new float[max_f];
 
-	for (int i = 0; i < max_f; i++) {
+	for (int i = 0; i < size; i++) {
 
 		float input = (float)(i / max_f_); // convert input to value between 0...1
 
 		// BT.709 - OETF
-		oetf_709[i] = pow(input, 1.0f / 2.4f);
-
-		/*
-		// BT.709 - EOTF
-		if (input < (4.5 * 0.018)) {
-			eotf_709[i] = input / 4.5;
-		}
-		else {
-			eotf_709[i] = pow(((input + (alpha - 1)) / alpha), 1.0 / 0.45);
-		}
-
-		// BT.2020 - OETF
-		if (input < beta) {
-			oetf_2020[i] = 4.5 * input;
-		}
-		else {
-			oetf_2020[i] = alpha * pow(input, 0.45) - (alpha - 1);
-		}
-		*/
+		mOetf709[i] = pow(input, 1.0f / 2.4f);
 
 		// BT.2020 - EOTF
 		if (input < (4.5 * beta)) {
-			eotf_2020[i] = input / 4.5;
+			mEotf2020[i] = input / 4.5;
 		}
 		else {
-			eotf_2020[i] = pow(((input + (alpha - 1)) / alpha), 1.0 / 0.45);
+			mEotf2020[i] = pow(((input + (alpha - 1)) / alpha), 1.0 / 0.45);
 		}
 
 		// SMPTE ST 2084 (PQ)
-		eotf_PQ[i] = pow(((pow(input, (1.0 / m2)) - c1)) / (c2 - c3 *pow(input, (1.0 / m2))), 1.0 / m1) * 10000;
-		//oetf_PQ[i] = pow((c1 + c2*pow(input, m1)) / (1 + c3*pow(input, m1)), m2);
-
+		mEotfPQ[i] = pow(((pow(input, (1.0 / m2)) - c1)) / (c2 - c3 *pow(input, (1.0 / m2))), 1.0 / m1) * 10000;
 	}
 
-	eotf_PQ[0] = 0;
-	oetf_PQ[0] = 0;
+	mEotfPQ[0] = 0;
+}
+
+const TransferLuts* TransferLuts::GetGlobalInstance() {
 
+	return theTransferLuts(); // thread safe, built on first use
 }
 
-void JP2K_Preview::getProxy() {
+JP2::JP2() {
 
-	mCpus = 1; // (default for proxys)
-	convert_to_709 = false; // (default for proxys)
-	params.cp_reduce = 4; // (default for proxy)
+	const TransferLuts *p_luts = TransferLuts::GetGlobalInstance();
+	oetf_709 = p_luts->GetOetf709();
+	eotf_2020 = p_luts->GetEotf2020();
+	eotf_PQ = p_luts->GetEotfPQ();
 
-	setAsset(); // initialize reader
-	QImage p1, p2;
+	max_f = 1 << bitdepth;
+	max_f_ = (float)(max_f)-1.0;
+}
 
-	// FIRST PROXY
-	if (!err && extractFrame(mFirst_proxy)) { // frame extraction was successfull -> decode frame
-		if (decodeImage()) { // try to decode image
-			p1 = DataToQImage();
-			cleanUp();
+// timeline preview constructor
+JP2K_Preview::JP2K_Preview() {
+	setUp();
+}
+
+JP2K_Preview::~JP2K_Preview()
+{
+	mFrameReader.Close();
+}
+
+void JP2K_Preview::setUp() {
+
+	mDecode_time.start();
+
+	params.cp_reduce = 3; // (default)
+	mCpus = opj_get_num_cpus();
+
+	pDecompressor = OPENJPEG_H::opj_create_decompress(OPJ_CODEC_J2K);
+
+	opj_codec_set_threads(pDecompressor, mCpus);
+
+	// Setup the decoder (first time), using user parameters
+	if (!OPENJPEG_H::opj_setup_decoder(pDecompressor, &params)) {
+		mMsg = "Error setting up decoder!"; // ERROR
+		opj_destroy_codec(pDecompressor);
+	}
+
+}
+
+void JP2K_Preview::getProxy() {
+
+	QList<qint64> frames;
+	do { // the strip may have been changed by the gui thread while decoding
+		frames = getProxyFrames();
+		QList<QImage> proxies;
+		bool missing = false;
+		for (int i = 0; i < frames.size(); i++) {
+			proxies.append((asset && !asset.isNull()) ? asset->GetProxy(frames.at(i)) : QImage()); // decoded before (see IngestCache)
+			if (proxies.last().isNull()) missing = true;
 		}
-		else {
-			p1 = QImage(":/proxy_unknown.png");
+
+		if (missing) {
+			mCpus = 1; // (default for proxys)
+			convert_to_709 = false; // (default for proxys)
+			params.cp_reduce = 4; // (default for proxy)
+
+			setAsset(); // initialize reader
+
+			for (int i = 0; i < frames.size(); i++) {
+				if (proxies.at(i).isNull()) proxies[i] = decodeProxy(frames.at(i));
+			}
 		}
-	}
-	else {
-		p1 = QImage(":/proxy_unknown.png");
-	}
-	
-	// SECOND PROXY
-	if (!err && extractFrame(mSecond_proxy)) { // frame extraction was successful -> decode frame
-		if (decodeImage()) { // try to decode image
-			p2 = DataToQImage();
+
+		emit proxyFinished(proxies);
+	} while (frames != getProxyFrames());
+	emit finished();
+}
+
+QImage JP2K_Preview::decodeProxy(qint64 frameNr) {
+
+	const JP2K_FrameKey frame_key(asset ? asset->GetId() : QUuid(), frameNr, params.cp_reduce, convert_to_709);
+	QImage proxy;
+	if (!JP2K_FrameCache::GetGlobalInstance()->Lookup(frame_key, proxy)) {
+		if (!err && extractFrame(frameNr) && decodeImage()) { // frame extraction was successful -> try to decode image
+			proxy = DataToQImage();
 			cleanUp();
+			JP2K_FrameCache::GetGlobalInstance()->Insert(frame_key, proxy);
 		}
 		else {
-			p2 = QImage(":/proxy_unknown.png");
+			return QImage(":/proxy_unknown.png");
 		}
 	}
-	else {
-		p2 = QImage(":/proxy_unknown.png");
-	}
-
-	emit proxyFinished(p1, p2);
-	emit finished();
+	if (asset && !asset.isNull()) asset->InsertProxy(frameNr, proxy);
+	return proxy;
 }
 
 // set decoding layer
@@ -177,6 +190,30 @@ void JP2K_Preview::setLayer(int index) {
 	}
 }
 
+void JP2K_Preview::setDecodeArea(const QRect &rArea) {
+
+	QMutexLocker locker(&mDecodeAreaMutex);
+	mDecodeArea = rArea;
+}
+
+QRect JP2K_Preview::getDecodeArea() const {
+
+	QMutexLocker locker(&mDecodeAreaMutex);
+	return mDecodeArea;
+}
+
+void JP2K_Preview::setProxyFrames(const QList<qint64> &rFrames) {
+
+	QMutexLocker locker(&mProxyFramesMutex);
+	mProxyFrames = rFrames;
+}
+
+QList<qint64> JP2K_Preview::getProxyFrames() const {
+
+	QMutexLocker locker(&mProxyFramesMutex);
+	return mProxyFrames;
+}
+
 void JP2K_Preview::setAsset() {
 
 	if (asset && !asset.isNull()) {
@@ -230,19 +267,14 @@ void JP2K_Preview::setAsset() {
 			break; // abort!
 		}
 
-		if (mMxf_path != "") { // close old asset/reader
-			reader->Close();
-			reader->~MXFReader();
-		}
-
 		mMxf_path = asset->GetPath().absoluteFilePath(); // get new path
 
-		reader = new AS_02::JP2K::MXFReader(); // create new reader
-
-		Result_t result_o = reader->OpenRead(mMxf_path.toStdString()); // open file for reading
-		if (!ASDCP_SUCCESS(result_o)) {
-			mMsg = QString("Failed to init. reader: %1").arg(result_o.Message()); // ERROR
-			err = true;
+		if (mFrameReader.GetFilePath() != mMxf_path || !mFrameReader.IsOpen()) { // the index table is parsed once per file
+			QString error_msg;
+			if (!mFrameReader.Open(mMxf_path, error_msg)) {
+				mMsg = QString("Failed to init. reader: %1").arg(error_msg); // ERROR
+				err = true;
+			}
 		}
 	}
 	else {
@@ -271,14 +303,36 @@ void JP2K_Preview::decode() {
 		setAsset();
 	}
 
+	const QRect decode_area = getDecodeArea(); // set by the gui thread
+	if (!err && !decode_area.isNull()) { // zoomed preview: decode the visible tiles only
+		decodeArea(decode_area);
+		return;
+	}
+
+	// frames decoded before (scrubbing, playback or proxies) are shown right away
+	JP2K_FrameCache *p_frame_cache = JP2K_FrameCache::GetGlobalInstance();
+	const JP2K_FrameKey frame_key(asset ? asset->GetId() : QUuid(), mFrameNr, params.cp_reduce, convert_to_709);
+	QImage cached_frame;
+	if (!err && p_frame_cache->Lookup(frame_key, cached_frame)) {
+		emit ShowFrame(cached_frame);
+		mMsg = QString("Frame %1 from cache in %2 ms | %3").arg(mFrameNr).arg(mDecode_time.elapsed()).arg(p_frame_cache->GetStatusString());
+		emit decodingStatus(mFrameNr, mMsg);
+		emit finished();
+		return;
+	}
+
 	if (!err && extractFrame(mFrameNr)) { // frame extraction was successfull -> decode frame
 
 		// try to decode image
 		if (decodeImage() && !err) {
 
-			emit ShowFrame(DataToQImage());
+			const int decode_ms = mDecode_time.elapsed();
+			const QImage frame = DataToQImage(mCpus);
+			p_frame_cache->Insert(frame_key, frame);
+			emit ShowFrame(frame);
+			const int total_ms = mDecode_time.elapsed();
 
-			if (!err) mMsg = QString("Decoded frame %1 in %2 ms").arg(mFrameNr).arg(mDecode_time.elapsed()); // no error
+			if (!err) mMsg = QString("Decoded frame %1 in %2 ms (decode: %3 ms, conversion: %4 ms) | %5").arg(mFrameNr).arg(total_ms).arg(decode_ms).arg(total_ms - decode_ms).arg(p_frame_cache->GetStatusString()); // no error
 
 			emit decodingStatus(mFrameNr, mMsg);
 			QApplication::processEvents();
@@ -300,45 +354,69 @@ void JP2K_Preview::decode() {
 
 bool JP2K_Preview::extractFrame(qint64 frameNr) {
 
-	// create new buffer
-	buff = new ASDCP::JP2K::FrameBuffer();
-
-	// calculate neccessary buffer size
-	if (ASDCP_SUCCESS(reader->AS02IndexReader().Lookup((frameNr + 1), IndexF2))) { // next frame
-		if (ASDCP_SUCCESS(reader->AS02IndexReader().Lookup(frameNr, IndexF1))) { // current frame
-			if (!ASDCP_SUCCESS(buff->Capacity((IndexF2.StreamOffset - IndexF1.StreamOffset) - 20))) { // set buffer size
+	mCodeStream = JP2K_CodeStream(); // return the previous buffer to the pool
 
-				mMsg = QString("Could not set FrameBuffer size to: %1").arg((IndexF2.StreamOffset - IndexF1.StreamOffset) - 20); // ERROR
-				err = true;
-				return false;
-			}
-		}
-		else {
-			mMsg = QString("Frame does not exist: %1").arg(frameNr); // ERROR
-			err = true;
-			return false;
-		}
-	}
-	else {
-		buff->Capacity(default_buffer_size); // set default size
-	}
-	
-	// try reading requested frame number
-	if (ASDCP_SUCCESS(reader->ReadFrame(frameNr, *buff, NULL, NULL))) {
-		pMemoryStream.pData = (unsigned char*)buff->Data();
-		pMemoryStream.dataSize = buff->Size();
+	// the frame size is taken from the index table and the KLV header, the buffer comes from the JP2K_BufferPool
+	QString error_msg;
+	if (mFrameReader.ReadFrame(frameNr, mCodeStream, error_msg)) {
+		pMemoryStream.pData = (OPJ_UINT8*)mCodeStream.pData;
+		pMemoryStream.dataSize = mCodeStream.size;
 		return true;
 	}
 	else {
-		mMsg = "Error reading frame!"; // ERROR
+		mMsg = QString("Error reading frame! %1").arg(error_msg); // ERROR
 		err = true;
 		return false;
 	}
+}
+
+void JP2K_Preview::decodeArea(const QRect &rArea) {
+
+	const int scale = 1 << params.cp_reduce;
+	const QSize stored_size(asset->GetMetadata().storedWidth, asset->GetMetadata().storedHeight);
+	const QSize frame_size((stored_size.width() + scale - 1) / scale, (stored_size.height() + scale - 1) / scale);
+	const QRect area = rArea & QRect(QPoint(0, 0), frame_size);
+
+	mTileCache.SetFrame(QString("%1|%2|%3|%4").arg(mMxf_path).arg(mFrameNr).arg(params.cp_reduce).arg(convert_to_709), frame_size);
+
+	QImage image;
+	if (area.isEmpty()) {
+		mMsg = "Invalid decoding area"; // ERROR
+		err = true;
+	}
+	else if (mTileCache.Assemble(area, image)) {
+		mMsg = QString("Frame %1: area %2 x %3 from cache").arg(mFrameNr).arg(area.width()).arg(area.height());
+	}
+	else {
+		const QRect missing = mTileCache.MissingBounds(area);
+		if (extractFrame(mFrameNr) && decodeImage(missing) && !err) {
+
+			const int decode_ms = mDecode_time.elapsed();
+			QImage decoded = DataToQImage(mCpus);
+			cleanUp();
+			mTileCache.Insert(missing, decoded);
+			if (!mTileCache.Assemble(area, image)) {
+				// stored size doesn't match the codestream: crop the tile aligned decode to the requested area
+				const QRect crop = area.translated(-missing.topLeft());
+				if (decoded.rect().contains(crop)) image = decoded.copy(crop);
+			}
+			const int total_ms = mDecode_time.elapsed();
+
+			if (image.isNull()) {
+				mMsg = QString("Frame %1: decoded area %2 x %3 doesn't cover the requested area").arg(mFrameNr).arg(decoded.width()).arg(decoded.height()); // ERROR
+				err = true;
+			}
+			else mMsg = QString("Decoded area %1 x %2 of frame %3 in %4 ms (decode: %5 ms, conversion: %6 ms)").arg(missing.width()).arg(missing.height()).arg(mFrameNr).arg(total_ms).arg(decode_ms).arg(total_ms - decode_ms);
+		}
+	}
 
-	return false; // default
+	if (err) image = QImage(":/frame_error.png");
+	emit ShowFrame(image);
+	emit decodingStatus(mFrameNr, mMsg);
+	emit finished();
 }
 
-bool JP2K_Preview::decodeImage() {
+bool JP2K_Preview::decodeImage(const QRect &rArea /*= QRect()*/) {
 
 	pMemoryStream.offset = 0;
 
@@ -352,16 +430,37 @@ bool JP2K_Preview::decodeImage() {
 		mMsg = "Failed to read image header!"; // ERROR
 		err = true;
 		psImage = NULL; // reset decoded output stream
+		mCodeStream = JP2K_CodeStream(); // return the buffer to the pool
 
 		pDecompressor = OPENJPEG_H::opj_create_decompress(OPJ_CODEC_J2K); // create new decompresser
 	}
 	else { // try decoding image
+		if (!rArea.isNull()) {
+			// restrict decoding to the tiles and precincts covering rArea (reference grid coordinates)
+			const int scale = 1 << params.cp_reduce;
+			const OPJ_INT32 x0 = psImage->x0 + rArea.left() * scale;
+			const OPJ_INT32 y0 = psImage->y0 + rArea.top() * scale;
+			const OPJ_INT32 x1 = qMin((OPJ_INT32)psImage->x1, (OPJ_INT32)(psImage->x0 + (rArea.right() + 1) * scale));
+			const OPJ_INT32 y1 = qMin((OPJ_INT32)psImage->y1, (OPJ_INT32)(psImage->y0 + (rArea.bottom() + 1) * scale));
+			if (!OPENJPEG_H::opj_set_decode_area(pDecompressor, psImage, x0, y0, x1, y1)) {
+				OPENJPEG_H::opj_stream_destroy(pStream);
+				OPENJPEG_H::opj_destroy_codec(pDecompressor);
+				OPENJPEG_H::opj_image_destroy(psImage);
+				mCodeStream = JP2K_CodeStream(); // return the buffer to the pool
+
+				psImage = NULL; // reset decoded output stream
+				pDecompressor = OPENJPEG_H::opj_create_decompress(OPJ_CODEC_J2K); // create new decompresser
+				mMsg = "Failed to set decoding area!"; // ERROR
+				err = true;
+				return false;
+			}
+		}
 		if (!(OPENJPEG_H::opj_decode(pDecompressor, pStream, psImage)))
 		{
 			OPENJPEG_H::opj_stream_destroy(pStream);
 			OPENJPEG_H::opj_destroy_codec(pDecompressor);
 			OPENJPEG_H::opj_image_destroy(psImage);
-			buff->~FrameBuffer();
+			mCodeStream = JP2K_CodeStream(); // return the buffer to the pool
 
 			psImage = NULL; // reset decoded output stream
 			pDecompressor = OPENJPEG_H::opj_create_decompress(OPJ_CODEC_J2K); // create new decompresser
@@ -370,7 +469,7 @@ bool JP2K_Preview::decodeImage() {
 			return false;
 		}
 		else {
-			buff->~FrameBuffer();
+			mCodeStream = JP2K_CodeStream(); // return the buffer to the pool
 			return true;
 		}
 	}
@@ -404,250 +503,125 @@ void JP2K_Preview::save2File() {
 	file.close();
 }
 
-QImage JP2::DataToQImage()
-{
-	w = psImage->comps->w;
-	h = psImage->comps->h;
-
-	QImage image(w, h, QImage::Format_RGB888); // create image
-
-	bytes_per_line = w * 3;
-	img_buff = new unsigned char[bytes_per_line];
-
-	int offset = 16 << (src_bitdepth - 8);
-	int maxcv = (1 << src_bitdepth) - 1;
-	int maxcv_plus_1 = maxcv + 1;
-	int range_y = 219 << (src_bitdepth - 8);
-	int range_c = (maxcv_plus_1 - 2 * offset);
-	if (convert_to_709) {
-
-		for (y = 0; y < h; y++) {
-			for (x = 0; x < w; x++) {
-
-				switch (ColorEncoding) {
-				case Metadata::RGBA:
-
-					xpos = (y*w + x); // don't calculate 3 times
-
-					// get RGB																
-					r = (float)psImage->comps[0].data[xpos];
-					g = (float)psImage->comps[1].data[xpos];
-					b = (float)psImage->comps[2].data[xpos];
-
-					//WR
-					if (ComponentMinRef && ComponentMaxRef) { // QE.2 If ComponentMinRef is != 0, it's Legal Range. Don't convert if ComponentMaxRef is (accidentally) zero, or not set.
-						r = (r - ComponentMinRef) / (ComponentMaxRef - ComponentMinRef) * maxcv;
-						g = (g - ComponentMinRef) / (ComponentMaxRef - ComponentMinRef) * maxcv;
-						b = (b - ComponentMinRef) / (ComponentMaxRef - ComponentMinRef) * maxcv;
-						if (r < 0) r = 0;
-						if (g < 0) g = 0;
-						if (b < 0) b = 0;
-					}
-					//WR
-					break;
-				case Metadata::CDCI:
-
-					xpos = (int)(y*w + x) / 2; // don't calculate twice
-
-					// get YCbCr values
-					Y = (float)psImage->comps[0].data[(int)(y*w + x)];
-					Cb = (float)psImage->comps[1].data[xpos];
-					Cr = (float)psImage->comps[2].data[xpos];
-
-					// convert to rgb
-					r = (Y - offset)*maxcv / range_y + 2 * (1 - Kr)*(Cr - maxcv_plus_1 / 2)*maxcv / range_c;
-					g = (Y - offset)*maxcv / range_y - 2 * Kb*(1 - Kb) / Kg*(Cb - maxcv_plus_1 / 2)*maxcv / range_c - 2 * Kr*(1 - Kr) / Kg*(Cr - maxcv_plus_1 / 2)*maxcv / range_c;
-					b = (Y - offset)*maxcv / range_y + 2 * (1 - Kb)*(Cb - maxcv_plus_1 / 2)*maxcv / range_c;
-
-					// clamp between 0...CVmax
-					if (r < 0) { r = 0; }
-					else if (r >= maxcv) { r = maxcv; }
-					if (g < 0) { g = 0; }
-					else if (g >= maxcv) { g = maxcv; }
-					if (b < 0) { b = 0; }
-					else if (b >= maxcv) { b = maxcv; }
-					break;
-				default: return QImage(":/frame_error.png"); break; // abort!
-				}
-
-				// now we have rgb data -> linearize the data!
-				switch (transferCharactersitics) {
-				case SMPTE::TransferCharacteristic_ITU709:
-
-					// convert to 8 bit
-					out_r8 = (int)r >> prec_shift;
-					out_g8 = (int)g >> prec_shift;
-					out_b8 = (int)b >> prec_shift;
-
-					// set data
-					buff_pos = x * 3; // don't calculate 3 times
-					img_buff[buff_pos] = (unsigned char)out_r8;
-					img_buff[buff_pos + 1] = (unsigned char)out_g8;
-					img_buff[buff_pos + 2] = (unsigned char)out_b8;
-
-					continue; // jump to next pixel
-
-					break;
-				case SMPTE::TransferCharacteristic_ITU2020:
-
-					r = eotf_2020[(int)((r / max) * max_f_)]; // 0...1
-					g = eotf_2020[(int)((g / max) * max_f_)]; // 0...1
-					b = eotf_2020[(int)((b / max) * max_f_)]; // 0...1
-
-					break;
-				case SMPTE::TransferCharacteristic_SMPTEST2084:
-
-					r = eotf_PQ[(int)((r / max) * max_f_)]; // 0...10 000
-					g = eotf_PQ[(int)((g / max) * max_f_)]; // 0...10 000
-					b = eotf_PQ[(int)((b / max) * max_f_)]; // 0...10 000
-
-					// convert to 0.0..100.0 ( 1.0 = 100 nits)
-					r /= 100;
-					g /= 100;
-					b /= 100;
-
-					break;
-				case SMPTE::TransferCharacteristic_IEC6196624_xvYCC:
-
-					// convert to 8 bit
-					out_r8 = (int)r >> prec_shift;
-					out_g8 = (int)g >> prec_shift;
-					out_b8 = (int)b >> prec_shift;
-
-					// clamp values between 0...255
-					if (out_r8 < 0) { out_r8 = 0; }
-					else if (out_r8 > 255) { out_r8 = 255; }
-					if (out_g8 < 0) { out_g8 = 0; }
-					else if (out_g8 > 255) { out_g8 = 255; }
-					if (out_b8 < 0) { out_b8 = 0; }
-					else if (out_b8 > 255) { out_b8 = 255; }
-
-					// set data
-					buff_pos = x * 3; // don't calculate 3 times
-					img_buff[buff_pos] = (unsigned char)out_r8;
-					img_buff[buff_pos + 1] = (unsigned char)out_g8;
-					img_buff[buff_pos + 2] = (unsigned char)out_b8;
-
-					continue; // jump to next pixel
-
-					break;
-				default: return QImage(":/frame_error.png"); break; // abort!
-				}
-
-				switch (colorPrimaries) {
-				case SMPTE::ColorPrimaries_ITU2020:
-
-					// convert from BT.2020 -> BT.709
-					out_r = r*1.6605 + g*-0.5877 + b*-0.0728;
-					out_g = r*-0.1246 + g*1.1330 + b*-0.0084;
-					out_b = r*-0.0182 + g*-0.1006 + b*1.1187;
-
-					break;
-				case SMPTE::ColorPrimaries_P3D65:
-
-					// convert from DCI-P3 -> BT.709
-					out_r = r*1.2248 - g*0.2249 - b*0.0001;
-					out_g = -r*0.042 + g*1.042;
-					out_b = -r*0.0196 - g*0.0786 + b*1.0983;
-
-					break;
-				default: return QImage(":/frame_error.png"); break; // abort!
-				}
-
-				// clamp between 0...1
-				if (out_r < 0) { out_r = 0; }
-				else if (out_r > 1) { out_r = 1; }
-				if (out_g < 0) { out_g = 0; }
-				else if (out_g > 1) { out_g = 1; }
-				if (out_b < 0) { out_b = 0; }
-				else if (out_b > 1) { out_b = 1; }
-
-				// unlinearize
-				out_r = oetf_709[(int)(out_r * max_f_)] * max;
-				out_g = oetf_709[(int)(out_g * max_f_)] * max;
-				out_b = oetf_709[(int)(out_b * max_f_)] * max;
-
-				// convert to 8 bit
-				out_r8 = (int)out_r >> prec_shift;
-				out_g8 = (int)out_g >> prec_shift;
-				out_b8 = (int)out_b >> prec_shift;
-
-				// clamp values between 0...255
-				if (out_r8 < 0) { out_r8 = 0; }
-				else if (out_r8 > 255) { out_r8 = 255; }
-				if (out_g8 < 0) { out_g8 = 0; }
-				else if (out_g8 > 255) { out_g8 = 255; }
-				if (out_b8 < 0) { out_b8 = 0; }
-				else if (out_b8 > 255) { out_b8 = 255; }
-
-				// set data
-				buff_pos = x * 3; // don't calculate 3 times
-				img_buff[buff_pos] = (unsigned char)out_r8;
-				img_buff[buff_pos + 1] = (unsigned char)out_g8;
-				img_buff[buff_pos + 2] = (unsigned char)out_b8;
+JP2K_TileCache::JP2K_TileCache(int maxTiles /*= 64*/) :
+mFrameKey(), mFrameSize(), mTiles(maxTiles) {
+
+}
+
+void JP2K_TileCache::SetFrame(const QString &rFrameKey, const QSize &rFrameSize) {
+
+	if (rFrameKey != mFrameKey || rFrameSize != mFrameSize) {
+		mTiles.clear();
+		mFrameKey = rFrameKey;
+		mFrameSize = rFrameSize;
+	}
+}
+
+QRect JP2K_TileCache::TileRect(int column, int row) const {
+
+	return QRect(column * tile_size, row * tile_size, tile_size, tile_size) & QRect(QPoint(0, 0), mFrameSize);
+}
+
+bool JP2K_TileCache::Assemble(const QRect &rArea, QImage &rImage) {
+
+	if (rArea.isEmpty()) return false;
+	const int first_column = rArea.left() / tile_size, last_column = rArea.right() / tile_size;
+	const int first_row = rArea.top() / tile_size, last_row = rArea.bottom() / tile_size;
+	for (int row = first_row; row <= last_row; row++) {
+		for (int column = first_column; column <= last_column; column++) {
+			if (!mTiles.contains(TileKey(column, row))) return false;
+		}
+	}
+
+	QImage image(rArea.size(), QImage::Format_RGB888);
+	for (int row = first_row; row <= last_row; row++) {
+		for (int column = first_column; column <= last_column; column++) {
+			const QImage *p_tile = mTiles.object(TileKey(column, row));
+			const QRect tile_rect = TileRect(column, row);
+			const QRect copy_rect = tile_rect & rArea;
+			if (p_tile->width() < tile_rect.width() || p_tile->height() < tile_rect.height()) return false;
+			for (int y = copy_rect.top(); y <= copy_rect.bottom(); y++) {
+				memcpy(image.scanLine(y - rArea.top()) + (copy_rect.left() - rArea.left()) * 3,
+					p_tile->constScanLine(y - tile_rect.top()) + (copy_rect.left() - tile_rect.left()) * 3, copy_rect.width() * 3);
 			}
-			memcpy(image.scanLine(y), img_buff, bytes_per_line);
 		}
 	}
-	else if (ColorEncoding == Metadata::eColorEncoding::RGBA) {
-		// RGB: keep original color encoding, or color encoding == REC.709
+	rImage = image;
+	return true;
+}
 
-		for (y = 0; y < h; y++) {
-			for (x = 0; x < w; x++) {
-				xpos = (y*w + x); // don't calculate 3 times
-				buff_pos = x * 3; // don't calculate 3 times
+QRect JP2K_TileCache::MissingBounds(const QRect &rArea) {
 
-				img_buff[buff_pos] = psImage->comps[0].data[xpos] >> prec_shift;
-				img_buff[buff_pos + 1] = psImage->comps[1].data[xpos] >> prec_shift;
-				img_buff[buff_pos + 2] = psImage->comps[2].data[xpos] >> prec_shift;
-			}
-			memcpy(image.scanLine(y), img_buff, bytes_per_line);
+	const int first_column = rArea.left() / tile_size, last_column = rArea.right() / tile_size;
+	const int first_row = rArea.top() / tile_size, last_row = rArea.bottom() / tile_size;
+	// all tiles of the visible area must fit
+	mTiles.setMaxCost(qMax(mTiles.maxCost(), (last_column - first_column + 1) * (last_row - first_row + 1)));
+	QRect missing;
+	for (int row = first_row; row <= last_row; row++) {
+		for (int column = first_column; column <= last_column; column++) {
+			if (!mTiles.contains(TileKey(column, row))) missing |= TileRect(column, row);
 		}
 	}
-	// Yuv:  keep original color encoding, or color encoding == REC.709
-	else if (ColorEncoding == Metadata::eColorEncoding::CDCI) {
-		for (y = 0; y < h; y++) {
-			for (x = 0; x < w; x++) {
-
-				xpos = (int)(y*w + x) / 2; // don't calculate twice
-				buff_pos = x * 3; // don't calculate 3 times
-
-				// get Yuv & convert x bit -> 8 bit
-				Y = psImage->comps[0].data[(int)(y*w + x)];
-				Cb = psImage->comps[1].data[xpos];
-				Cr = psImage->comps[2].data[xpos];
-
-				// convert to rgb
-				r = (Y - offset)*maxcv / range_y + 2 * (1 - Kr)          *(Cr - maxcv_plus_1 / 2)*maxcv / range_c;
-				g = (Y - offset)*maxcv / range_y - 2 * Kb*(1 - Kb) / Kg*(Cb - maxcv_plus_1 / 2)*maxcv / range_c - 2 * Kr*(1 - Kr) / Kg*(Cr - maxcv_plus_1 / 2)*maxcv / range_c;
-				b = (Y - offset)*maxcv / range_y + 2 * (1 - Kb)          *(Cb - maxcv_plus_1 / 2)*maxcv / range_c;
-
-				out_r8 = (int)r >> prec_shift;
-				out_g8 = (int)g >> prec_shift;
-				out_b8 = (int)b >> prec_shift;
-
-				// clamp values between 0...255
-				if (out_r8 < 0) { out_r8 = 0; }
-				else if (out_r8 > 255) { out_r8 = 255; }
-				if (out_g8 < 0) { out_g8 = 0; }
-				else if (out_g8 > 255) { out_g8 = 255; }
-				if (out_b8 < 0) { out_b8 = 0; }
-				else if (out_b8 > 255) { out_b8 = 255; }
-
-				// set data
-				buff_pos = x * 3; // don't calculate 3 times
-				img_buff[buff_pos] = (unsigned char)out_r8;
-				img_buff[buff_pos + 1] = (unsigned char)out_g8;
-				img_buff[buff_pos + 2] = (unsigned char)out_b8;
-			}
-			memcpy(image.scanLine(y), img_buff, bytes_per_line);
+	return missing;
+}
+
+void JP2K_TileCache::Insert(const QRect &rRegion, const QImage &rImage) {
+
+	if (rRegion.isEmpty() || rImage.size() != rRegion.size()) return;
+	const int first_column = rRegion.left() / tile_size, last_column = rRegion.right() / tile_size;
+	const int first_row = rRegion.top() / tile_size, last_row = rRegion.bottom() / tile_size;
+	for (int row = first_row; row <= last_row; row++) {
+		for (int column = first_column; column <= last_column; column++) {
+			const QRect tile_rect = TileRect(column, row);
+			if ((tile_rect & rRegion) != tile_rect) continue; // not covered completely
+			mTiles.insert(TileKey(column, row), new QImage(rImage.copy(tile_rect.translated(-rRegion.topLeft()))));
 		}
 	}
-	else { // unknown ColorEncoding
-		return QImage(":/frame_error.png");
+}
+
+int JP2::ReductionForViewport(const QSize &rFrameSize, const QSize &rViewportSize, int maxReduction) {
+
+	if (rFrameSize.isEmpty() || rViewportSize.isEmpty()) return 0;
+	const QSize fitted = rFrameSize.scaled(rViewportSize, Qt::KeepAspectRatio);
+	// every reduction level halves width and height (wavelet decomposition)
+	int reduction = 0;
+	while (reduction < maxReduction && (rFrameSize.width() >> (reduction + 1)) >= fitted.width() && (rFrameSize.height() >> (reduction + 1)) >= fitted.height()) {
+		reduction++;
+	}
+	return reduction;
+}
+
+QImage JP2::DataToQImage(int threadCount /*= 1*/)
+{
+	if (!mColorConversion.Prepare(*this, psImage)) {
+		return QImage(":/frame_error.png"); // unknown ColorEncoding, transfer characteristic or primaries
 	}
 
-	delete img_buff; // clear char buffer
+	QImage image(mColorConversion.GetWidth(), mColorConversion.GetHeight(), QImage::Format_RGB888); // create image
+	if (image.isNull()) return QImage(":/frame_error.png");
+
+	// write directly into the scanlines
+	uchar *p_bits = image.bits(); // detach once, before the bands are converted concurrently
+	const int bytes_per_line = image.bytesPerLine();
+	const int band_count = qBound(1, threadCount, image.height() / min_rows_per_band);
+	if (band_count == 1) {
+		mColorConversion.ConvertRows(0, image.height(), p_bits, bytes_per_line);
+	}
+	else {
+		const int rows_per_band = (image.height() + band_count - 1) / band_count;
+		QSemaphore done;
+		for (int i = 1; i < band_count; i++) {
+			ConvertRowsTask *p_task = new ConvertRowsTask(mColorConversion, i * rows_per_band, (i + 1) * rows_per_band, p_bits, bytes_per_line, done);
+			// never wait for a busy pool, convert the band ourselves instead
+			if (!QThreadPool::globalInstance()->tryStart(p_task)) {
+				p_task->run();
+				delete p_task;
+			}
+		}
+		// the calling thread converts the first band
+		mColorConversion.ConvertRows(0, rows_per_band, p_bits, bytes_per_line);
+		done.acquire(band_count - 1);
+	}
 
 	return image;
 }
@@ -16,9 +16,16 @@
 #pragma once
 #include <QObject>
 #include <QThreadPool>
+#include <QCache>
+#include <QImage>
+#include <QRect>
+#include <QMutex>
 #include "Error.h"
 #include "openjpeg.h"
 #include "ImfPackage.h"
+#include "JP2K_ColorConversion.h"
+#include "JP2K_FrameReader.h"
+#include "JP2K_FrameCache.h"
 
 class AssetMxfTrack;
 
@@ -29,9 +36,33 @@ typedef struct
 	OPJ_SIZE_T offset; //Where are we currently in our data.
 }opj_memory_stream;
 
+/*! \brief
+Process wide transfer function lookup tables shared by all JP2 instances.
+The tables are built once on first use and are read-only afterwards. Index with a value normalized to [0, TransferLuts::size - 1].
+*/
+class TransferLuts {
+
+public:
+	static const int bitdepth = 16; // lookup table size (default: 16 bit)
+	static const int size = 1 << bitdepth;
+	//! Use TransferLuts::GetGlobalInstance().
+	TransferLuts();
+	static const TransferLuts* GetGlobalInstance();
+	const float* GetOetf709() const { return mOetf709; } // BT.709 OETF (Inverse of BT.1886 EOTF)
+	const float* GetEotf2020() const { return mEotf2020; } // BT.2020 EOTF
+	const float* GetEotfPQ() const { return mEotfPQ; } // SMPTE ST 2084 EOTF [cd/m^2]
+
+private:
+	Q_DISABLE_COPY(TransferLuts);
+	float mOetf709[size];
+	float mEotf2020[size];
+	float mEotfPQ[size];
+};
+
 class JP2 {
 
 public:
+	JP2();
 
 	//WR
 	quint32	ComponentMinRef;
@@ -54,23 +85,18 @@ public:
 
 	QSharedPointer<AssetMxfTrack> current_asset; // pointer to current asset
 
+	//! Largest resolution reduction (cp_reduce) at which a frame of rFrameSize still covers rViewportSize [device pixels] when scaled to fit.
+	static int ReductionForViewport(const QSize &rFrameSize, const QSize &rViewportSize, int maxReduction);
+
 protected:
 
-	// luts
-	static const int bitdepth = 16; // lookup table size (default: 16 bit)
+	// luts (shared, see TransferLuts)
+	static const int bitdepth = TransferLuts::bitdepth; // lookup table size (default: 16 bit)
 	int max_f; // (float)pow(2, bitdepth)
 	float max_f_; // max_f - 1;
-	float *oetf_709;
-	float *eotf_709;
-	float *oetf_2020;
-	float *eotf_2020;
-	float *oetf_PQ;
-	float *eotf_PQ;
-
-	AS_02::JP2K::MXFReader *reader;
-	ASDCP::MXF::IndexTableSegment::IndexEntry IndexF1; // current frame offset
-	ASDCP::MXF::IndexTableSegment::IndexEntry IndexF2; // next frame offset
-	int default_buffer_size = 30000000; // byte
+	const float *oetf_709;
+	const float *eotf_2020;
+	const float *eotf_PQ;
 
 	OPENJPEG_H::opj_image_t *psImage;
 	OPENJPEG_H::opj_codec_t *pDecompressor;
@@ -78,10 +104,8 @@ protected:
 	opj_memory_stream pMemoryStream;
 
 	// data to qimage
-	unsigned char *img_buff;
-	int w, h, xpos, buff_pos, x, y, bytes_per_line;
-	float Y, Cb, Cr, r, g, b, out_r, out_g, out_b, out_r8, out_g8, out_b8;
-	QImage DataToQImage(); // converts opj_image_t -> QImage
+	JP2K_ColorConversion mColorConversion; // kernel is selected per frame
+	QImage DataToQImage(int threadCount = 1); // converts opj_image_t -> QImage, bands of rows are converted on up to threadCount threads
 
 	// memory stream methods
 	static OPJ_SIZE_T opj_memory_stream_read(void * p_buffer, OPJ_SIZE_T p_nb_bytes, void * p_user_data);
@@ -97,7 +121,36 @@ protected:
 	static void error_callback(const char *msg, void *data);
 
 	bool err = false; // error in the decoding process?
-	ASDCP::JP2K::FrameBuffer *buff;
+	JP2K_CodeStream mCodeStream; // current codestream, pMemoryStream points into it
+};
+
+/*! \brief
+Converted blocks of the current frame, reused when the visible area of the unscaled preview moves.
+Coordinates are pixels of the decoded (reduced) frame.
+*/
+class JP2K_TileCache {
+
+public:
+	static const int tile_size = 512; // [px] even, keeps chroma sub sampling aligned
+	JP2K_TileCache(int maxTiles = 64);
+	//! Clears the cache if the frame (asset, frame nr, layer, color conversion) changed.
+	void SetFrame(const QString &rFrameKey, const QSize &rFrameSize);
+	QSize GetFrameSize() const { return mFrameSize; }
+	//! Copies rArea into rImage. Returns false if a tile covering rArea is missing.
+	bool Assemble(const QRect &rArea, QImage &rImage);
+	//! Tile aligned bounding rect of the missing tiles covering rArea.
+	QRect MissingBounds(const QRect &rArea);
+	//! rRegion must be tile aligned (see JP2K_TileCache::MissingBounds()).
+	void Insert(const QRect &rRegion, const QImage &rImage);
+
+private:
+	Q_DISABLE_COPY(JP2K_TileCache);
+	QRect TileRect(int column, int row) const;
+	static quint64 TileKey(int column, int row) { return ((quint64)column << 32) | (quint32)row; }
+
+	QString mFrameKey;
+	QSize mFrameSize;
+	QCache<quint64, QImage> mTiles;
 };
 
 class JP2K_Preview : public QObject, public JP2 {
@@ -106,26 +159,36 @@ private:
 
 	void cleanUp();
 	void setUp();
-	bool decodeImage();
+	bool decodeImage(const QRect &rArea = QRect()); // rArea: pixels of the reduced frame, null decodes everything
+	void decodeArea(const QRect &rArea);
 	void setAsset();
 	bool extractFrame(qint64 frameNr);
+	QImage decodeProxy(qint64 frameNr); // decodes a timeline proxy and keeps it in the asset
 	void save2File(); // save JP2K bytestream to file
 	
 	int mCpus = 0; // nr of threads used for decoding
 	QTime mDecode_time; // time (ms) needed to decode/convert the image
 	QString mMsg; // error message
 	QString mMxf_path; // path to current asset
+	JP2K_FrameReader mFrameReader;
+	JP2K_TileCache mTileCache; // zoomed preview
+	QRect mDecodeArea; // written by the gui thread, read by the decoding thread
+	mutable QMutex mDecodeAreaMutex;
+	QList<qint64> mProxyFrames; // frames of the timeline thumbnail strip, written by the gui thread, read by the proxy thread
+	mutable QMutex mProxyFramesMutex;
 
 public:
 	JP2K_Preview();
 	~JP2K_Preview();
 
 	qint64 mFrameNr;
-	qint64 mFirst_proxy;
-	qint64 mSecond_proxy;
 	QSharedPointer<AssetMxfTrack> asset;
+	void setProxyFrames(const QList<qint64> &rFrames); // frames of the timeline thumbnail strip
+	QList<qint64> getProxyFrames() const;
+	void setDecodeArea(const QRect &rArea); // visible area of the unscaled preview (pixels of the reduced frame), null: decode the whole frame
+	QRect getDecodeArea() const;
 signals:
-	void proxyFinished(const QImage&, const QImage&); // finished generating proxy
+	void proxyFinished(const QList<QImage>&); // finished generating the thumbnail strip (one image per frame of getProxyFrames())
 	void ShowFrame(const QImage&);
 	void decodingStatus(qint64, QString);
 	void finished(); // everything, including cleanup is done...
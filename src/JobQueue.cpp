@@ -21,8 +21,33 @@
 
 Q_GLOBAL_STATIC(JobQueue, theInstance)
 
-AbstractJob::AbstractJob(const QString &rDescription) :
-QObject(NULL), mMutex(), mError(), mDescription(rDescription), mIdentifier() {
+//! Worker thread of the JobQueue. Executes jobs of one resource class until no more jobs are pending.
+class JobWorker : public QThread {
+
+public:
+	JobWorker(JobQueue *pQueue, int resourceClass) : QThread(NULL), mpQueue(pQueue), mResourceClass(resourceClass) {}
+	virtual ~JobWorker() {}
+
+protected:
+	virtual void run() {
+
+		AbstractJob *p_job = NULL;
+		while((p_job = mpQueue->TakeJob(mResourceClass)) != NULL) {
+			QObject::connect(p_job, SIGNAL(Progress(int)), mpQueue, SLOT(JobProgress(int)));
+			emit mpQueue->NextJobStarted(p_job->GetDescription());
+			Error error = p_job->PerformRun();
+			mpQueue->JobDone(p_job, error);
+		}
+	}
+
+private:
+	Q_DISABLE_COPY(JobWorker);
+	JobQueue *mpQueue;
+	const int mResourceClass;
+};
+
+AbstractJob::AbstractJob(const QString &rDescription, eResourceClass resourceClass /*= ResourceMixed*/) :
+QObject(NULL), mMutex(), mError(), mDescription(rDescription), mIdentifier(), mResourceClass(resourceClass), mDependencies() {
 
 }
 
@@ -66,13 +91,19 @@ QVariant AbstractJob::GetIdentifier() {
 }
 
 JobQueue::JobQueue(QObject *pParent /*= NULL*/) :
-QThread(pParent), mMutex(), mQueue(), mErrors(), mMaxProgress(0), mJobProgress(0), mCurrentProgress(0), mInterruptIfError(false) {
-
+QThread(pParent), mQueue(), mUnfinishedJobs(), mWorkers(), mMutex(), mJobStateChanged(), mErrors(), mJobProgress(), mDispatching(false), mStop(false),
+mMaxProgress(0), mCurrentProgress(0), mInterruptIfError(false), mInterrupted(false) {
+
+	const int cores = qMax(1, QThread::idealThreadCount());
+	mWorkerCount[AbstractJob::ResourceIo] = 2;
+	mWorkerCount[AbstractJob::ResourceCpu] = cores;
+	mWorkerCount[AbstractJob::ResourceMixed] = qMax(1, cores / 2);
+	for(int i = 0; i < 3; i++) mActiveWorkers[i] = 0;
 }
 
 JobQueue::~JobQueue() {
 
-	requestInterruption();
+	InterruptQueue();
 	wait();
 	for(int i = 0; i < mQueue.size(); i++) {
 		AbstractJob *p_job = mQueue.at(i);
@@ -84,43 +115,103 @@ void JobQueue::run() {
 
 	emit Progress(0);
 	mMutex.lock();
-	bool stop = false;
+	mDispatching = true;
+	SpawnWorkers();
+	mMutex.unlock();
 
-	while(mQueue.empty() == false) {
-		QPointer<AbstractJob> p_job(mQueue.dequeue());
+	forever {
+		mMutex.lock();
+		while(mActiveWorkers[AbstractJob::ResourceIo] + mActiveWorkers[AbstractJob::ResourceCpu] + mActiveWorkers[AbstractJob::ResourceMixed] > 0) {
+			mJobStateChanged.wait(&mMutex);
+		}
+		QList<JobWorker*> workers = mWorkers;
+		mWorkers.clear();
+		if(workers.isEmpty() == true) mDispatching = false;
 		mMutex.unlock();
-		connect(p_job.data(), SIGNAL(Progress(int)), this, SLOT(JobProgress(int)));
+		if(workers.isEmpty() == true) break;
+		for(int i = 0; i < workers.size(); i++) {
+			workers.at(i)->wait();
+			delete workers.at(i);
+		}
+	}
+	emit Progress(100);
+}
 
-		if(p_job.isNull() == false) {
-			emit NextJobStarted(p_job->GetDescription());
-			bool auto_delete = p_job->autoDelete();
-			Error error = p_job->PerformRun();
-			if(error.IsError() == true) {
-				mMutex.lock();
-				mErrors.push_back(p_job->GetLastError());
-				mMutex.unlock();
-				if(mInterruptIfError == 1) stop = true;
-			}
-			if(auto_delete == true && p_job.isNull() == false) {
-				p_job->deleteLater();
-			}
+void JobQueue::SpawnWorkers() {
+
+	if(mDispatching == false || mStop == true || mInterrupted == 1) return;
+	int pending[3] = {0, 0, 0};
+	for(int i = 0; i < mQueue.size(); i++) {
+		if(mQueue.at(i)) pending[mQueue.at(i)->GetResourceClass()]++;
+	}
+	for(int resource_class = 0; resource_class < 3; resource_class++) {
+		while(mActiveWorkers[resource_class] < qMin(mWorkerCount[resource_class], pending[resource_class])) {
+			JobWorker *p_worker = new JobWorker(this, resource_class);
+			mWorkers.push_back(p_worker);
+			mActiveWorkers[resource_class]++;
+			p_worker->start(LowPriority);
 		}
+	}
+}
 
-		mMutex.lock();
+AbstractJob* JobQueue::TakeJob(int resourceClass) {
 
-		if(isInterruptionRequested() == true || stop == true) break;
+	QMutexLocker locker(&mMutex);
+	forever {
+		bool pending = false;
+		if(mStop == false && mInterrupted == 0) {
+			for(int i = 0; i < mQueue.size(); i++) {
+				AbstractJob *p_job = mQueue.at(i);
+				if(p_job == NULL || p_job->GetResourceClass() != resourceClass) continue;
+				pending = true;
+				bool ready = true;
+				const QList<AbstractJob*> dependencies = p_job->GetDependencies();
+				for(int k = 0; k < dependencies.size(); k++) {
+					if(mUnfinishedJobs.contains(dependencies.at(k))) {
+						ready = false;
+						break;
+					}
+				}
+				if(ready == true) {
+					mQueue.removeAt(i);
+					return p_job;
+				}
+			}
+		}
+		if(pending == false) {
+			mActiveWorkers[resourceClass]--;
+			mJobStateChanged.wakeAll();
+			return NULL;
+		}
+		// Wait for a dependency to finish.
+		mJobStateChanged.wait(&mMutex);
 	}
+}
+
+void JobQueue::JobDone(AbstractJob *pJob, const Error &rError) {
 
+	bool auto_delete = pJob->autoDelete();
+	mMutex.lock();
+	mUnfinishedJobs.remove(pJob);
+	if(rError.IsError() == true) {
+		mErrors.push_back(rError);
+		if(mInterruptIfError == 1) mStop = true;
+	}
+	mJobStateChanged.wakeAll();
 	mMutex.unlock();
-	emit Progress(100);
+	if(auto_delete == true) pJob->deleteLater();
 }
 
 void JobQueue::StartQueue() {
 
 	if(isRunning() == false) {
+		mMutex.lock();
 		mMaxProgress = mQueue.size() * 100;
-		mJobProgress = 0;
 		mCurrentProgress = 0;
+		mJobProgress.clear();
+		mStop = false;
+		mInterrupted = false;
+		mMutex.unlock();
 		start(LowPriority);
 	}
 }
@@ -128,21 +219,47 @@ void JobQueue::StartQueue() {
 void JobQueue::InterruptQueue() {
 
 	requestInterruption();
+	mMutex.lock();
+	mInterrupted = true;
+	for(int i = 0; i < mWorkers.size(); i++) mWorkers.at(i)->requestInterruption();
+	mJobStateChanged.wakeAll();
+	mMutex.unlock();
 }
 
 void JobQueue::AddJob(AbstractJob *pJob) {
 
 	mMutex.lock();
 	mQueue.enqueue(pJob);
+	mUnfinishedJobs.insert(pJob);
 	mMaxProgress += 100;
+	SpawnWorkers();
+	mJobStateChanged.wakeAll();
 	mMutex.unlock();
 }
 
+void JobQueue::SetWorkerCount(int resourceClass, int count) {
+
+	if(resourceClass < AbstractJob::ResourceIo || resourceClass > AbstractJob::ResourceMixed) return;
+	QMutexLocker lock(&mMutex);
+	mWorkerCount[resourceClass] = qMax(1, count);
+}
+
+int JobQueue::GetWorkerCount(int resourceClass) const {
+
+	if(resourceClass < AbstractJob::ResourceIo || resourceClass > AbstractJob::ResourceMixed) return 0;
+	QMutexLocker lock(&mMutex);
+	return mWorkerCount[resourceClass];
+}
+
 void JobQueue::JobProgress(int progress) {
 
-	if(progress == 0) mJobProgress = 0;
-	mCurrentProgress += progress - mJobProgress;
-	mJobProgress = progress;
+	// Runs in the thread of the JobQueue object. Several jobs report concurrently, track them separately.
+	QObject *p_job = sender();
+	int last_progress = (progress == 0) ? 0 : mJobProgress.value(p_job, 0);
+	mCurrentProgress += progress - last_progress;
+	// AbstractJob::PerformRun() reports 100 when the job finished. A later job may be allocated at the same address.
+	if(progress >= 100) mJobProgress.remove(p_job);
+	else mJobProgress.insert(p_job, progress);
 	if(mMaxProgress > 0) emit Progress(mCurrentProgress * 100 / mMaxProgress);
 }
 
@@ -159,7 +276,7 @@ QList<Error> JobQueue::GetErrors() {
 
 void JobQueue::FlushQueue() {
 
-	requestInterruption();
+	InterruptQueue();
 	wait();
 	for(int i = 0; i < mQueue.size(); i++) {
 		AbstractJob *p_job = mQueue.at(i);
@@ -167,6 +284,7 @@ void JobQueue::FlushQueue() {
 	}
 	mMutex.lock();
 	mQueue.clear();
+	mUnfinishedJobs.clear();
 	mErrors.clear();
 	mMutex.unlock();
 }
@@ -17,23 +17,37 @@
 #include "Error.h"
 #include <QThread>
 #include <QMutex>
+#include <QWaitCondition>
 #include <QQueue>
+#include <QHash>
+#include <QSet>
 #include <QRunnable>
 #include <QVariant>
 #include <QAtomicInteger>
 
 
 class AbstractJob;
+class JobWorker;
 
+/*! \brief
+The Job Queue dispatches the queued jobs to worker threads. Every job declares a resource class (see AbstractJob::eResourceClass),
+for every resource class a separate number of workers is started (see JobQueue::SetWorkerCount()). A job is not started before all its
+dependencies (see AbstractJob::AddDependency()) are finished.
+*/
 class JobQueue : public QThread {
 
 	Q_OBJECT
 
+	friend class JobWorker;
+
 public:
 	JobQueue(QObject *pParent = NULL);
 	virtual ~JobQueue();
 	bool IsQueueRunning() const { return isRunning(); }
 	void AddJob(AbstractJob *pJob);
+	//! Sets the max. number of jobs of the given resource class running concurrently. Takes effect as soon as workers are started for pending jobs (JobQueue::StartQueue() or JobQueue::AddJob() on a running queue). Running workers aren't stopped if the count is lowered.
+	void SetWorkerCount(int resourceClass, int count);
+	int GetWorkerCount(int resourceClass) const;
 	//! The Job Queue stops if an error occurred if JobQueue::GetInterruptIfError returns true (not the default).
 	void SetInterruptIfError(bool interrupt) { mInterruptIfError = interrupt; }
 	bool GetInterruptIfError() const { return mInterruptIfError; }
@@ -60,14 +74,28 @@ protected:
 
 private:
 	Q_DISABLE_COPY(JobQueue);
+	//! Called by workers. Blocks until a job of the resource class is ready. Returns NULL if the worker should quit.
+	AbstractJob* TakeJob(int resourceClass);
+	//! Called by workers after a job was executed.
+	void JobDone(AbstractJob *pJob, const Error &rError);
+	//! Starts additional workers for pending jobs. Caller must hold mMutex.
+	void SpawnWorkers();
 
 	QQueue<AbstractJob*> mQueue;
-	QMutex mMutex;
+	QSet<AbstractJob*> mUnfinishedJobs;
+	QList<JobWorker*> mWorkers;
+	mutable QMutex mMutex;
+	QWaitCondition mJobStateChanged;
 	QList<Error> mErrors;
+	QHash<QObject*, int> mJobProgress; // progress of the running jobs
+	int mWorkerCount[3];
+	int mActiveWorkers[3];
+	bool mDispatching;
+	bool mStop;
 	QAtomicInteger<int> mMaxProgress;
-	QAtomicInteger<int> mJobProgress;
 	QAtomicInteger<int> mCurrentProgress;
 	QAtomicInteger<int> mInterruptIfError;
+	QAtomicInteger<int> mInterrupted;
 };
 
 
@@ -77,11 +105,21 @@ class AbstractJob : public QObject, public QRunnable {
 	Q_OBJECT
 
 public:
-	AbstractJob(const QString &rDescription);
+	//! Determines which workers of the JobQueue execute the job.
+	enum eResourceClass {
+		ResourceIo = 0, //!< Bound by disk throughput (e.g. wrapping, hashing).
+		ResourceCpu, //!< Bound by computation.
+		ResourceMixed
+	};
+	AbstractJob(const QString &rDescription, eResourceClass resourceClass = ResourceMixed);
 	virtual ~AbstractJob() {}
 	void SetIdentifier(const QVariant &rIdentifier);
 	QVariant GetIdentifier();
 	QString GetDescription() const { return mDescription; }
+	eResourceClass GetResourceClass() const { return mResourceClass; }
+	//! The JobQueue won't start this job before pJob is finished. Both jobs must be added to the same JobQueue.
+	void AddDependency(AbstractJob *pJob) { if(pJob && pJob != this) mDependencies.push_back(pJob); }
+	QList<AbstractJob*> GetDependencies() const { return mDependencies; }
 	//! Returns the last error. If no error occurred during execution Error::IsError() returns false. This method is thread safe.
 	Error GetLastError();
 	//! Don't reimplement this method or make sure that base class implementation is invoked.
@@ -98,6 +136,7 @@ protected:
 	/*! \brief
 	Implement the task that should run asynchronously. You should emit Job::Progress() regulary to inform the JobQueue about the current progress.
 	Additionally you should check QThread::currentThread().isInterruptionRequested() regularry and return Job::Execute() prematurely if interruption is requested.
+	Note that jobs are executed concurrently by the JobQueue workers. Don't touch process wide state (e.g. QDir::setCurrent()) without synchronization.
 	Return empty error if everything went fine. Otherwise return filled error.
 	*/
 	virtual Error Execute() = 0;
@@ -110,4 +149,6 @@ private:
 	Error mError;
 	QString mDescription;
 	QVariant mIdentifier;
+	eResourceClass mResourceClass;
+	QList<AbstractJob*> mDependencies;
 };
@@ -15,74 +15,209 @@
  * along with this program.If not, see <http://www.gnu.org/licenses/>.
  */
 #include "Jobs.h"
+#include "HashEngine.h"
+#include "MetadataExtractor.h"
 #include "AS_02.h"
 #include "Metadata.h"
 #include <vector>
 #include "PCMParserList.h"
 #include "AS_DCP_internal.h"
 #include <QFileInfo>
-#include <QCryptographicHash>
 #include <QFile>
 #include <QProcess>
 #include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QGlobalStatic>
 //regxmllibc
 #include <com/sandflow/smpte/regxml/dict/MetaDictionaryCollection.h>
 #include <com/sandflow/smpte/regxml/dict/importers/XMLImporter.h>
 #include "com/sandflow/smpte/regxml/MXFFragmentBuilder.h"
 #include <fstream>
+#include <sstream>
+
+//#define DEBUG_ESSENCE_DESCRIPTOR
+//#define DEBUG_HASH
 
 XERCES_CPP_NAMESPACE_USE
 
 using namespace rxml;
 //regxmllibc
 
-JobCalculateHash::JobCalculateHash(const QString &rSourceFile) :
-AbstractJob(tr("Calculating Hash: %1").arg(QFileInfo(rSourceFile).fileName())), mSourceFile(rSourceFile) {
+namespace
+{
+	// Jobs run concurrently. Serializes changes of the process wide working directory.
+	QMutex working_dir_mutex;
+}
+
+Q_GLOBAL_STATIC(MetaDictionaryCache, theMetaDictionaryCache)
+
+#define HEADER_PARTITION_PREFIX_SIZE 65536 // [Byte] Covers the run-in, the partition pack and the header metadata of most files with a single read.
+#define HEADER_PARTITION_MAX_SIZE 268435456 // [Byte] Sanity limit for HeaderByteCount.
+
+namespace
+{
+	// SMPTE ST 377-1 Header Partition Pack key (bytes 0-13), byte 14 (partition status) varies.
+	const char header_partition_pack_key[] = {0x06, 0x0e, 0x2b, 0x34, 0x02, 0x05, 0x01, 0x01, 0x0d, 0x01, 0x02, 0x01, 0x01, 0x02};
+	// SMPTE ST 377-1 KLV Fill item key, byte 7 (registry version) varies.
+	const char fill_key[] = {0x06, 0x0e, 0x2b, 0x34, 0x01, 0x01, 0x01, 0x00, 0x03, 0x01, 0x02, 0x10, 0x01, 0x00, 0x00, 0x00};
+
+	//! Decodes a BER length at pos. Returns the number of bytes used by the length field or 0 if rData is too short or the length is invalid.
+	int decode_ber_length(const QByteArray &rData, int pos, quint64 &rLength) {
+
+		if(pos >= rData.size()) return 0;
+		const quint8 first = (quint8)rData.at(pos);
+		if(first < 0x80) {
+			rLength = first;
+			return 1;
+		}
+		const int count = first & 0x7f;
+		if(count == 0 || count > 8 || pos + 1 + count > rData.size()) return 0;
+		rLength = 0;
+		for(int i = 0; i < count; i++) rLength = (rLength << 8) | (quint8)rData.at(pos + 1 + i);
+		return 1 + count;
+	}
+
+	quint64 read_uint64_be(const QByteArray &rData, int pos) {
 
+		quint64 value = 0;
+		for(int i = 0; i < 8; i++) value = (value << 8) | (quint8)rData.at(pos + i);
+		return value;
+	}
+
+	bool is_fill_key(const QByteArray &rData, int pos) {
+
+		if(pos + 16 > rData.size()) return false;
+		for(int i = 0; i < 16; i++) {
+			if(i != 7 && rData.at(pos + i) != fill_key[i]) return false;
+		}
+		return true;
+	}
 }
 
-Error JobCalculateHash::Execute() {
+bool read_header_partition(const QString &rFilePath, QByteArray &rHeaderPartition, qint64 *pBytesRead /*= NULL*/, QString *pErrorString /*= NULL*/) {
 
-	QFile file(mSourceFile);
+	if(pBytesRead) *pBytesRead = 0;
+	QFile file(rFilePath);
 	if(file.open(QIODevice::ReadOnly) == false) {
-		return Error(Error::SourceFileOpenError, file.fileName());
+		if(pErrorString) *pErrorString = file.errorString();
+		return false;
+	}
+	QByteArray data = file.read(HEADER_PARTITION_PREFIX_SIZE);
+	if(pBytesRead) *pBytesRead = data.size();
+	// The run-in is at most 65535 bytes long (SMPTE ST 377-1).
+	const int pack_pos = data.indexOf(QByteArray::fromRawData(header_partition_pack_key, sizeof(header_partition_pack_key)));
+	quint64 pack_length = 0;
+	const int pack_ber_size = pack_pos < 0 ? 0 : decode_ber_length(data, pack_pos + 16, pack_length);
+	const int pack_value_pos = pack_pos + 16 + pack_ber_size;
+	if(pack_pos < 0 || pack_ber_size == 0 || pack_length < 40 || pack_value_pos + 40 > data.size()) {
+		if(pErrorString) *pErrorString = QObject::tr("No header partition pack found.");
+		return false;
+	}
+	// MajorVersion (2), MinorVersion (2), KAGSize (4), ThisPartition (8), PreviousPartition (8), FooterPartition (8), HeaderByteCount (8)
+	const quint64 header_byte_count = read_uint64_be(data, pack_value_pos + 32);
+	if(header_byte_count == 0 || header_byte_count > HEADER_PARTITION_MAX_SIZE || pack_length > HEADER_PARTITION_MAX_SIZE) {
+		if(pErrorString) *pErrorString = QObject::tr("Header partition doesn't declare its header metadata size.");
+		return false;
+	}
+	// HeaderByteCount starts with the Primer Pack. A KAG alignment fill may precede it.
+	int metadata_pos = pack_value_pos + (int)pack_length;
+	quint64 fill_length = 0;
+	int fill_ber_size = 0;
+	if(is_fill_key(data, metadata_pos) == true && (fill_ber_size = decode_ber_length(data, metadata_pos + 16, fill_length)) > 0 && fill_length <= HEADER_PARTITION_MAX_SIZE) {
+		metadata_pos += 16 + fill_ber_size + (int)fill_length;
 	}
+	const qint64 end = (qint64)metadata_pos + (qint64)header_byte_count;
+	if(end > data.size()) {
+		// One more bounded read for the remainder of the header metadata.
+		const QByteArray remainder = file.read(end - data.size());
+		if(pBytesRead) *pBytesRead += remainder.size();
+		data.append(remainder);
+		if(end > data.size()) {
+			if(pErrorString) *pErrorString = QObject::tr("Header partition truncated.");
+			return false;
+		}
+	}
+	rHeaderPartition = data.mid(pack_pos, end - pack_pos);
+	return true;
+}
 
-	QCryptographicHash hasher(QCryptographicHash::Sha1);
+DOMDocument* extract_essence_descriptor(const QString &rFilePath, Error &rError) {
 
-	Error error;
-	char buffer[16 * 1024];
-	qint64 count;
-	qint64 file_size = file.size();
+	const MetaDictionaryCollection *p_dictionaries = MetaDictionaryCache::GetGlobalInstance()->Get(rError);
+	if(p_dictionaries == NULL) return NULL;
+
+	XMLCh tempStr[3] = { chLatin_L, chLatin_S, chNull };
+	DOMImplementation *impl = DOMImplementationRegistry::getDOMImplementation(tempStr);
+
+	DOMDocument *doc = impl->createDocument();
+
+	// Feed the fragment builder with the header partition only. Fall back to the whole file if the header metadata size is unknown.
+	QByteArray header_partition;
 	qint64 bytes_read = 0;
-	int progress = 0;
-	int last_progress = 0;
-	do {
-		if(QThread::currentThread()->isInterruptionRequested()) {
-			error = Error(Error::WorkerInterruptionRequest);
-			break;
-		}
-		count = file.read(buffer, sizeof(buffer));
-		if(count == -1) {
-			error = Error(Error::HashCalculation, tr("Couldn't read file for Hash calculation."));
-			break;
-		}
-		bytes_read += count;
-		progress = bytes_read * 100 / file_size;
-		if(progress != last_progress) emit Progress(progress);
-		last_progress = progress;
-		hasher.addData(buffer, count);
-	} while(!file.atEnd());
+	QString error_string;
+	std::istringstream header_stream;
+	std::ifstream file_stream;
+	std::istream *p_stream = &header_stream;
+	if(read_header_partition(rFilePath, header_partition, &bytes_read, &error_string) == true) {
+		header_stream.str(std::string(header_partition.constData(), header_partition.size()));
+#ifdef DEBUG_ESSENCE_DESCRIPTOR
+		qDebug() << "Essence Descriptor: Read" << bytes_read << "bytes from" << rFilePath;
+#endif
+	}
+	else {
+#ifdef DEBUG_ESSENCE_DESCRIPTOR
+		qDebug() << "Essence Descriptor: Reading whole file" << rFilePath << ":" << error_string;
+#endif
+		file_stream.open(rFilePath.toStdString().c_str(), std::ifstream::in | std::ifstream::binary);
+		p_stream = &file_stream;
+	}
+
+	if (!p_stream->good()) {
+		qDebug() << "Can't read file:" << rFilePath;
+		rError = Error(Error::EssenceDescriptorExtraction);
 
-	if(error.IsError() == false) {
-		emit Result(hasher.result(), GetIdentifier());
 	}
-	file.close();
-	return error;
+	static const rxml::UL ESSENCE_DESCRIPTOR_KEY = "urn:smpte:ul:060e2b34.02010101.0d010101.01012400";
+	static const rxml::AUID ed_auid(ESSENCE_DESCRIPTOR_KEY);
+	DOMDocumentFragment* frag = MXFFragmentBuilder::fromInputStream(*p_stream, *p_dictionaries, NULL, &ed_auid, *doc);
+
+	doc->appendChild(frag);
+	return doc;
+}
+
+JobCalculateHash::JobCalculateHash(const QString &rSourceFile) :
+AbstractJob(tr("Calculating Hash: %1").arg(QFileInfo(rSourceFile).fileName()), ResourceIo), mSourceFile(rSourceFile) {
+
+}
+
+Error JobCalculateHash::Execute() {
+
+	QByteArray hash;
+	QString error_string;
+	HashFileReport report;
+	const HashProgressCallback progress = [this](qint64 bytesHashed, qint64 fileSize) {
+		emit Progress(fileSize > 0 ? (int)(bytesHashed * 100 / fileSize) : 100);
+		return true;
+	};
+	if(hash_file(mSourceFile, hash, &error_string, progress, &report) == false) {
+		switch(report.status) {
+			case HashFileReport::OpenError: return Error(Error::SourceFileOpenError, QString("%1: %2").arg(mSourceFile).arg(error_string));
+			case HashFileReport::Canceled: return Error(Error::WorkerInterruptionRequest);
+			default: return Error(Error::HashCalculation, tr("Couldn't read file for Hash calculation: %1").arg(error_string));
+		}
+	}
+#ifdef DEBUG_HASH
+	// If the hasher waits for the reader most of the time we are disk-bound, otherwise CPU-bound.
+	if(report.elapsedNs > 0) qDebug() << "Hash" << QFileInfo(mSourceFile).fileName() << ":" << report.bytesHashed << "bytes in" << report.elapsedNs / 1e9 << "s,"
+		<< (double)report.bytesHashed / report.elapsedNs << "GB/s," << (report.ioWaitNs * 100 / report.elapsedNs) << "% waiting for IO (" << Sha1Hasher::GetBackendName() << ")";
+#endif
+	emit Result(hash, GetIdentifier()); // hash_file() inserted the hash into the HashCache
+	return Error();
 }
 
 JobWrapWav::JobWrapWav(const QStringList &rSourceFiles, const QString &rOutputFile, const SoundfieldGroup &rSoundFieldGroup, const QUuid &rAssetId, const QString &rLanguageTag, const QString &rMCATitle, const QString &rMCATitleVersion, const QString &rMCAAudioContentKind, const QString &rMCAAudioElementKind) :
-AbstractJob(tr("Wrapping %1").arg(QFileInfo(rOutputFile).fileName())), mOutputFile(rOutputFile), mSourceFiles(rSourceFiles), mSoundFieldGoup(rSoundFieldGroup), mLanguageTag(rLanguageTag), mMCATitle(rMCATitle), mMCATitleVersion(rMCATitleVersion), mMCAAudioContentKind(rMCAAudioContentKind), mMCAAudioElementKind(rMCAAudioElementKind), mWriterInfo() {
+AbstractJob(tr("Wrapping %1").arg(QFileInfo(rOutputFile).fileName()), ResourceIo), mOutputFile(rOutputFile), mSourceFiles(rSourceFiles), mSoundFieldGoup(rSoundFieldGroup), mLanguageTag(rLanguageTag), mMCATitle(rMCATitle), mMCATitleVersion(rMCATitleVersion), mMCAAudioContentKind(rMCAAudioContentKind), mMCAAudioElementKind(rMCAAudioElementKind), mWriterInfo() {
 
 	convert_uuid(rAssetId, (unsigned char*)mWriterInfo.AssetUUID);
 }
@@ -200,7 +335,7 @@ Error JobWrapWav::Execute() {
 
 
 JobWrapTimedText::JobWrapTimedText(const QStringList &rSourceFiles, const QString &rOutputFile, const EditRate &rEditRate, const Duration &rDuration, const QUuid &rAssetId, const QString &rProfile, const QString &rLanguageTag) :
-AbstractJob(tr("Wrapping %1").arg(QFileInfo(rOutputFile).fileName())), mOutputFile(rOutputFile), mSourceFiles(rSourceFiles), mEditRate(rEditRate), mDuration(rDuration), mProfile(rProfile), mLanguageTag(rLanguageTag) {
+AbstractJob(tr("Wrapping %1").arg(QFileInfo(rOutputFile).fileName()), ResourceIo), mOutputFile(rOutputFile), mSourceFiles(rSourceFiles), mEditRate(rEditRate), mDuration(rDuration), mProfile(rProfile), mLanguageTag(rLanguageTag) {
 
 	convert_uuid(rAssetId, (unsigned char*)mWriterInfo.AssetUUID);
 
@@ -221,6 +356,7 @@ Error JobWrapTimedText::Execute() {
 	QFileInfo file_info(mSourceFiles.first());
 
 	//We need to change the working directory to resolve the ancillary resources!
+	QMutexLocker working_dir_locker(&working_dir_mutex);
 	QString dirCopyPath = QDir::currentPath();
 	QDir::setCurrent(file_info.absolutePath());
 
@@ -291,6 +427,90 @@ Error JobWrapTimedText::Execute() {
 }
 //WR
 
+MetaDictionaryCache::MetaDictionaryCache() :
+mMutex(), mDictionaries(), mIsLoaded(false) {
+
+}
+
+MetaDictionaryCache::~MetaDictionaryCache() {
+
+	for(std::map<std::string, MetaDictionary*>::const_iterator it = mDictionaries.getDictionatries().begin(); it != mDictionaries.getDictionatries().end(); it++) {
+		delete it->second;
+	}
+}
+
+MetaDictionaryCache* MetaDictionaryCache::GetGlobalInstance() {
+
+	return theMetaDictionaryCache();
+}
+
+const MetaDictionaryCollection* MetaDictionaryCache::Get(Error &rError) {
+
+	QMutexLocker locker(&mMutex);
+	if(mIsLoaded == false) {
+		rError = Load();
+		if(rError.IsError() == true) return NULL;
+		mIsLoaded = true;
+	}
+	return &mDictionaries;
+}
+
+Error MetaDictionaryCache::Load() {
+
+	QList<QString> dicts_fname = QList<QString>()
+/*		<< "www-smpte-ra-org-reg-335-2012-13-1-amwa-as12.xml"
+		<< "www-smpte-ra-org-reg-335-2012-13-1-amwa-rules.xml"
+		<< "www-smpte-ra-org-reg-335-2012-13-4-archive.xml"
+		<< "www-smpte-ra-org-reg-335-2012-13-12-as11.xml"
+		<< "www-smpte-ra-org-reg-335-2012-13-13.xml"
+		<< "www-smpte-ra-org-reg-395-2014.xml"*/
+		<< "www-smpte-ra-org-reg-395-2014-13-1-aaf.xml"
+/*		<< "www-smpte-ra-org-reg-395-2014-13-1-amwa-as10.xml"
+		<< "www-smpte-ra-org-reg-395-2014-13-1-amwa-as11.xml"
+		<< "www-smpte-ra-org-reg-395-2014-13-1-amwa-as12.xml"
+		<< "www-smpte-ra-org-reg-395-2014-13-1-amwa-as-common.xml"
+		<< "www-smpte-ra-org-reg-395-2014-13-4-archive.xml"
+		<< "www-smpte-ra-org-reg-395-2014-13-12-as11.xml"
+		<< "www-smpte-ra-org-reg-395-2014-13-13.xml"*/
+		<< "www-smpte-ra-org-reg-2003-2012.xml"
+/*		<< "www-smpte-ra-org-reg-2003-2012-13-1-amwa-as11.xml"
+		<< "www-smpte-ra-org-reg-2003-2012-13-1-amwa-as12.xml"
+		<< "www-smpte-ra-org-reg-2003-2012-13-4-archive.xml"
+		<< "www-smpte-ra-org-reg-2003-2012-13-12-as11.xml"
+		<< "www-ebu-ch-metadata-schemas-ebucore-smpte-class13-element.xml"
+		<< "www-ebu-ch-metadata-schemas-ebucore-smpte-class13-group.xml"
+		<< "www-ebu-ch-metadata-schemas-ebucore-smpte-class13-type.xml" */
+		<< "www-smpte-ra-org-reg-335-2012.xml"
+		<< "www-smpte-ra-org-reg-335-2012-13-1-aaf.xml"
+//		<< "www-smpte-ra-org-reg-335-2012-13-1-amwa-as10.xml"
+//		<< "www-smpte-ra-org-reg-335-2012-13-1-amwa-as11.xml"
+		;
+
+	// Xerces is initialized for the whole process in main().
+	XercesDOMParser parser;
+	parser.setDoNamespaces(true);
+	QList<MetaDictionary*> dictionaries;
+	for(int i = 0; i < dicts_fname.size(); i++) {
+		QString dict_path = QApplication::applicationDirPath() + QString("/regxmllib/") + dicts_fname[i];
+		parser.parse(dict_path.toStdString().c_str());
+		DOMDocument *doc = parser.getDocument();
+		if(doc) {
+			MetaDictionary *md = new MetaDictionary();
+			XMLImporter::fromDOM(*doc, *md);
+			dictionaries.push_back(md);
+		}
+		else {
+			qDebug() << "Meta Dictionary " << dict_path << " not found!";
+			qDeleteAll(dictionaries);
+			return Error(Error::MetaDictionaryOpenError, QString("Couldn't open file %1").arg(dict_path));
+		}
+	}
+	for(int i = 0; i < dictionaries.size(); i++) {
+		mDictionaries.addDictionary(dictionaries.at(i));
+	}
+	return Error();
+}
+
 /*JobExtractEssenceDescriptor::JobExtractEssenceDescriptor(const QString &rSourceFile) :
 AbstractJob(tr("Extracting Essence Descriptor from: %1").arg(QFileInfo(rSourceFile).fileName())), mSourceFile(rSourceFile) {
 
@@ -343,7 +563,7 @@ AbstractJob(tr("Extracting Essence Descriptor from: %1").arg(QFileInfo(rSourceFi
 } */
 
 JobExtractEssenceDescriptor::JobExtractEssenceDescriptor(const QString &rSourceFile) :
-AbstractJob(tr("Extracting Essence Descriptor from: %1").arg(QFileInfo(rSourceFile).fileName())), mSourceFile(rSourceFile) {
+AbstractJob(tr("Extracting Essence Descriptor from: %1").arg(QFileInfo(rSourceFile).fileName()), ResourceCpu), mSourceFile(rSourceFile) {
 
 }
 
@@ -354,80 +574,10 @@ Error JobExtractEssenceDescriptor::Execute() {
 	if(file.open(QIODevice::ReadOnly) == false) {
 		return Error(Error::SourceFileOpenError, file.fileName());
 	}
+	file.close();
 	Error error;
 
-	QList<QString> dicts_fname = QList<QString>()
-/*		<< "www-smpte-ra-org-reg-335-2012-13-1-amwa-as12.xml"
-		<< "www-smpte-ra-org-reg-335-2012-13-1-amwa-rules.xml"
-		<< "www-smpte-ra-org-reg-335-2012-13-4-archive.xml"
-		<< "www-smpte-ra-org-reg-335-2012-13-12-as11.xml"
-		<< "www-smpte-ra-org-reg-335-2012-13-13.xml"
-		<< "www-smpte-ra-org-reg-395-2014.xml"*/
-		<< "www-smpte-ra-org-reg-395-2014-13-1-aaf.xml"
-/*		<< "www-smpte-ra-org-reg-395-2014-13-1-amwa-as10.xml"
-		<< "www-smpte-ra-org-reg-395-2014-13-1-amwa-as11.xml"
-		<< "www-smpte-ra-org-reg-395-2014-13-1-amwa-as12.xml"
-		<< "www-smpte-ra-org-reg-395-2014-13-1-amwa-as-common.xml"
-		<< "www-smpte-ra-org-reg-395-2014-13-4-archive.xml"
-		<< "www-smpte-ra-org-reg-395-2014-13-12-as11.xml"
-		<< "www-smpte-ra-org-reg-395-2014-13-13.xml"*/
-		<< "www-smpte-ra-org-reg-2003-2012.xml"
-/*		<< "www-smpte-ra-org-reg-2003-2012-13-1-amwa-as11.xml"
-		<< "www-smpte-ra-org-reg-2003-2012-13-1-amwa-as12.xml"
-		<< "www-smpte-ra-org-reg-2003-2012-13-4-archive.xml"
-		<< "www-smpte-ra-org-reg-2003-2012-13-12-as11.xml"
-		<< "www-ebu-ch-metadata-schemas-ebucore-smpte-class13-element.xml"
-		<< "www-ebu-ch-metadata-schemas-ebucore-smpte-class13-group.xml"
-		<< "www-ebu-ch-metadata-schemas-ebucore-smpte-class13-type.xml" */
-		<< "www-smpte-ra-org-reg-335-2012.xml"
-		<< "www-smpte-ra-org-reg-335-2012-13-1-aaf.xml"
-//		<< "www-smpte-ra-org-reg-335-2012-13-1-amwa-as10.xml"
-//		<< "www-smpte-ra-org-reg-335-2012-13-1-amwa-as11.xml"
-		;
-
-	XMLPlatformUtils::Initialize();
-
-	XercesDOMParser *parser = new XercesDOMParser();
-
-	parser->setDoNamespaces(true);
-
-	MetaDictionaryCollection mds;
-
-	for (int i = 0; i < dicts_fname.size(); i++) {
-
-		QString dict_path = QApplication::applicationDirPath() + QString("/regxmllib/") + dicts_fname[i];
-		parser->parse(dict_path.toStdString().c_str());
-		DOMDocument *doc = parser->getDocument();
-		if (doc) {
-			MetaDictionary *md = new MetaDictionary();
-			XMLImporter::fromDOM(*doc, *md);
-			mds.addDictionary(md);
-		} else
-		{
-			qDebug() << "Meta Dictionary " << dict_path << " not found!";
-			return Error(Error::MetaDictionaryOpenError, QString("Couldn't open file %1").arg(dict_path));
-		}
-	}
-
-	XMLCh tempStr[3] = { chLatin_L, chLatin_S, chNull };
-	DOMImplementation *impl = DOMImplementationRegistry::getDOMImplementation(tempStr);
-	DOMLSOutput       *output = ((DOMImplementationLS*)impl)->createLSOutput();
-
-	DOMDocument *doc = impl->createDocument();
-
-	std::ifstream f(mSourceFile.toStdString().c_str(), std::ifstream::in | std::ifstream::binary);
-
-	if (!f.good()) {
-		qDebug() << "Can't read file:" << mSourceFile;
-		error = Error(Error::EssenceDescriptorExtraction);
-
-	}
-	static const rxml::UL ESSENCE_DESCRIPTOR_KEY = "urn:smpte:ul:060e2b34.02010101.0d010101.01012400";
-	const rxml::AUID* ed_auid = new rxml::AUID(ESSENCE_DESCRIPTOR_KEY);
-	DOMDocumentFragment* frag = MXFFragmentBuilder::fromInputStream(f, mds, NULL, ed_auid, *doc);
-
-	doc->appendChild(frag);
-
+	DOMDocument *doc = extract_essence_descriptor(mSourceFile, error);
 
 	if(error.IsError() == false) {
 		emit Result(doc, GetIdentifier());
@@ -435,15 +585,21 @@ Error JobExtractEssenceDescriptor::Execute() {
 
 	//doc->release();
 
+	return error;
+}
+//WR
 
-	/* free heap */
+JobReadMetadata::JobReadMetadata(const QString &rSourceFile) :
+AbstractJob(tr("Reading Metadata: %1").arg(QFileInfo(rSourceFile).fileName()), ResourceIo), mSourceFile(rSourceFile) {
 
-	for (std::map<std::string, MetaDictionary*>::const_iterator it = mds.getDictionatries().begin();
-		it != mds.getDictionatries().end();
-		it++) {
-		delete it->second;
-	}
-	XMLPlatformUtils::Terminate();
+}
+
+Error JobReadMetadata::Execute() {
+
+	Metadata metadata;
+	MetadataExtractor extractor;
+	Error error = extractor.ReadMetadata(metadata, mSourceFile);
+	// Emit even if reading failed. The receiver is waiting for a result to leave its placeholder state.
+	emit Result(metadata, GetIdentifier());
 	return error;
 }
-//WR
@@ -17,10 +17,13 @@
 #include "JobQueue.h"
 #include "info.h"
 #include "ImfCommon.h"
+#include "MetadataExtractorCommon.h"
 #include <xercesc/dom/DOM.hpp>
 #include <xercesc/util/PlatformUtils.hpp>
 #include <xercesc/framework/LocalFileFormatTarget.hpp>
 #include <xercesc/parsers/XercesDOMParser.hpp>
+#include <com/sandflow/smpte/regxml/dict/MetaDictionaryCollection.h>
+#include <QMutex>
 
 XERCES_CPP_NAMESPACE_USE
 
@@ -125,7 +128,41 @@ private:
 	//WR
 };
 
-/*class JobExtractEssenceDescriptor : public AbstractJob {
+/*! \brief
+Process wide RegXML dictionaries used by JobExtractEssenceDescriptor. The dictionaries are loaded on first use
+and never modified afterwards, so concurrent jobs share them without further synchronization.
+*/
+class MetaDictionaryCache {
+
+public:
+	MetaDictionaryCache();
+	~MetaDictionaryCache();
+	static MetaDictionaryCache* GetGlobalInstance();
+	//! Loads the dictionaries if necessary. Returns NULL and sets rError if a dictionary couldn't be loaded.
+	const rxml::MetaDictionaryCollection* Get(Error &rError);
+
+private:
+	Q_DISABLE_COPY(MetaDictionaryCache);
+	Error Load();
+
+	QMutex mMutex;
+	rxml::MetaDictionaryCollection mDictionaries;
+	bool mIsLoaded;
+};
+
+
+/*! \brief
+Reads the header partition (partition pack and header metadata) of an MXF file. The size is taken from the HeaderByteCount of the partition pack,
+no essence bytes are read. Usually a single read of 64 KiB suffices, large header metadata requires one more bounded read.
+Returns false if the file has no header partition pack or the HeaderByteCount is zero. pBytesRead receives the number of bytes read from the file.
+*/
+bool read_header_partition(const QString &rFilePath, QByteArray &rHeaderPartition, qint64 *pBytesRead = NULL, QString *pErrorString = NULL);
+
+//! Builds the RegXML fragment of the essence descriptor of an MXF file. Reads the header partition only if possible (see read_header_partition()).
+DOMDocument* extract_essence_descriptor(const QString &rFilePath, Error &rError);
+
+
+/*class JobExtractEssenceDescriptor : public AbstractJob {
 
 	Q_OBJECT
 
@@ -166,3 +203,25 @@ private:
 	const QString mSourceFile;
 
 };
+
+
+//! Reads the essence metadata of a (MXF) file using MetadataExtractor. Only the file headers are read.
+class JobReadMetadata : public AbstractJob {
+
+	Q_OBJECT
+
+public:
+	JobReadMetadata(const QString &rSourceFile);
+	virtual ~JobReadMetadata() {}
+
+signals:
+	void Result(const Metadata &rMetadata, const QVariant &rIdentifier = QVariant());
+
+protected:
+	virtual Error Execute();
+
+private:
+	Q_DISABLE_COPY(JobReadMetadata);
+
+	const QString mSourceFile;
+};
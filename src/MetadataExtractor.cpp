@@ -690,18 +690,7 @@ Error MetadataExtractor::ReadTimedTextMetadata(Metadata &rMetadata, const QFileI
 	metadata.fileName = rSourceFile.fileName();
 	metadata.filePath = rSourceFile.filePath();
 
-	try {
-		XMLPlatformUtils::Initialize();
-	}
-	catch (const XMLException& toCatch) {
-		char* message = XMLString::transcode(toCatch.getMessage());
-		qDebug() << "Error during initialization! :\n" << message << "\n";
-		XMLString::release(&message);
-		error = (Error::Unknown);
-		error.AppendErrorDescription(XMLString::transcode(toCatch.getMessage()));
-		return error;
-	}
-
+	// Xerces is initialized once in main(), Initialize()/Terminate() aren't thread safe.
 	XercesDOMParser *parser = new XercesDOMParser();
 	ErrorHandler *errHandler = (ErrorHandler*) new HandlerBase();
 
@@ -837,7 +826,6 @@ Error MetadataExtractor::ReadTimedTextMetadata(Metadata &rMetadata, const QFileI
 	rMetadata = metadata;
     delete parser;
     delete errHandler;
-    XMLPlatformUtils::Terminate();
 	return error;
 }
 			/* -----Denis Manthey----- */
@@ -0,0 +1,160 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "TTMLImageCache.h"
+#include "AS_02.h"
+#include <QGlobalStatic>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QFileInfo>
+#include <QDebug>
+
+Q_GLOBAL_STATIC(TTMLImageCache, theTTMLImageCache)
+
+#define TTML_IMAGE_NOT_FOUND ":/ttml_bg_not_found.png"
+
+
+//! Decodes the bitmaps of one file for TTMLImageCache::Prefetch().
+class TTMLImagePrefetchTask : public QRunnable {
+
+public:
+	TTMLImagePrefetchTask(TTMLImageCache *pCache, const QString &rFilePath, const QList<QUuid> &rResourceIds) :
+		QRunnable(), mpCache(pCache), mFilePath(rFilePath), mResourceIds(rResourceIds) {}
+	void run() {
+		const QList<QImage> images = TTMLImageCache::Decode(mFilePath, mResourceIds);
+		for (int i = 0; i < mResourceIds.size(); i++) mpCache->Insert(TTMLImageKey(mFilePath, mResourceIds.at(i)), images.at(i));
+	}
+
+private:
+	TTMLImageCache *mpCache;
+	QString mFilePath;
+	QList<QUuid> mResourceIds;
+};
+
+
+TTMLImageCache::TTMLImageCache() :
+mMutex(), mImages((int)(default_max_bytes / 1024)), mScaledImages((int)(max_scaled_bytes / 1024)), mIdentities(), mPending() {
+
+}
+
+TTMLImageCache* TTMLImageCache::GetGlobalInstance() {
+
+	return theTTMLImageCache();
+}
+
+QImage TTMLImageCache::Get(const TTMLImageKey &rKey) {
+
+	if (rKey.IsNull()) return QImage();
+	{
+		QMutexLocker locker(&mMutex);
+		QImage *p_image = mImages.object(rKey);
+		if (p_image) return *p_image; // implicitly shared
+	}
+	const QImage image = Decode(rKey.filePath, QList<QUuid>() << rKey.resourceId).first();
+	Insert(rKey, image);
+	return image;
+}
+
+void TTMLImageCache::Prefetch(const QList<TTMLImageKey> &rKeys) {
+
+	QHash<QString, QList<QUuid> > missing; // file -> resources
+	{
+		QMutexLocker locker(&mMutex);
+		for (int i = 0; i < rKeys.size(); i++) {
+			const TTMLImageKey &r_key = rKeys.at(i);
+			if (r_key.IsNull() || mImages.contains(r_key) || mPending.contains(r_key)) continue;
+			mPending.insert(r_key);
+			missing[r_key.filePath].append(r_key.resourceId);
+		}
+	}
+	for (QHash<QString, QList<QUuid> >::const_iterator it = missing.constBegin(); it != missing.constEnd(); ++it) {
+		QThreadPool::globalInstance()->start(new TTMLImagePrefetchTask(this, it.key(), it.value()));
+	}
+}
+
+QImage TTMLImageCache::GetScaled(const QImage &rImage, const QSize &rSize) {
+
+	if (rImage.isNull() || rSize.isEmpty() || rImage.size() == rSize) return rImage;
+	const QPair<qint64, quint64> key(rImage.cacheKey(), ((quint64)rSize.width() << 32) | (quint32)rSize.height());
+	{
+		QMutexLocker locker(&mMutex);
+		QImage *p_scaled = mScaledImages.object(key);
+		if (p_scaled) return *p_scaled;
+	}
+	const QImage scaled = rImage.scaled(rSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	QMutexLocker locker(&mMutex);
+	mScaledImages.insert(key, new QImage(scaled), qMax(1, scaled.byteCount() / 1024));
+	return scaled;
+}
+
+void TTMLImageCache::Validate(const QString &rFilePath) {
+
+	const FileIdentity identity = FileIdentity::FromFile(QFileInfo(rFilePath));
+	QMutexLocker locker(&mMutex);
+	QHash<QString, FileIdentity>::iterator it = mIdentities.find(rFilePath);
+	if (it == mIdentities.end() || it.value() == identity) return;
+	const QList<TTMLImageKey> keys = mImages.keys();
+	for (int i = 0; i < keys.size(); i++) {
+		if (keys.at(i).filePath == rFilePath) mImages.remove(keys.at(i)); // scaled copies age out of mScaledImages
+	}
+	mIdentities.erase(it);
+}
+
+void TTMLImageCache::Clear() {
+
+	QMutexLocker locker(&mMutex);
+	mImages.clear();
+	mScaledImages.clear();
+	mIdentities.clear();
+}
+
+void TTMLImageCache::Insert(const TTMLImageKey &rKey, const QImage &rImage) {
+
+	const FileIdentity identity = FileIdentity::FromFile(QFileInfo(rKey.filePath));
+	QMutexLocker locker(&mMutex);
+	mPending.remove(rKey);
+	if (rImage.isNull()) return;
+	if (mIdentities.contains(rKey.filePath) == false) mIdentities.insert(rKey.filePath, identity);
+	mImages.insert(rKey, new QImage(rImage), qMax(1, rImage.byteCount() / 1024)); // Bitmaps exceeding the whole budget are dropped.
+}
+
+QList<QImage> TTMLImageCache::Decode(const QString &rFilePath, const QList<QUuid> &rResourceIds) {
+
+	QList<QImage> images;
+	if (rResourceIds.size() == 1 && rResourceIds.first().isNull()) { // PNG file of non-wrapped timed text
+		QImage image(rFilePath);
+		images.append(image.isNull() ? QImage(TTML_IMAGE_NOT_FOUND) : image);
+		return images;
+	}
+
+	AS_02::TimedText::MXFReader reader;
+	const bool is_open = ASDCP_SUCCESS(reader.OpenRead(rFilePath.toStdString()));
+	ASDCP::TimedText::FrameBuffer buffer;
+	buffer.Capacity(2 * Kumu::Megabyte);
+	for (int i = 0; i < rResourceIds.size(); i++) {
+		QImage image;
+		const QByteArray id_bytes = rResourceIds.at(i).toRfc4122();
+		if (is_open && ASDCP_SUCCESS(reader.ReadAncillaryResource(Kumu::UUID((const byte_t*)id_bytes.constData()), buffer))) {
+			image.loadFromData(buffer.RoData(), buffer.Size(), "png");
+		}
+		if (image.isNull()) {
+			qWarning() << "Couldn't decode ancillary resource" << rResourceIds.at(i) << "of" << rFilePath;
+			image = QImage(TTML_IMAGE_NOT_FOUND);
+		}
+		images.append(image);
+	}
+	return images;
+}
@@ -0,0 +1,81 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QtGlobal>
+#include <QUuid>
+#include <QImage>
+#include <QCache>
+#include <QMutex>
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QPair>
+#include "HashEngine.h"
+
+
+//! Identifies a subtitle bitmap: the file it's stored in and, for wrapped timed text, the id of its ancillary resource.
+struct TTMLImageKey {
+	TTMLImageKey() : filePath(), resourceId() {}
+	TTMLImageKey(const QString &rFilePath, const QUuid &rResourceId = QUuid()) : filePath(rFilePath), resourceId(rResourceId) {}
+	bool IsNull() const { return filePath.isEmpty(); }
+	bool operator==(const TTMLImageKey &rOther) const { return filePath == rOther.filePath && resourceId == rOther.resourceId; }
+	QString filePath; // Mxf track file if wrapped, PNG file otherwise
+	QUuid resourceId; // ancillary resource, null if not wrapped
+};
+
+inline uint qHash(const TTMLImageKey &rKey, uint seed = 0) {
+
+	return qHash(rKey.filePath, seed) ^ qHash(rKey.resourceId, seed);
+}
+
+
+/*! \brief
+Process wide LRU cache of the decoded subtitle bitmaps of image profile IMSC1 documents and of their copies scaled for the viewport.
+Bitmaps are decoded on demand (see TTMLImageCache::Get() and TTMLImageCache::Prefetch()), so only the cues around the playhead are ever decoded.
+Bitmaps of a file are dismissed as soon as its FileIdentity changes (see TTMLImageCache::Validate()). This class is thread safe.
+*/
+class TTMLImageCache {
+
+public:
+	static const qint64 default_max_bytes = 256ll * 1024 * 1024;
+	static const qint64 max_scaled_bytes = 64ll * 1024 * 1024;
+	//! Use TTMLImageCache::GetGlobalInstance().
+	TTMLImageCache();
+	static TTMLImageCache* GetGlobalInstance();
+	//! Returns the bitmap of rKey, decodes it on a cache miss. Returns a placeholder image if the bitmap couldn't be read.
+	QImage Get(const TTMLImageKey &rKey);
+	//! Decodes the bitmaps of rKeys which aren't cached yet on the global thread pool.
+	void Prefetch(const QList<TTMLImageKey> &rKeys);
+	//! Returns rImage scaled to rSize (smooth transformation). Scaled copies are cached per image and size.
+	QImage GetScaled(const QImage &rImage, const QSize &rSize);
+	//! Dismisses all bitmaps of rFilePath if the file was modified since they were decoded.
+	void Validate(const QString &rFilePath);
+	void Clear();
+
+private:
+	Q_DISABLE_COPY(TTMLImageCache);
+	friend class TTMLImagePrefetchTask;
+	//! Reads and decodes the bitmaps of rKeys (of one file). Mxf files are opened once.
+	static QList<QImage> Decode(const QString &rFilePath, const QList<QUuid> &rResourceIds);
+	void Insert(const TTMLImageKey &rKey, const QImage &rImage);
+
+	mutable QMutex mMutex;
+	QCache<TTMLImageKey, QImage> mImages; // cost: KiB
+	QCache<QPair<qint64, quint64>, QImage> mScaledImages; // (QImage::cacheKey(), width << 32 | height) -> scaled image, cost: KiB
+	QHash<QString, FileIdentity> mIdentities; // file -> identity when its bitmaps were decoded
+	QSet<TTMLImageKey> mPending; // queued for prefetching
+};
@@ -0,0 +1,192 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "TTMLIndex.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+
+namespace {
+
+bool interval_less(const TTMLIntervalTree::Interval &rLeft, const TTMLIntervalTree::Interval &rRight) {
+
+	return rLeft.begin < rRight.begin || (rLeft.begin == rRight.begin && rLeft.value < rRight.value);
+}
+
+//! Rounds like the timeline does: two decimals of the frame count, then up to the next frame.
+qint64 to_frames(float seconds, float editRate) {
+
+	return (qint64)ceil(qRound(seconds * editRate * 100.f) / 100.f);
+}
+
+}
+
+
+void TTMLIntervalTree::Build(const QVector<Interval> &rIntervals) {
+
+	mIntervals = rIntervals;
+	std::sort(mIntervals.begin(), mIntervals.end(), interval_less);
+	mMaxEnd = QVector<qint64>(mIntervals.size());
+	Build(0, mIntervals.size());
+}
+
+qint64 TTMLIntervalTree::Build(int lo, int hi) {
+
+	if (lo >= hi) return std::numeric_limits<qint64>::min();
+	const int mid = lo + (hi - lo) / 2;
+	mMaxEnd[mid] = qMax(mIntervals.at(mid).end, qMax(Build(lo, mid), Build(mid + 1, hi)));
+	return mMaxEnd.at(mid);
+}
+
+void TTMLIntervalTree::Stab(qint64 point, QVector<int> &rValues) const {
+
+	Stab(0, mIntervals.size(), point, rValues);
+}
+
+void TTMLIntervalTree::Stab(int lo, int hi, qint64 point, QVector<int> &rValues) const {
+
+	if (lo >= hi) return;
+	const int mid = lo + (hi - lo) / 2;
+	if (mMaxEnd.at(mid) <= point) return; // nothing in this subtree reaches point
+	Stab(lo, mid, point, rValues);
+	if (mIntervals.at(mid).begin > point) return; // the right subtree begins even later
+	if (mIntervals.at(mid).end > point) rValues.push_back(mIntervals.at(mid).value);
+	Stab(mid + 1, hi, point, rValues);
+}
+
+
+void TTMLIndex::Build(const QMap<int, QVector<TTMLtimelineResource> > &rTracks, float editRate) {
+
+	mTracks.clear();
+	for (QMap<int, QVector<TTMLtimelineResource> >::const_iterator it = rTracks.constBegin(); it != rTracks.constEnd(); ++it) {
+
+		Track track;
+		track.key = it.key();
+		QVector<TTMLIntervalTree::Interval> resource_intervals;
+		for (int i = 0; i < it.value().size(); i++) {
+
+			const TTMLtimelineResource &r_resource = it.value().at(i);
+			Resource resource;
+			resource.index = i;
+			resource.timelineIn = to_frames(r_resource.timeline_in, editRate);
+			resource.timelineOut = to_frames(r_resource.timeline_out, editRate);
+			resource.origin = qRound64(r_resource.timeline_in * editRate);
+			resource.period = qRound64((r_resource.out - r_resource.in) * editRate);
+			resource.documentIn = qRound64(r_resource.in * editRate);
+			resource.repeatCount = qMax(1, r_resource.RepeatCount);
+
+			QVector<TTMLIntervalTree::Interval> item_intervals;
+			for (int z = 0; z < r_resource.items.size(); z++) {
+				TTMLIntervalTree::Interval interval;
+				interval.begin = to_frames(r_resource.items.at(z).beg, editRate);
+				interval.end = to_frames(r_resource.items.at(z).end, editRate);
+				interval.value = z;
+				if (interval.end > interval.begin) item_intervals.push_back(interval);
+
+				// cues beginning before the in point or after the out point are never shown
+				const qint64 cue = interval.begin - resource.documentIn + resource.origin;
+				if (cue >= resource.origin && cue < resource.origin + resource.period) resource.cues.push_back(qMax<qint64>(0, cue));
+			}
+			resource.items.Build(item_intervals);
+			std::sort(resource.cues.begin(), resource.cues.end());
+
+			TTMLIntervalTree::Interval interval;
+			interval.begin = resource.timelineIn;
+			interval.end = resource.timelineOut;
+			interval.value = track.resourceList.size();
+			resource_intervals.push_back(interval);
+			track.resourceList.push_back(resource);
+		}
+		track.resources.Build(resource_intervals);
+		mTracks.push_back(track);
+	}
+}
+
+void TTMLIndex::GetVisible(qint64 frame, QVector<Visible> &rVisible) const {
+
+	for (int t = 0; t < mTracks.size(); t++) {
+
+		const Track &r_track = mTracks.at(t);
+		QVector<int> resources;
+		r_track.resources.Stab(frame, resources);
+		std::sort(resources.begin(), resources.end());
+		for (int i = 0; i < resources.size(); i++) {
+
+			const Resource &r_resource = r_track.resourceList.at(resources.at(i));
+			qint64 offset = qMax<qint64>(0, frame - r_resource.origin);
+			if (r_resource.period > 0) offset %= r_resource.period; // position within the current repetition
+
+			Visible visible;
+			visible.track = r_track.key;
+			visible.resource = r_resource.index;
+			visible.documentFrame = offset + r_resource.documentIn;
+			r_resource.items.Stab(visible.documentFrame, visible.items);
+			std::sort(visible.items.begin(), visible.items.end());
+			rVisible.push_back(visible);
+		}
+	}
+}
+
+bool TTMLIndex::GetNextCue(qint64 frame, qint64 &rCue) const {
+
+	bool found = false;
+	for (int t = 0; t < mTracks.size(); t++) {
+		for (int i = 0; i < mTracks.at(t).resourceList.size(); i++) {
+
+			const Resource &r_resource = mTracks.at(t).resourceList.at(i);
+			if (r_resource.cues.isEmpty() || r_resource.period <= 0) continue;
+			// the cue is in the repetition containing frame or in the following one
+			const qint64 first = qBound<qint64>(0, (frame - r_resource.origin) / r_resource.period, r_resource.repeatCount - 1);
+			for (qint64 repetition = first; repetition <= qMin<qint64>(first + 1, r_resource.repeatCount - 1); repetition++) {
+				const qint64 shift = repetition * r_resource.period;
+				QVector<qint64>::const_iterator it = std::upper_bound(r_resource.cues.constBegin(), r_resource.cues.constEnd(), frame - shift);
+				if (it == r_resource.cues.constEnd()) continue;
+				if (*it + shift < r_resource.timelineOut && (!found || *it + shift < rCue)) {
+					rCue = *it + shift;
+					found = true;
+				}
+				break;
+			}
+		}
+	}
+	return found;
+}
+
+bool TTMLIndex::GetPreviousCue(qint64 frame, qint64 &rCue) const {
+
+	bool found = false;
+	for (int t = 0; t < mTracks.size(); t++) {
+		for (int i = 0; i < mTracks.at(t).resourceList.size(); i++) {
+
+			const Resource &r_resource = mTracks.at(t).resourceList.at(i);
+			if (r_resource.cues.isEmpty() || r_resource.period <= 0 || frame <= r_resource.origin) continue;
+			// the cue is in the repetition containing frame or in the preceding one
+			const qint64 last = qMin<qint64>((frame - r_resource.origin) / r_resource.period, r_resource.repeatCount - 1);
+			for (qint64 repetition = last; repetition >= qMax<qint64>(0, last - 1); repetition--) {
+				const qint64 shift = repetition * r_resource.period;
+				QVector<qint64>::const_iterator it = std::lower_bound(r_resource.cues.constBegin(), r_resource.cues.constEnd(), frame - shift);
+				if (it == r_resource.cues.constBegin()) continue;
+				--it;
+				if (*it + shift < r_resource.timelineOut && (!found || *it + shift > rCue)) {
+					rCue = *it + shift;
+					found = true;
+				}
+				break;
+			}
+		}
+	}
+	return found;
+}
@@ -0,0 +1,94 @@
+/* Copyright(C) 2016 Björn Stresing, Denis Manthey, Wolfgang Ruppel, Krispin Weiss
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include "ImfCommon.h"
+#include <QtGlobal>
+#include <QVector>
+#include <QMap>
+
+
+/*! \brief
+Static interval tree over half-open intervals [begin, end). The intervals are stored sorted by begin, every node of the implicit balanced tree knows the largest end of its subtree.
+TTMLIntervalTree::Stab() reports the k intervals containing a point in O(log n + k).
+*/
+class TTMLIntervalTree {
+
+public:
+	struct Interval {
+		qint64 begin;
+		qint64 end;
+		int value;
+	};
+	TTMLIntervalTree() : mIntervals(), mMaxEnd() {}
+	void Build(const QVector<Interval> &rIntervals);
+	//! Appends the values of all intervals containing point (ordered by begin).
+	void Stab(qint64 point, QVector<int> &rValues) const;
+	//! Sorted by begin.
+	const QVector<Interval>& GetIntervals() const { return mIntervals; }
+
+private:
+	qint64 Build(int lo, int hi);
+	void Stab(int lo, int hi, qint64 point, QVector<int> &rValues) const;
+
+	QVector<Interval> mIntervals;
+	QVector<qint64> mMaxEnd; // largest end of the subtree rooted at the middle of [lo, hi)
+};
+
+
+/*! \brief
+Answers "which timed text elements are visible at frame F" and "which cue begins next to frame F" for the timed text tracks of a playlist.
+All times are precomputed in CPL edit units, repeated resources (RepeatCount) are resolved arithmetically instead of being expanded.
+The index must be rebuilt with TTMLIndex::Build() whenever the tracks change.
+*/
+class TTMLIndex {
+
+public:
+	struct Visible {
+		int track; // key of the track
+		int resource; // index of the resource within the track
+		qint64 documentFrame; // frame within the ttml document [CPL edit units]
+		QVector<int> items; // indices of the visible TTMLelem (document order)
+	};
+	TTMLIndex() : mTracks() {}
+	void Build(const QMap<int, QVector<TTMLtimelineResource> > &rTracks, float editRate);
+	void Clear() { mTracks.clear(); }
+	//! Appends the resources visible at frame (ordered by track and resource).
+	void GetVisible(qint64 frame, QVector<Visible> &rVisible) const;
+	//! Earliest cue beginning after frame. Returns false if there is none.
+	bool GetNextCue(qint64 frame, qint64 &rCue) const;
+	//! Latest cue beginning before frame. Returns false if there is none.
+	bool GetPreviousCue(qint64 frame, qint64 &rCue) const;
+
+private:
+	struct Resource {
+		int index; // within the track
+		qint64 timelineIn; // [CPL edit units]
+		qint64 timelineOut;
+		qint64 origin; // timeline frame of the resource in point
+		qint64 period; // duration of one repetition
+		qint64 documentIn; // document frame of the resource in point
+		int repeatCount;
+		TTMLIntervalTree items; // document frames
+		QVector<qint64> cues; // sorted timeline frames of the cues beginning in the first repetition
+	};
+	struct Track {
+		int key;
+		TTMLIntervalTree resources; // timeline frames, values index Track::resourceList
+		QVector<Resource> resourceList;
+	};
+
+	QVector<Track> mTracks;
+};
@@ -20,405 +20,551 @@
 #include <KM_fileio.h>
 #include <cmath>
 #include <QtCore>
-#include <xercesc/parsers/XercesDOMParser.hpp>
-#include <xercesc/dom/DOM.hpp>
-#include <xercesc/sax/HandlerBase.hpp>
+#include <xercesc/sax2/SAX2XMLReader.hpp>
+#include <xercesc/sax2/XMLReaderFactory.hpp>
+#include <xercesc/sax2/DefaultHandler.hpp>
+#include <xercesc/sax2/Attributes.hpp>
 #include <xercesc/util/XMLString.hpp>
+#include <xercesc/util/XMLUni.hpp>
 #include <xercesc/util/PlatformUtils.hpp>
-
-#include <xercesc/util/OutOfMemoryException.hpp>
-#include <xercesc/dom/DOMDocument.hpp>
-#include <xercesc/dom/DOMImplementation.hpp>
-#include <xercesc/dom/DOMImplementationRegistry.hpp>
-#include <xercesc/dom/DOMLSSerializer.hpp>
 #include <xercesc/framework/MemBufInputSource.hpp>
 
 using namespace xercesc;
 //#define DEBUG_TTML
 
 
-//!this class helps to convert char* to XMLString by using X(char*) instead of XMLString::transcode(char*).
-class XStr
-{
-public:
-	XStr(const char* const toTranscode) { 
-		fUnicodeForm = XMLString::transcode(toTranscode); 
-	}
-	~XStr() { XMLString::release(&fUnicodeForm); }
-	const XMLCh* unicodeForm() const { return fUnicodeForm; }
+namespace {
 
-private:
-	XMLCh*   fUnicodeForm;
-};
-#define X(str) XStr(str).unicodeForm()
+QString to_qstring(const XMLCh *pString, int length = -1) {
 
-elem::elem(xercesc::DOMNode *rNode, TTMLParser *rParser, elem *rParent) {
-
-	parser = rParser;
-	parent = rParent;
-	node = rNode;
-	el = dynamic_cast<DOMElement*>(rNode);
+	if (pString == NULL) return QString();
+	return QString::fromUtf16(reinterpret_cast<const ushort*>(pString), length);
 }
 
-bool elem::process() {
-
-	if (el) {
-		// check if irrelevant element -> ignore
-		if(!tt_tags.contains(XMLString::transcode(el->getTagName()))){
-			//dur = 2; remove?
-			stop = true;
-			return stop;
-		}
+typedef QVector<QPair<QString, QString> > AttributeList; // qualified name, value
 
-		// check for region attribute
-		GetRegion();
+AttributeList to_attribute_list(const Attributes &rAttributes) {
 
-		// check for timing
-		if (GetStartEndTimes()) {
-			is_timed = true;
-			stop = true;
-			processTimedElement();
-		}
-		else { // no timing attributes!
-			GetTimeContainer(); // check for timeContainer attribute
-			GetStyle();
-		}
+	AttributeList attributes;
+	attributes.reserve((int)rAttributes.getLength());
+	for (XMLSize_t i = 0; i < rAttributes.getLength(); i++) {
+		attributes.append(qMakePair(to_qstring(rAttributes.getQName(i)), to_qstring(rAttributes.getValue(i))));
 	}
-	return stop;
+	return attributes;
 }
 
-void elem::GetTimeContainer() {
+QString attribute_value(const AttributeList &rAttributes, const char *pName) {
 
-	// check if parent has timing -> pass on values if this is the case
-	if (parent && parent->is_timed) { 
-		is_timed = true;
-		timeContainer = parent->timeContainer;
+	for (int i = 0; i < rAttributes.size(); i++) {
+		if (rAttributes.at(i).first == QLatin1String(pName)) return rAttributes.at(i).second;
 	}
+	return QString();
+}
 
-	// check for timing attributes
-	QString timeContainerVal = XMLString::transcode(el->getAttribute(XMLString::transcode("timeContainer")));
-	if (timeContainerVal.length() > 0) { // found timeContainer!
+}
 
-		is_timed = true;
 
-		if (timeContainerVal == "seq") {
-			timeContainer = 2;
-		}
-		else if (timeContainerVal == "par") {
-			timeContainer = 1;
-		}
-	}
+/*! \brief
+SAX2 content handler of TTMLParser.
+Open div, p and span elements are kept on a stack of blocks carrying the inherited region, style and timing (par/seq, dur, consumed duration).
+Timed elements are serialized with their computed inline style while their children are read and become a TTMLCue when closed.
+*/
+class TTMLParser::SaxHandler : public DefaultHandler, TTMLFns {
 
-	// timing is either par or seq
-	if (is_timed) {
+public:
+	SaxHandler(TTMLParser &rParser);
+	void startElement(const XMLCh *const uri, const XMLCh *const localname, const XMLCh *const qname, const Attributes &attrs) override;
+	void endElement(const XMLCh *const uri, const XMLCh *const localname, const XMLCh *const qname) override;
+	void characters(const XMLCh *const chars, const XMLSize_t length) override;
 
-		QString durVal = XMLString::transcode(el->getAttribute(XMLString::transcode("dur")));
-		QString endVal = XMLString::transcode(el->getAttribute(XMLString::transcode("end")));
+private:
+	//! Untimed div, p or span element.
+	struct Block {
+		Block() : isTimed(false), timeContainer(0), dur(0), durUsed(0), durSet(false), hasBegEndDur(false), region(), css() {}
+		bool isTimed; // time container
+		int timeContainer; // 0 : unknown, 1 : par, 2 : seq
+		float dur;
+		float durUsed; // duration consumed by children
+		bool durSet;
+		bool hasBegEndDur;
+		QString region;
+		QMap<QString, QString> css;
+	};
+	void ReadMetadata(const AttributeList &rAttributes);
+	void AddStyle(const AttributeList &rAttributes);
+	void AddRegion(const AttributeList &rAttributes);
+	void ReadBody(const AttributeList &rAttributes);
+	void StartBlock(const QString &rQName, const AttributeList &rAttributes);
+	void EndBlock();
+	void StartTimedElement(const QString &rQName, const AttributeList &rAttributes, const Block &rBlock, Block *pParent, float beg, float end);
+	//! Writes the start tag of an element within a timed element.
+	void WriteStartTag(const QString &rQName, const AttributeList &rAttributes, const QMap<QString, QString> &rCss);
+	void CloseStartTag();
+	//! css attributes of the element > referenced style > rInherited.
+	QMap<QString, QString> ComputeCss(const AttributeList &rAttributes, const QMap<QString, QString> &rInherited);
+	QString ToPercent(const QString &rLength, int dimension) const;
+	qint32 InternStyle(const QMap<QString, QString> &rCss);
+	qint32 InternImage(const QString &rImage);
+
+	TTMLParser &mrParser;
+	TTMLCueList &mrCues;
+	QHash<QString, QMap<QString, QString> > mStyles; // xml:id -> css
+	QHash<QString, qint32> mRegionIndex; // xml:id -> index in TTMLCueList::regions
+	QHash<QString, qint32> mStyleIndex; // serialized css -> index in TTMLCueList::styles
+	QHash<QString, qint32> mImageIndex; // image name -> index in TTMLCueList::images
+	bool mInBody;
+	QString mBodyRegion;
+	QMap<QString, QString> mBodyCss;
+	QVector<Block> mBlocks;
+	float mSeqOffset; // total duration of untimed blocks in seq containers
+	int mSkipDepth; // > 0 : within an ignored element
+	int mTimedDepth; // > 0 : within a timed element
+	TTMLCue mCue; // cue of the open timed element
+	QString mText; // serialization of the open timed element
+	bool mIsStartTagOpen;
+	QVector<QMap<QString, QString> > mTimedCss; // css of the open elements within the timed element
+};
 
-		if (durVal.length() > 0) { // dur is set!
-			
-			dur = ConvertTimingQStringtoDouble(durVal, parser->framerate, parser->tickrate);
-			dur_set = true;
+TTMLParser::SaxHandler::SaxHandler(TTMLParser &rParser) :
+DefaultHandler(), TTMLFns(), mrParser(rParser), mrCues(rParser.mCues), mStyles(), mRegionIndex(), mStyleIndex(), mImageIndex(), mInBody(false), mBodyRegion(), mBodyCss(),
+mBlocks(), mSeqOffset(0), mSkipDepth(0), mTimedDepth(0), mCue(), mText(), mIsStartTagOpen(false), mTimedCss() {
 
-			if (parent && parent->dur_set) { // parent dur is set
-				if (parent->dur_used < parent->dur) { // there is at least some duration left
-					
-					if (dur >= (parent->dur - parent->dur_used)) {
-						dur = parent->dur - parent->dur_used; // use whatever is left over from parent dur
-					}
+	mBlocks.reserve(16);
+}
 
-					// check if parent is par or seq
-					if (parent->timeContainer == 2) { // seq
-						parent->dur_used += dur;
-					} // else: parent is par
+void TTMLParser::SaxHandler::startElement(const XMLCh *const uri, const XMLCh *const localname, const XMLCh *const qname, const Attributes &attrs) {
 
-				}
-				else {
-					stop = true; // discontinue processing children
-				}
-			}
-		}
-		else if (parent && parent->dur_set) {
-			dur_set = true;
-			dur = 0;
-		}
+	Q_UNUSED(uri);
+	if (mSkipDepth > 0) {
+		mSkipDepth++;
+		return;
+	}
+	if (mTimedDepth > 0) { // child of a timed element
+		const AttributeList attributes = to_attribute_list(attrs);
+		const QMap<QString, QString> css = ComputeCss(attributes, mTimedCss.last());
+		WriteStartTag(to_qstring(qname), attributes, css);
+		mTimedCss.append(css);
+		mTimedDepth++;
+		return;
+	}
 
-		if (endVal.length() > 0 && durVal.length() == 0) { // end is set -> use as dur!
-			// use end only if dur is undefined?
-			dur = ConvertTimingQStringtoDouble(endVal, parser->framerate, parser->tickrate);
-			dur_set = true;
+	const QString name = to_qstring(localname);
+	if (mInBody == false) {
+		if (name == "tt") ReadMetadata(to_attribute_list(attrs));
+		else if (name == "style") AddStyle(to_attribute_list(attrs));
+		else if (name == "region") AddRegion(to_attribute_list(attrs));
+		else if (name == "body") {
+			mInBody = true;
+			ReadBody(to_attribute_list(attrs));
 		}
+		return;
+	}
+
+	if (name != "div" && name != "p" && name != "span") { // irrelevant element -> ignore
+		mSkipDepth = 1;
+		return;
 	}
+	StartBlock(to_qstring(qname), to_attribute_list(attrs));
 }
 
-void elem::GetRegion() {
+void TTMLParser::SaxHandler::endElement(const XMLCh *const uri, const XMLCh *const localname, const XMLCh *const qname) {
 
-	if (parent && parent->regionName.length() > 0) { // parent element has region -> pass it on!
-		regionName = parent->regionName;
-#ifdef DEBUG_TTML
-		qDebug() << "parent region found:" << regionName;
-#endif
+	Q_UNUSED(uri);
+	Q_UNUSED(localname);
+	if (mSkipDepth > 0) {
+		mSkipDepth--;
+		return;
 	}
-	else { // check if current element has region
-		QString regVal = XMLString::transcode(el->getAttribute(XMLString::transcode("region")));
-		if (regVal.length() > 0) { // found region!
-#ifdef DEBUG_TTML
-			qDebug() << "region used" << regVal;
-#endif
-			regionName = regVal;
+	if (mTimedDepth > 0) {
+		if (mIsStartTagOpen == true) {
+			mText.append("/>");
+			mIsStartTagOpen = false;
 		}
-		else if(is_timed) {
-#ifdef DEBUG_TTML
-			qDebug() << "no region found";
-#endif
+		else {
+			mText.append("</").append(to_qstring(qname)).append('>');
 		}
+		mTimedCss.removeLast();
+		if (--mTimedDepth == 0) { // timed element closed
+			mCue.text = mrCues.texts.size();
+			mrCues.texts.append(mText);
+			mrCues.cues.append(mCue);
+			mText.clear();
+		}
+		return;
+	}
+	if (mInBody == false) return;
+	if (mBlocks.isEmpty()) { // </body>
+		mInBody = false;
+		return;
 	}
+	EndBlock();
 }
 
-void elem::GetStyle() {
+void TTMLParser::SaxHandler::characters(const XMLCh *const chars, const XMLSize_t length) {
 
-	// get style from parent
-	if (parent && parent->CSS.count() > 0) {
-		CSS = mergeCss(CSS, parent->CSS);
-	}
-
-	// look for style attribute
-	QString styleVal = XMLString::transcode(el->getAttribute(XMLString::transcode("style")));
-	if (!styleVal.isEmpty()) {
-		CSS = mergeCss(CSS, parser->styles[styleVal]);
-		el->removeAttribute(XMLString::transcode("style"));
-	}
+	if (mTimedDepth == 0 || mSkipDepth > 0) return;
+	CloseStartTag();
+	mText.append(to_qstring(chars, (int)length).toHtmlEscaped());
+}
 
-	// loop attributes
-	if (el->hasAttributes()) { // loop them
-		for (int z = 0; z < el->getAttributes()->getLength(); z++) {
+void TTMLParser::SaxHandler::StartBlock(const QString &rQName, const AttributeList &rAttributes) {
 
-			DOMAttr *attr = dynamic_cast<DOMAttr*>(el->getAttributes()->item(z));
+	Block block;
+	Block *p_parent = mBlocks.isEmpty() ? NULL : &mBlocks.last(); // NULL : child of <body>
 
-			QString name = XMLString::transcode(attr->getNodeName());
-			if (parser->cssAttr.contains(name)) { // known parameter!
-				CSS[parser->cssAttr[name]] = XMLString::transcode(attr->getNodeValue());
+	// region: parent element has region -> pass it on!
+	if (p_parent && p_parent->region.length() > 0) block.region = p_parent->region;
+	else {
+		const QString region = attribute_value(rAttributes, "region");
+		if (region.length() > 0) block.region = region;
+		else if (p_parent == NULL) block.region = mBodyRegion;
+	}
+
+	// timing
+	const QString time_container = attribute_value(rAttributes, "timeContainer");
+	const QString dur_string = attribute_value(rAttributes, "dur");
+	const QString end_string = attribute_value(rAttributes, "end");
+	if (time_container.isEmpty()) {
+		const QString beg_string = attribute_value(rAttributes, "begin");
+		const float end = end_string.isEmpty() ? 0 : ConvertTimingQStringtoDouble(end_string, mrParser.framerate, mrParser.tickrate);
+		const float beg = beg_string.isEmpty() ? 0 : ConvertTimingQStringtoDouble(beg_string, mrParser.framerate, mrParser.tickrate);
+		const float dur = dur_string.isEmpty() ? 0 : ConvertTimingQStringtoDouble(dur_string, mrParser.framerate, mrParser.tickrate);
+		block.dur = end_string.isEmpty() ? beg + dur : end;
+
+		if (dur_string.isEmpty() == false || (beg_string.isEmpty() == false && end_string.isEmpty() == false)) {
+			StartTimedElement(rQName, rAttributes, block, p_parent, beg, block.dur);
+			return;
+		}
+		else if (dur_string.isEmpty() == false || beg_string.isEmpty() == false || end_string.isEmpty() == false) { // invisible element
+			block.hasBegEndDur = true;
+			if (p_parent && p_parent->durSet) p_parent->durUsed += block.dur; // add current duration to total duration used in the block
+		}
+	}
+
+	// time container: pass on values of a timed parent
+	if (p_parent && p_parent->isTimed) {
+		block.isTimed = true;
+		block.timeContainer = p_parent->timeContainer;
+	}
+	if (time_container.isEmpty() == false) {
+		block.isTimed = true;
+		if (time_container == "seq") block.timeContainer = 2;
+		else if (time_container == "par") block.timeContainer = 1;
+	}
+	if (block.isTimed) {
+		if (dur_string.isEmpty() == false) {
+			block.dur = ConvertTimingQStringtoDouble(dur_string, mrParser.framerate, mrParser.tickrate);
+			block.durSet = true;
+			if (p_parent && p_parent->durSet) {
+				if (p_parent->durUsed >= p_parent->dur) { // parent duration exhausted -> discontinue processing children
+					mSkipDepth = 1;
+					return;
+				}
+				block.dur = qMin(block.dur, p_parent->dur - p_parent->durUsed); // use whatever is left over from parent dur
+				if (p_parent->timeContainer == 2) p_parent->durUsed += block.dur; // seq
 			}
 		}
+		else if (p_parent && p_parent->durSet) {
+			block.durSet = true;
+			block.dur = 0;
+		}
+		if (end_string.isEmpty() == false && dur_string.isEmpty() == true) { // end is set -> use as dur!
+			block.dur = ConvertTimingQStringtoDouble(end_string, mrParser.framerate, mrParser.tickrate);
+			block.durSet = true;
+		}
 	}
-}
 
-bool elem::processTimedElement() {
+	block.css = ComputeCss(rAttributes, p_parent ? p_parent->css : mBodyCss);
+	mBlocks.append(block);
+}
 
-	// is element between in- and -out point?
-	if(timing_end < parser->timeline_in || timing_begin > (parser->timeline_out)){
-		return false;
-	}
+void TTMLParser::SaxHandler::EndBlock() {
 
-	// was specified parent-block duration exeeded?
-	if (parent && parent->dur_set && (parent->dur_used + dur) > parent->dur) {
-		return false;
+	const Block block = mBlocks.takeLast();
+	if (mBlocks.isEmpty() == false && mBlocks.last().timeContainer == 2 && block.hasBegEndDur == false) {
+		mSeqOffset += block.dur; // add block duration (if sequential) to total offset
 	}
+}
 
-	// create new timed element
-	TTMLelem ttml_timed;
-	ttml_timed.beg = (timing_begin + parser->seq_timing_total_offset);
-	ttml_timed.end = (timing_end + parser->seq_timing_total_offset);
+void TTMLParser::SaxHandler::StartTimedElement(const QString &rQName, const AttributeList &rAttributes, const Block &rBlock, Block *pParent, float beg, float end) {
 
-	// add offset from parent (if available)
-	if (parent) { 
-		ttml_timed.beg += parent->dur_used;
-		ttml_timed.end += parent->dur_used;
+	// is element between in- and -out point? was specified parent-block duration exeeded?
+	if (end < mrParser.timeline_in || beg > mrParser.timeline_out || (pParent && pParent->durSet && (pParent->durUsed + rBlock.dur) > pParent->dur)) {
+		mSkipDepth = 1;
+		return;
 	}
 
-	if (regionName.length() > 0 && is_timed) { // region is defined -> resolve it!
+	const float offset = mSeqOffset + (pParent ? pParent->durUsed : 0);
+	mCue.beg = beg + offset;
+	mCue.end = end + offset;
+	mCue.region = mRegionIndex.value(rBlock.region, -1);
+	mCue.text = -1;
+	const QString image = attribute_value(rAttributes, "smpte:backgroundImage");
+	mCue.image = image.isEmpty() ? -1 : InternImage(image);
 
-		TTMLRegion new_region;
-		new_region = parser->regions[regionName]; // resolve region
-		ttml_timed.region = new_region;
-	}
+	// element > referenced style > parent > region > default
+	QMap<QString, QString> css = ComputeCss(rAttributes, pParent ? pParent->css : mBodyCss);
+	if (mCue.region >= 0) css = mergeCss(css, mrCues.regions.at(mCue.region).CSS);
+	if (css.contains("color") == false) css.insert("color", "white"); // default for text-profile
+	mCue.style = InternStyle(css);
 
-	QString image = XMLString::transcode(el->getAttribute(XMLString::transcode("smpte:backgroundImage")));
-	if (!image.isEmpty()) {
+	mText.clear();
+	mIsStartTagOpen = false;
+	WriteStartTag(rQName, rAttributes, css);
+	mTimedCss.append(css);
+	mTimedDepth = 1;
 
-		ttml_timed.type = 1; // set type : image
+	// add visible element duration to parent block duration if parent timing is seq
+	if (pParent && pParent->timeContainer == 2) pParent->durUsed += rBlock.dur;
+}
 
-		if (parser->is_wrapped) {
-			// create UUID from file name e.g. track5-frag0-sample1-subs4.png -> 0c209959-84e2-5a63-86ad-bd5406b068d1
-			Kumu::UUID id = AS_02::TimedText::CreatePNGNameId(image.toStdString());
-			if (!parser->anc_resources[id].isNull()) { // anc asset found!
-				ttml_timed.bgImage = parser->anc_resources[id];
-			}
-			else { // no anc asset found -> use default
-				ttml_timed.bgImage = QImage(":/ttml_bg_not_found.png"); // ERROR
-				ttml_timed.error = true; // set error flag
-			}
-		}
-		else {
-			// look for asset in base directory
-			QString dirCopyPath = QDir::currentPath();
-			QDir::setCurrent(parser->baseDir.absolutePath());
+void TTMLParser::SaxHandler::WriteStartTag(const QString &rQName, const AttributeList &rAttributes, const QMap<QString, QString> &rCss) {
 
-			ttml_timed.bgImage = QImage(image);
-			if (ttml_timed.bgImage.isNull()) {
-				ttml_timed.bgImage = QImage(":/ttml_bg_not_found.png");
-			}
-			QDir::setCurrent(dirCopyPath); // reset dir change
-		}
-	}
-	else {
-		ttml_timed.type = 0; // set type : text
+	CloseStartTag();
+	mText.append('<').append(rQName);
+	for (int i = 0; i < rAttributes.size(); i++) {
+		if (rAttributes.at(i).first == QLatin1String("style")) continue; // replaced by the computed style
+		mText.append(' ').append(rAttributes.at(i).first).append("=\"").append(rAttributes.at(i).second.toHtmlEscaped()).append('"');
 	}
+	if (rCss.isEmpty() == false) mText.append(" style=\"").append(serializeCss(rCss).toHtmlEscaped()).append('"');
+	mIsStartTagOpen = true;
+}
 
-	ttml_timed.text = serializeTT(processTimedElementStyle(el, true));
+void TTMLParser::SaxHandler::CloseStartTag() {
 
-	// set processed style map in timed struct
-	ttml_timed.CSS = CSS;
+	if (mIsStartTagOpen == false) return;
+	mText.append('>');
+	mIsStartTagOpen = false;
+}
 
-	// add timed item to list
-	parser->mThisResource->items.append(ttml_timed);
+QMap<QString, QString> TTMLParser::SaxHandler::ComputeCss(const AttributeList &rAttributes, const QMap<QString, QString> &rInherited) {
 
-	// add visible element duration to parent block duration if parent timing is seq
-	if (parent && parent->timeContainer == 2) {
-		parent->dur_used += dur;
+	QMap<QString, QString> css;
+	for (int i = 0; i < rAttributes.size(); i++) {
+		QMap<QString, QString>::const_iterator it = mrParser.cssAttr.constFind(rAttributes.at(i).first);
+		if (it != mrParser.cssAttr.constEnd()) css[it.value()] = rAttributes.at(i).second;
 	}
-
-	return true;
+	const QString style = attribute_value(rAttributes, "style");
+	if (style.isEmpty() == false) css = mergeCss(css, mStyles.value(style));
+	if (css.isEmpty()) return rInherited; // shared
+	return mergeCss(css, rInherited);
 }
 
-DOMElement* elem::processTimedElementStyle(DOMElement *rEl, bool HasTiming) {
-
-	// timed element: get styles from parent
-	if (HasTiming) {
-
-		// get style from region
-		if (regionName.length() > 0) {
-			CSS = mergeCss(CSS,parser->regions[regionName].CSS);
-		}
+void TTMLParser::SaxHandler::ReadMetadata(const AttributeList &rAttributes) {
 
-		// get style from parent
-		if (parent && parent->CSS.count() > 0) {
-			CSS = mergeCss(CSS, parent->CSS);
-		}
+	//Frame Rate Multiplier Extractor
+	const QString mult = attribute_value(rAttributes, "ttp:frameRateMultiplier");
+	float num = 1;
+	float den = 1;
+	if (!mult.isEmpty()) {
+		num = mult.section(" ", 0, 0).toInt();
+		den = mult.section(" ", 1, 1).toInt();
 	}
 
-	// look for style attribute
-	QString style = XMLString::transcode(rEl->getAttribute(XMLString::transcode("style")));
-	if (!style.isEmpty()) {
-		CSS = mergeCss(parser->styles[style], CSS);
-		rEl->removeAttribute(XMLString::transcode("style"));
+	//Frame Rate Extractor
+	int subFrameRate = 1;
+	const QString fr = attribute_value(rAttributes, "ttp:frameRate");
+	mrParser.framerate = 30 * (num / den);		//framerate is for calculating the duration, we need the fractal editrate!
+	if (!fr.isEmpty()) {
+		mrParser.framerate = fr.toFloat()*(num / den);
 	}
 
-	// loop attributes
-	if (rEl->hasAttributes()) { // loop them
-		for (int z = 0; z < rEl->getAttributes()->getLength(); z++) {
-
-			DOMAttr *attr = dynamic_cast<DOMAttr*>(rEl->getAttributes()->item(z));
+	//Tick Rate Extractor
+	mrParser.tickrate = 1; //TTML1 section 6.2.10
+	const QString tr = attribute_value(rAttributes, "ttp:tickRate");
+	if (!tr.isEmpty())
+		mrParser.tickrate = tr.toInt();
+	else if (!fr.isEmpty())  //TTML1 section 6.2.10
+		mrParser.tickrate = ceil(mrParser.framerate * subFrameRate);
 
-			QString name = XMLString::transcode(attr->getNodeName());
-			if (parser->cssAttr.contains(name)) { // known parameter!
-				CSS[parser->cssAttr[name]] = XMLString::transcode(attr->getNodeValue());
-			}
+	// get extent (e.g. tts:extent='854px 480px')
+	QString extentVal = attribute_value(rAttributes, "tts:extent");
+	if (extentVal.count("px") > 0) {
+		extentVal.replace("px", ""); // remove 'px'
+		QStringList values = extentVal.split(" ", QString::SkipEmptyParts);
+		if (values.size() >= 2) {
+			mrParser.extent[0] = values[0].toFloat();
+			mrParser.extent[1] = values[1].toFloat();
 		}
 	}
+}
 
-	if (CSS.count() > 0) { // set serialized CSS in timed element
-		rEl->setAttribute(XMLString::transcode("style"), XMLString::transcode(serializeCss(CSS).toStdString().c_str()));
-	}
+void TTMLParser::SaxHandler::AddStyle(const AttributeList &rAttributes) {
 
-	// loop children (if available...)
-	if (rEl->getChildNodes()) {
-		for (int i = 0; i < rEl->getChildNodes()->getLength(); i++) {
-			DOMElement* child = dynamic_cast<DOMElement*>(rEl->getChildNodes()->item(i)->cloneNode(true));
-			if (child) {
-				DOMNode *processed_child = dynamic_cast<DOMNode*>(processTimedElementStyle(child, false));
-				rEl->replaceChild(processed_child, rEl->getChildNodes()->item(i));
-			}
+	QString id;
+	QMap<QString, QString> css;
+	for (int i = 0; i < rAttributes.size(); i++) {
+		const QString &r_name = rAttributes.at(i).first;
+		if (r_name == "xml:id") {
+			id = rAttributes.at(i).second;
+		}
+		else if (r_name == "style") { // Chained Referential Styling
+			css = mergeCss(css, mStyles.value(rAttributes.at(i).second));
+		}
+		else if (mrParser.cssAttr.contains(r_name)) { // known parameter!
+			css[mrParser.cssAttr.value(r_name)] = rAttributes.at(i).second;
 		}
 	}
-
-	return rEl;
+	mStyles.insert(id, css); // e.g. ["white_8"] = "CSS"
 }
 
-bool elem::GetStartEndTimes() {
+QString TTMLParser::SaxHandler::ToPercent(const QString &rLength, int dimension) const {
 
-	float duration = 0, end = 0, beg = 0, current_dur = 0;
-	bool end_found = false, beg_found = false, dur_found = false;
+	QString value = rLength;
+	if (value.contains("%")) return value.remove("%"); // %
+	value.remove("px"); // px
+	if (mrParser.extent[dimension] <= 0) return value;
+	return QString::number((value.toFloat() / mrParser.extent[dimension]) * 100);
+}
 
-	if (!el) return false;
+void TTMLParser::SaxHandler::AddRegion(const AttributeList &rAttributes) {
 
-	QString tc_string = XMLString::transcode(el->getAttribute(XMLString::transcode("timeContainer")));
-	if (!tc_string.isEmpty()) {
-		return false; // abort!
-	}
+	TTMLRegion region = TTMLRegion();
+	region.id = attribute_value(rAttributes, "xml:id");
 
-	QString end_string = XMLString::transcode(el->getAttribute(XMLString::transcode("end")));
-	if (!end_string.isEmpty()) {
-		end = ConvertTimingQStringtoDouble(end_string, parser->framerate, parser->tickrate);
-		end_found = true;
+	// get origin e.g. tts:origin='12.88% 0.417%' and extent e.g. tts:extent='580px 200px'
+	const QStringList origin = attribute_value(rAttributes, "tts:origin").split(" ", QString::SkipEmptyParts);
+	if (origin.size() >= 2) {
+		region.origin[0] = ToPercent(origin.at(0), 0).toFloat();
+		region.origin[1] = ToPercent(origin.at(1), 1).toFloat();
 	}
+	const QStringList extent = attribute_value(rAttributes, "tts:extent").split(" ", QString::SkipEmptyParts);
+	if (extent.size() >= 2) {
+		region.extent[0] = ToPercent(extent.at(0), 0).toFloat();
+		region.extent[1] = ToPercent(extent.at(1), 1).toFloat();
+	}
+
+	// check when region is active
+	region.alwaysActive = attribute_value(rAttributes, "tts:showBackground") == "always";
+
+	region.CSS = ComputeCss(rAttributes, QMap<QString, QString>());
 
-	QString beg_string = XMLString::transcode(el->getAttribute(XMLString::transcode("begin")));
-	if (!beg_string.isEmpty()) {
-		beg = ConvertTimingQStringtoDouble(beg_string, parser->framerate, parser->tickrate);
-		beg_found = true;
+	// check if region has a backround-color
+	if (region.CSS.contains("background-color")) { // use it
+		region.bgColor.setNamedColor(region.CSS["background-color"]); // orange, #ff8000, #ff6 ...
+	}
+	else { // default region color
+		region.bgColor = QColor(120, 0, 244, 100); // default color
 	}
 
-	QString dur_string = XMLString::transcode(el->getAttribute(XMLString::transcode("dur")));
-	if (!dur_string.isEmpty()) {
-		current_dur = ConvertTimingQStringtoDouble(dur_string, parser->framerate, parser->tickrate);
-		dur_found = true;
+	// check if region has opacity
+	if (region.CSS.contains("opacity")) {
+		region.bgColor.setAlpha((int)(region.CSS["opacity"].toFloat() * 255)); // use it
+	}
+	else { // default opacity (50%)
+		region.bgColor.setAlpha(127);
 	}
 
-	if (end_string.isEmpty()) {
-		end = beg + current_dur;
+	QHash<QString, qint32>::const_iterator it = mRegionIndex.constFind(region.id);
+	if (it != mRegionIndex.constEnd()) {
+		mrCues.regions[it.value()] = region;
+	}
+	else {
+		mRegionIndex.insert(region.id, mrCues.regions.size());
+		mrCues.regions.append(region);
 	}
+#ifdef DEBUG_TTML
+	qDebug() << "created region" << region.id;
+#endif
+}
+
+void TTMLParser::SaxHandler::ReadBody(const AttributeList &rAttributes) {
 
-	dur = end;
+	mBodyCss = ComputeCss(rAttributes, QMap<QString, QString>());
+	mBodyRegion = attribute_value(rAttributes, "region");
+}
 
-	if (dur_found || (beg_found && end_found) || (beg_found && dur_found)) {
-		hasBegEndDur = true;
-		timing_begin = beg;
-		timing_end = end;
-		timing_dur = end - beg;
+qint32 TTMLParser::SaxHandler::InternStyle(const QMap<QString, QString> &rCss) {
 
-		return true;
-	}
-	else if(dur_found || beg_found || end_found){ // invisible element
-		hasBegEndDur = true;
-		// dur
-		if (parent && (parent->dur_set || parent->end_set)) {
-			parent->dur_used += end; // add current duration to total duration used in the block
+	const QString key = serializeCss(rCss);
+	QHash<QString, qint32>::const_iterator it = mStyleIndex.constFind(key);
+	if (it != mStyleIndex.constEnd()) return it.value();
+	const qint32 index = mrCues.styles.size();
+	mrCues.styles.append(rCss);
+	mStyleIndex.insert(key, index);
+	return index;
+}
+
+qint32 TTMLParser::SaxHandler::InternImage(const QString &rImage) {
+
+	QHash<QString, qint32>::const_iterator it = mImageIndex.constFind(rImage);
+	if (it != mImageIndex.constEnd()) return it.value();
+
+	TTMLCueList::Image image;
+	image.error = false;
+	if (mrParser.is_wrapped) {
+		// create UUID from file name e.g. track5-frag0-sample1-subs4.png -> 0c209959-84e2-5a63-86ad-bd5406b068d1
+		Kumu::UUID id = AS_02::TimedText::CreatePNGNameId(rImage.toStdString());
+		const QUuid resource_id = QUuid::fromRfc4122(QByteArray((const char*)id.Value(), 16));
+		if (mrParser.anc_resources.contains(resource_id)) {
+			image.key = TTMLImageKey(mrParser.SourceFilePath, resource_id);
+		}
+		else { // no anc asset found -> use default
+			image.key = TTMLImageKey(":/ttml_bg_not_found.png"); // ERROR
+			image.error = true; // set error flag
 		}
 	}
-
-	return false;
+	else { // look for asset in base directory
+		const QString file_path = mrParser.baseDir.absoluteFilePath(rImage);
+		image.key = TTMLImageKey(QFileInfo::exists(file_path) ? file_path : ":/ttml_bg_not_found.png");
+		TTMLImageCache::GetGlobalInstance()->Validate(image.key.filePath); // dismiss bitmap of a modified file
+	}
+	const qint32 index = mrCues.images.size();
+	mrCues.images.append(image);
+	mImageIndex.insert(rImage, index);
+	return index;
 }
 
-QString elem::serializeTT(DOMElement *rEl) {
 
-	DOMImplementation *implementation = DOMImplementationRegistry::getDOMImplementation(X("LS"));
-	DOMLSSerializer *serializer = ((DOMImplementationLS*)implementation)->createLSSerializer();
-	return QString(XMLString::transcode(serializer->writeToString(rEl)));
+// --------------------------------------------------------------------------------------------
+
+void TTMLCueList::ToItems(QVector<TTMLelem> &rItems) const {
+
+	rItems.reserve(rItems.size() + cues.size());
+	for (int i = 0; i < cues.size(); i++) {
+		const TTMLCue &r_cue = cues.at(i);
+		TTMLelem item;
+		item.type = r_cue.image >= 0 ? 1 : 0; // 0 : text, 1 : image
+		item.error = r_cue.image >= 0 ? images.at(r_cue.image).error : false;
+		if (r_cue.image >= 0) {
+			item.bgImageFile = images.at(r_cue.image).key.filePath;
+			item.bgImageId = images.at(r_cue.image).key.resourceId;
+		}
+		item.beg = r_cue.beg;
+		item.end = r_cue.end;
+		if (r_cue.text >= 0) item.text = texts.at(r_cue.text);
+		item.region = r_cue.region >= 0 ? regions.at(r_cue.region) : TTMLRegion();
+		item.CSS = styles.at(r_cue.style);
+		rItems.append(item);
+	}
 }
 
 
 // --------------------------------------------------------------------------------------------
 
-TTMLParser::TTMLParser() {}
+TTMLParser::TTMLParser() :
+mThisResource(NULL), mCues(), tickrate(1), framerate(30), is_wrapped(false), timeline_in(0), timeline_out(0), baseDir(), SourceFilePath(), reader(), anc_resources() {
+
+	extent[0] = 0;
+	extent[1] = 0;
+}
 
 Error TTMLParser::open(const QString &rSourceFile, TTMLtimelineResource &ttml_segment, bool rIsWrapped) {
 
 	Error error;
 	
 	mThisResource = &ttml_segment;
+	mCues = TTMLCueList();
 	timeline_in = ttml_segment.in;
 	timeline_out = ttml_segment.out;
 	is_wrapped = rIsWrapped;
 	baseDir = QFileInfo(rSourceFile).absoluteDir();
 	SourceFilePath = rSourceFile;
 
-	TimedText::FrameBuffer buff(2 * Kumu::Megabyte);
-	AS_02::TimedText::TimedTextDescriptor TDesc;
 	std::string XMLDoc;
 
 	if (is_wrapped) {
-		AS_02::Result_t result = reader.OpenRead(rSourceFile.toStdString()); // "D:/Master/Thesis/TTML/track5-frag2-sample1-subs0.mxf"
+		AS_02::Result_t result = reader.OpenRead(rSourceFile.toStdString());
 		if (ASDCP_SUCCESS(result)) {
 
 			result = reader.ReadTimedTextResource(XMLDoc); // read TTML XML
@@ -442,36 +588,17 @@ Error TTMLParser::open(const QString &rSourceFile, TTMLtimelineResource &ttml_se
 
 void TTMLParser::readAncilleryData() {
 
-	// get ancillary data
+	// get ids of the ancillary data, the resources are read and decoded on demand by TTMLImageCache
 	AS_02::TimedText::TimedTextDescriptor TDesc;
 	AS_02::Result_t result = reader.FillTimedTextDescriptor(TDesc);
-	TimedText::FrameBuffer buffer;
-	buffer.Capacity(2 * Kumu::Megabyte);
 	
 	if (ASDCP_SUCCESS(result)) {
 		AS_02::TimedText::ResourceList_t::const_iterator ri;
 
-		for (ri = TDesc.ResourceList.begin(); ri != TDesc.ResourceList.end() && ASDCP_SUCCESS(result); ri++) {
-
-			Kumu::UUID id;
-			id.Set((*ri).ResourceID);
-
-			result = reader.ReadAncillaryResource((*ri).ResourceID, buffer);
-
-			if (ASDCP_SUCCESS(result)) {
-#ifdef DEBUG_TTML
-				qDebug() << "successfully read anc data";
-#endif
-				QPixmap pix;
-				pix.loadFromData(buffer.RoData(), buffer.Size(), "png");
-				anc_resources[id] = pix.toImage();
-			}
-			else {
-#ifdef DEBUG_TTML
-				qDebug() << "error reading anc";
-#endif
-			}
+		for (ri = TDesc.ResourceList.begin(); ri != TDesc.ResourceList.end(); ri++) {
+			anc_resources.insert(QUuid::fromRfc4122(QByteArray((const char*)(*ri).ResourceID, 16)));
 		}
+		TTMLImageCache::GetGlobalInstance()->Validate(SourceFilePath); // dismiss bitmaps of a modified file
 	}
 	else {
 #ifdef DEBUG_TTML
@@ -480,318 +607,39 @@ void TTMLParser::readAncilleryData() {
 	}
 }
 
-void TTMLParser::parse(std::string xml) {
-
-	// SETUP XERCES
-	XercesDOMParser*   parser = NULL;
-	ErrorHandler*      errorHandler = NULL;
-
-	if (!parser)
-	{
-		XMLPlatformUtils::Initialize();
-		parser = new XercesDOMParser();
-	}
-	
-	if (is_wrapped) {
-		xercesc::MemBufInputSource memBuffInput((const XMLByte*)xml.c_str(), xml.size(), "dummy");
-		parser->parse(memBuffInput);
-	}
-	else {
-		try {
-			parser->parse(SourceFilePath.toLocal8Bit());
-		}
-		catch (...) {
-#ifdef DEBUG_TTML
-			qDebug() << "ERROR parsing" << SourceFilePath;
-#endif
-		}
-	}
-	
-	DOMDocument *dom_doc = parser->getDocument();															
-
-	// get metadata
-	getMetadata(dom_doc);
-
-	// set framerate & doc in TTMLtimelineSegment
-	mThisResource->frameRate = framerate;
-	mThisResource->doc = QString(xml.c_str());
-
-	// loop styles
-	DOMNodeList	*styleList = dom_doc->getElementsByTagName(XMLString::transcode("style"));
-	for (int i = 0; i < styleList->getLength(); i++) {
-		QPair<QString, QMap<QString, QString>> style = parseStyle(styleList->item(i));
-		styles[style.first] = style.second; // e.g. ["white_8"] = "CSS"
-#ifdef DEBUG_TTML
-		qDebug() << "created style" << style.first;
-#endif
-	}
-	
-	// loop regions
-	DOMNodeList	*regionList = dom_doc->getElementsByTagName(XMLString::transcode("region"));
-	for (int i = 0; i < regionList->getLength(); i++) {
-		TTMLRegion region = parseRegion(regionList->item(i));
-		regions[ region.id ] = region; // e.g. ["region1"] = TTMLRegion
-#ifdef DEBUG_TTML
-		qDebug() << "created region" << region.id;
-#endif
-	}
-
-	// check if body has styling information
-	DOMNode *body_node = dom_doc->getElementsByTagName(XMLString::transcode("body"))->item(0);
-	DOMElement *body_el = dynamic_cast<DOMElement*>(body_node);
-
-	QString body_region;
-	QMap<QString, QString> body_style;
-
-	if (body_node->hasAttributes()) {
-		for (int z = 0; z < body_node->getAttributes()->getLength(); z++) {
-
-			DOMAttr *attr = dynamic_cast<DOMAttr*>(body_node->getAttributes()->item(z));
-			QString name = XMLString::transcode(attr->getNodeName());
-			if (cssAttr.contains(name)) { // known parameter!
-				body_style[cssAttr[name]] = XMLString::transcode(attr->getNodeValue());
-			}
-		}
+void TTMLParser::parse(const std::string &rXml) {
 
-		// get style
-		QString styleVal = XMLString::transcode(body_el->getAttribute(XMLString::transcode("style")));
-		if (!styleVal.isEmpty()) { // found style
-			body_style = mergeCss(body_style, styles[styleVal]);
-		}
+	// Xerces is initialized in main()
+	SaxHandler handler(*this);
+	QScopedPointer<SAX2XMLReader> sax_reader(XMLReaderFactory::createXMLReader());
+	sax_reader->setFeature(XMLUni::fgSAX2CoreNameSpaces, true);
+	sax_reader->setFeature(XMLUni::fgXercesLoadExternalDTD, false);
+	sax_reader->setContentHandler(&handler);
+	sax_reader->setErrorHandler(&handler);
 
-		// get region
-		QString regVal = XMLString::transcode(body_el->getAttribute(XMLString::transcode("region")));
-		if (regVal.length() > 0) { // found region!
-			body_region = regVal;
-		}
-	}
-
-	// loop all children of <body>
-	DOMNodeList	*body = dom_doc->getElementsByTagName(XMLString::transcode("body"))->item(0)->getChildNodes();
-	for (int i = 0; i < body->getLength(); i++) {
-		
-		elem *newEl = new elem(body->item(i), this, NULL); // pass current parser & parent element
-		newEl->regionName = body_region;
-		newEl->CSS = body_style;
-
-		if (newEl->process() == false) { // continue processing children
-			elems.append(newEl);
-			RloopElements(newEl);
+	try {
+		if (is_wrapped) {
+			MemBufInputSource memBuffInput((const XMLByte*)rXml.c_str(), rXml.size(), "dummy");
+			sax_reader->parse(memBuffInput);
 		}
 		else {
-			delete newEl; // delete instance
+			sax_reader->parse(SourceFilePath.toLocal8Bit().constData());
 		}
 	}
-
+	catch (...) { // the cues read so far are kept
 #ifdef DEBUG_TTML
-	print2Console(mThisResource->items);
+		qDebug() << "ERROR parsing" << SourceFilePath;
 #endif
-
-	parser->~XercesDOMParser(); // delete DOM parser
-}
-
-TTMLRegion TTMLParser::parseRegion(DOMNode *node) {
-
-	TTMLRegion region;
-
-	DOMElement *el = dynamic_cast<DOMElement*>(node);
-
-	// get id
-	QString idVal = XMLString::transcode(el->getAttribute(XMLString::transcode("xml:id")));
-	if (!idVal.isEmpty()) { // found id
-		region.id = idVal;
-		el->removeAttribute(XMLString::transcode("xml:id"));
-	}
-
-	// get style
-	QString styleVal = XMLString::transcode(el->getAttribute(XMLString::transcode("style")));
-	if (!styleVal.isEmpty()) { // found style
-		region.CSS = mergeCss(region.CSS,styles[styleVal]);
-		el->removeAttribute(XMLString::transcode("style"));
 	}
 
-	// get origin e.g. tts:origin='12.88% 0.417%'
-	QString originVal = XMLString::transcode(el->getAttribute(XMLString::transcode("tts:origin")));
-	if (!originVal.isEmpty()) { // found origin
-		if (originVal.count("%") > 0) { // %
-			originVal.replace("%", ""); // remove '%'
-			QStringList values = originVal.split(" ");
-			region.origin[0] = values[0].toFloat();
-			region.origin[1] = values[1].toFloat();
-		}
-		else { // px
-			originVal.replace("px", ""); // remove 'px'
-			QStringList values = originVal.split(" ");
-			region.origin[0] = (values[0].toFloat() / extent[0]) * 100;
-			region.origin[1] = (values[1].toFloat() / extent[1]) * 100;
-		}
-		el->removeAttribute(XMLString::transcode("tts:origin")); // remove attr
-	}
-
-	// get extent e.g. tts:extent='580px 200px'
-	QString extentVal = XMLString::transcode(el->getAttribute(XMLString::transcode("tts:extent")));
-	if (!extentVal.isEmpty()) { // found extent
-		if (extentVal.count("%") > 0) { // %
-			extentVal.replace("%", ""); // remove '%'
-			QStringList values = extentVal.split(" ");
-			region.extent[0] = values[0].toFloat();
-			region.extent[1] = values[1].toFloat();
-		}
-		else { // px
-			extentVal.replace("px", ""); // remove 'px'
-			QStringList values = extentVal.split(" ");
-			region.extent[0] = (values[0].toFloat() / extent[0]) * 100;
-			region.extent[1] = (values[1].toFloat() / extent[1]) * 100;
-		}
-		el->removeAttribute(XMLString::transcode("tts:extent")); // remove attr
-	}
-
-	// check when region is active
-	QString showVal = XMLString::transcode(el->getAttribute(XMLString::transcode("tts:showBackground")));
-	if (!showVal.isEmpty()) { // found showBackground
-		if (showVal == "always") {
-			region.alwaysActive = true;
-		}
-		else {
-			region.alwaysActive = false;
-		}
-		el->removeAttribute(XMLString::transcode("tts:showBackground")); // remove attr
-	}
-
-	// loop remaining attributes
-	if (el->hasAttributes()) { // loop them
-		for (int z = 0; z < el->getAttributes()->getLength(); z++) {
-
-			DOMAttr *attr = dynamic_cast<DOMAttr*>(el->getAttributes()->item(z));
-
-			QString name = XMLString::transcode(attr->getNodeName());
-			if (cssAttr.contains(name)) { // known parameter!
-				region.CSS[cssAttr[name]] = XMLString::transcode(attr->getNodeValue());
-			} // else : not supported parameter
-		}
-	}
-
-	// check if region has a backround-color
-	if (region.CSS.contains("background-color")) { // use it
-		region.bgColor.setNamedColor(region.CSS["background-color"]); // orange, #ff8000, #ff6 ...
-	}
-	else { // default region color
-		region.bgColor = QColor(120, 0, 244, 100); // default color
-	}
-
-	// check if region has opacity
-	if (region.CSS.contains("opacity")) {
-		region.bgColor.setAlpha((int)(region.CSS["opacity"].toFloat() * 255)); // use it
-	}
-	else { // default opacity (50%)
-		region.bgColor.setAlpha(127);
-	}
-
-	return region;
-}
-
-
-QPair<QString, QMap<QString, QString>> TTMLParser::parseStyle(DOMNode *el) {
-
-	QPair<QString, QMap<QString, QString>> result;
-	
-	// get attributes
-	if (el->hasAttributes()) { // loop them
-		for (int z = 0; z < el->getAttributes()->getLength(); z++) {
-
-			DOMNode *attr = el->getAttributes()->item(z);
-
-			QString name = XMLString::transcode(attr->getNodeName());
-			if (name == "xml:id") {
-				result.first = XMLString::transcode(attr->getNodeValue()); // ID
-			}else if(name == "style"){ // Chained Referential Styling
-				result.second = mergeCss(result.second, styles[XMLString::transcode(attr->getNodeValue())]);
-			}else if (cssAttr.contains(name)) { // known parameter!
-				result.second[cssAttr[name]] = XMLString::transcode(attr->getNodeValue());
-			}
-		}
-	}
-
-	return result;
-}
-
-void TTMLParser::RloopElements(elem *el) {
-
-
-	if (el->node) {
-
-		DOMNodeList *children = el->node->getChildNodes();
-
-		// recursively loop children
-		for (int z = 0; z < children->getLength(); z++) {
-
-			elem *newEl = new elem(children->item(z), this, el); // pass current parser & parent element
-			if (newEl->process() == false) { // continue one step deeper
-				elems.append(newEl);
-				RloopElements(newEl);
-
-				if (newEl->parent->timeContainer == 2 && newEl->hasBegEndDur == false) {
-					seq_timing_total_offset += newEl->dur; // add block duration (if sequential) to total offset
-				}
-			}
-			else {
-				delete newEl; // destroy elem instance
-			}
-		}
-	}
-}
-
-// Code by Denis Manthey
-void TTMLParser::getMetadata(DOMDocument *rDom) {
+	// set framerate & doc in TTMLtimelineSegment
+	mThisResource->frameRate = framerate;
+	mThisResource->doc = QString::fromUtf8(rXml.c_str(), (int)rXml.size());
+	mCues.ToItems(mThisResource->items);
 
-	DOMNodeList *ttitem = rDom->getElementsByTagName(XMLString::transcode("tt"));
-	//Check if <tt> is present
-	if (ttitem->getLength() == 0) {
 #ifdef DEBUG_TTML
-		qDebug() << "ERROR - no tt element found!";
+	print2Console(mThisResource->items);
 #endif
-		return;
-	}
-	//write <tt> from DOMNodelist to DOMElement
-	DOMElement* tteleDom = dynamic_cast<DOMElement*>(ttitem->item(0));
-
-	//Frame Rate Multiplier Extractor
-	QString mult = XMLString::transcode(tteleDom->getAttribute(XMLString::transcode("ttp:frameRateMultiplier")));
-	float num = 1;
-	float den = 1;
-	if (!mult.isEmpty()) {
-		num = mult.section(" ", 0, 0).toInt();
-		den = mult.section(" ", 1, 1).toInt();
-	}
-
-	//Frame Rate Extractor
-	int subFrameRate = 1;
-	QString fr = XMLString::transcode(tteleDom->getAttribute(XMLString::transcode("ttp:frameRate")));
-	int editrate = 30;					//editrate is for the metadata object (expects editrate*numerator, denominator)
-	framerate = 30 * (num / den);		//framerate is for calculating the duration, we need the fractal editrate!
-	if (!fr.isEmpty()) {
-		framerate = fr.toFloat()*(num / den);
-		editrate = fr.toInt();
-	}
-
-	//Tick Rate Extractor
-	tickrate = 1; //TTML1 section 6.2.10
-	QString tr = XMLString::transcode(tteleDom->getAttribute(XMLString::transcode("ttp:tickRate")));
-	if (!tr.isEmpty())
-		tickrate = tr.toInt();
-	else if (!fr.isEmpty())  //TTML1 section 6.2.10
-		tickrate = ceil(framerate * subFrameRate);
-
-	// get extent (e.g. tts:extent='854px 480px')
-	QString extentVal = XMLString::transcode(tteleDom->getAttribute(XMLString::transcode("tts:extent")));
-	if (!extentVal.isEmpty()) {
-		if (extentVal.count("px") > 0) {
-			extentVal.replace("px", ""); // remove 'px'
-			QStringList values = extentVal.split(" ");
-			extent[0] = values[0].toFloat();
-			extent[1] = values[1].toFloat();
-		}
-	}
 }
 
 
@@ -805,7 +653,7 @@ void TTMLParser::print2Console(const QVector<TTMLelem> &ttmls) {
 			qDebug() << ttmls[i].beg << " -> " << ttmls[i].end << "TEXT:" << ttmls[i].text;
 		}
 		else if(ttmls[i].type == 1){ // image
-			qDebug() << ttmls[i].beg << " -> " << ttmls[i].end << "IMAGE:" << ttmls[i].bgImage.byteCount();
+			qDebug() << ttmls[i].beg << " -> " << ttmls[i].end << "IMAGE:" << ttmls[i].bgImageFile << ttmls[i].bgImageId;
 		}
 		else { // unknown
 			qDebug() << "ERROR: unknown type";
@@ -18,11 +18,10 @@
 #include "ImfPackageCommon.h"
 #include <QDebug>
 #include <QVector>
+#include <QHash>
 #include "Error.h"
-
-class TTMLParser;
-class elem;
-class TTMLFns;
+#include "TTMLImageCache.h"
+#include <QSet>
 
 class TTMLFns {
 
@@ -32,35 +31,75 @@ protected:
 	QString serializeCss(QMap<QString, QString>);
 };
 
+//! Timed element of a TTML document. Region, style, text and image are indices into the tables of the TTMLCueList.
+struct TTMLCue {
+	float beg; // (sec. rel. to document)
+	float end; // (sec. rel. to document)
+	qint32 region; // -1 : no region
+	qint32 style; // computed style
+	qint32 text; // element serialized with its computed inline style
+	qint32 image; // -1 : text element
+};
+
+/*! \brief
+Flat list of the timed elements of a TTML document as produced by TTMLParser.
+Regions, computed styles and images are interned: all cues referring to the same region, style or background image share one table entry.
+*/
+struct TTMLCueList {
+	struct Image {
+		TTMLImageKey key; // decoded on demand by TTMLImageCache
+		bool error; // image not found
+	};
+	QVector<TTMLCue> cues;
+	QVector<TTMLRegion> regions;
+	QVector<QMap<QString, QString> > styles;
+	QVector<QString> texts;
+	QVector<Image> images;
+	//! Appends a TTMLelem for every cue. Regions and styles are implicitly shared between the items, background images are left to be decoded by TTMLImageCache.
+	void ToItems(QVector<TTMLelem> &rItems) const;
+};
+
+/*! \brief
+Streaming (SAX2) parser for TTML and IMSC1 documents. The document is never built as a DOM.
+Styles and regions are resolved into interned tables while reading, every timed element becomes a TTMLCue.
+*/
 class TTMLParser : TTMLFns {
 
 public:
 	TTMLParser();
-	~TTMLParser() {
-		for (int i = 0; i < elems.length(); i++) {
-			elems.remove(i);
-		}
-	};
-
-	QVector<elem*> elems;
+	~TTMLParser() {}
+	//! Appends the timed elements of rSourceFile within in- and out-point of ttml_segment to ttml_segment.items.
 	Error open(const QString &rSourceFile, TTMLtimelineResource &ttml_segment, bool rIsWrapped);
-	void parse(std::string xml);
-	QPair<QString, QMap<QString, QString>> parseStyle(xercesc::DOMNode *node);
+	//! Cues of the document opened last.
+	const TTMLCueList& GetCues() const { return mCues; }
+
+private:
+	Q_DISABLE_COPY(TTMLParser);
+	class SaxHandler;
+
+	void parse(const std::string &rXml);
+	void readAncilleryData();
+	void print2Console(const QVector<TTMLelem> &ttmls);
 
 	TTMLtimelineResource *mThisResource; // current timeline resource
+	TTMLCueList mCues;
 
-	float seq_timing_total_offset = 0;
 	int tickrate;
 	float framerate;
 	bool is_wrapped; // wrapped in .mxf or not?
 	float timeline_in; // in-point on timeline
 	float timeline_out; // out-point on timeline;
 	QDir baseDir; // dir where anc data is stored (relevant for non-wrapped .ttml)
+	QString SourceFilePath;
+
+	// ttml reader
+	AS_02::TimedText::MXFReader reader;
+
+	// metadata
+	float extent[2];
 
 	// resources
-	QMap<Kumu::UUID, QImage> anc_resources;
-	QMap<QString, QMap<QString, QString>> styles;
-	QMap<QString, TTMLRegion> regions;
+	QSet<QUuid> anc_resources; // ids of the ancillary resources
 	QMap<QString, QString> cssAttr{
 		{ "tts:backgroundColor" , "background-color" },
 		{ "tts:content" , "content" },
@@ -77,74 +116,4 @@ public:
 		{ "tts:unicodeBidi" , "unicode-bidi" },
 		{ "tts:opacity" , "opacity" }
 	}; // all supported css values
-
-	TTMLRegion nullregion;
-
-private:
-
-	void getMetadata(xercesc::DOMDocument *rDiv);
-	void readAncilleryData();
-	void RloopElements(elem *el);
-
-	QVector<QColor> region_colors;
-	QString SourceFilePath;
-
-	// ttml reader
-	AS_02::TimedText::MXFReader reader;
-
-	// metadata
-	float extent[2];
-
-	TTMLRegion parseRegion(xercesc::DOMNode *el);
-	void print2Console(const QVector<TTMLelem> &ttmls);
-};
-
-
-class elem : public TTMLFns {
-public:
-	elem(xercesc::DOMNode *rNode, TTMLParser *parser, elem *rParent);
-
-	bool process();
-
-	TTMLParser *parser;
-	elem *parent;
-	bool stop = false; // discontinue processing children
-
-	// time Container
-	int timeContainer = 0; // 0 : unknown, 1 : par, 2 : seq
-	bool is_timed = false; // has timing attributes?
-
-	float end = 0;
-	bool end_set = false;
-
-	float dur = 0;
-	float dur_used = 0;
-	bool dur_set = false;
-	bool hasBegEndDur = false;
-
-	// timing
-	float timing_begin = 0;
-	float timing_end = 0;
-	float timing_dur = 0; // amount of time the element is visible
-
-	// region
-	QString regionName;
-	QMap<QString, QString> CSS {
-		{ "color" , "white" } // default for text-profile
-	};
-
-	QList<QString> tt_tags {"div", "p", "span"};
-
-	xercesc::DOMElement *el;
-	xercesc::DOMNode *node;
-
-private:
-
-	QString serializeTT(xercesc::DOMElement *rEl);
-	bool GetStartEndTimes();
-	void GetTimeContainer();
-	void GetRegion();
-	void GetStyle();
-	bool processTimedElement();
-	xercesc::DOMElement* processTimedElementStyle(xercesc::DOMElement *rEl, bool HasTiming);
 };
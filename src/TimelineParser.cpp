@@ -4,9 +4,95 @@
 #include "GraphicsWidgetSegment.h"
 #include "GraphicsWidgetSequence.h"
 #include "GraphicsWidgetResources.h"
+#include <limits>
+
+const TimelineParser::ParsedDocument* TimelineParser::GetParsedDocument(const QSharedPointer<AssetMxfTrack> &rAsset) {
+
+	if (!rAsset) return NULL; // asset deleted?
+
+	// is asset alread wrapped in mxf?
+	const bool is_wrapped = !rAsset->HasSourceFiles();
+	const QStringList files = is_wrapped ? QStringList(rAsset->GetPath().absoluteFilePath()) : rAsset->GetSourceFiles();
+	QVector<FileIdentity> identities;
+	for (int z = 0; z < files.length(); z++) identities.push_back(FileIdentity::FromFile(QFileInfo(files.at(z))));
+
+	QHash<QUuid, ParsedDocument>::iterator it = mParsedDocuments.find(rAsset->GetId());
+	const bool known = it != mParsedDocuments.end();
+	if (known && it->files == files && it->identities == identities) {
+		it->lastUsedRun = mRun;
+		return &it.value();
+	}
+
+	// parse the whole document, in- and out-point are applied in MapResource()
+	TTMLtimelineResource document;
+	document.in = -std::numeric_limits<float>::max();
+	document.out = std::numeric_limits<float>::max();
+	document.frameRate = 0;
+	bool success = false;
+	for (int z = 0; z < files.length(); z++) {
+		TTMLParser parser;
+		if (parser.open(files.at(z), document, is_wrapped).IsError() == false) success = true;
+	}
+	if (success == false) {
+		if (known) mParsedDocuments.erase(it);
+		return NULL;
+	}
+
+	ParsedDocument &r_parsed = mParsedDocuments[rAsset->GetId()];
+	r_parsed.files = files;
+	r_parsed.identities = identities;
+	r_parsed.frameRate = document.frameRate;
+	r_parsed.doc = document.doc;
+	r_parsed.items = document.items;
+	r_parsed.generation = (known ? r_parsed.generation : 0) + 1;
+	r_parsed.lastUsedRun = mRun;
+	return &r_parsed;
+}
+
+void TimelineParser::MapResource(const QUuid &rResourceId, const QSharedPointer<AssetMxfTrack> &rAsset, TTMLtimelineResource &rResource) {
+
+	const ParsedDocument *p_parsed = GetParsedDocument(rAsset);
+	if (p_parsed == NULL) {
+		mMappedResources.remove(rResourceId);
+		return;
+	}
+	rResource.frameRate = p_parsed->frameRate;
+	rResource.doc = p_parsed->doc;
+
+	MappedResource &r_mapped = mMappedResources[rResourceId];
+	r_mapped.lastUsedRun = mRun;
+	if (r_mapped.assetId != rAsset->GetId() || r_mapped.in != rResource.in || r_mapped.out != rResource.out || r_mapped.generation != p_parsed->generation) {
+		// is element between in- and -out point?
+		r_mapped.items.clear();
+		for (int i = 0; i < p_parsed->items.length(); i++) {
+			const TTMLelem &r_item = p_parsed->items.at(i);
+			if (r_item.end < rResource.in || r_item.beg > rResource.out) continue;
+			r_mapped.items.append(r_item);
+		}
+		r_mapped.assetId = rAsset->GetId();
+		r_mapped.in = rResource.in;
+		r_mapped.out = rResource.out;
+		r_mapped.generation = p_parsed->generation;
+	}
+	rResource.items = r_mapped.items; // implicitly shared
+}
+
+void TimelineParser::PruneCaches() {
+
+	for (QHash<QUuid, MappedResource>::iterator it = mMappedResources.begin(); it != mMappedResources.end();) {
+		if (it->lastUsedRun != mRun) it = mMappedResources.erase(it);
+		else ++it;
+	}
+	if (mParsedDocuments.size() <= max_cached_documents) return; // keep documents of other compositions
+	for (QHash<QUuid, ParsedDocument>::iterator it = mParsedDocuments.begin(); it != mParsedDocuments.end();) {
+		if (it->lastUsedRun != mRun) it = mParsedDocuments.erase(it);
+		else ++it;
+	}
+}
 
 void TimelineParser::run() {
 
+	mRun++;
 	int last_track = 0;
 	int track_index = 0;
 	int video_timeline_index = 0;
@@ -55,8 +141,6 @@ void TimelineParser::run() {
 							// TTML resource found
 							GraphicsWidgetTimedTextResource *timelineWidget = dynamic_cast<GraphicsWidgetTimedTextResource*>(p_resource);
 
-							TTMLParser *parser = new TTMLParser();
-
 							// check for new track
 							if (ii != last_track && i == 0) {
 								track_index++;
@@ -89,21 +173,8 @@ void TimelineParser::run() {
 								resource.timeline_out = resource.out - resource.in;
 							}
 							
-							// is asset alread wrapped in mxf?
-							if (p_resource->GetAsset() && p_resource->GetAsset()->HasSourceFiles()) { // no
-								// loop source files
-								for (int z = 0; z < p_resource->GetAsset()->GetSourceFiles().length(); z++) {
-									if (p_resource->InOutChanged) {
-										parser->open(p_resource->GetAsset()->GetSourceFiles().at(z), resource, false);
-									}
-								}
-							}
-							else if (p_resource->GetAsset() && p_resource->InOutChanged) { // yes
-								parser->open(p_resource->GetAsset()->GetPath().absoluteFilePath(), resource, true);
-							}
-							else { // ?
-								// asset deleted?
-							}
+							// documents are only parsed again if their files changed, items are only trimmed again if in- or out-point changed
+							MapResource(p_resource->GetId(), p_resource->GetAsset(), resource);
 
 							if (resource.RepeatCount > 1) {
 								resource.timeline_out += ((resource.out - resource.in) * (resource.RepeatCount - 1)); // update out-point
@@ -113,8 +184,6 @@ void TimelineParser::run() {
 							<< "resource.out" << resource.out << "resource.timeline_out" << resource.timeline_out;
 #endif
 
-							parser->~TTMLParser();
-		
 							ttmls->append(resource);
 
 							last_track = ii;
@@ -125,6 +194,8 @@ void TimelineParser::run() {
 		}
 	}
 
+	PruneCaches();
+
 	emit PlaylistFinished();
 	this->thread()->quit();
 }
@@ -5,11 +5,20 @@
 #include "ImfPackage.h"
 #include <QVector>
 #include "TTMLParser.h" 
+#include "HashEngine.h"
+#include <QHash>
+#include <QUuid>
 
+/*! \brief
+Builds the video playlist and the timed text resources of a composition.
+Parsed TTML documents are cached by asset id and the FileIdentity of their files, the trimmed items of every timed text resource are cached by resource id.
+A run only parses documents whose files changed and only maps resources whose asset, in- or out-point changed.
+*/
 class TimelineParser : public QObject {
 	Q_OBJECT
 public:
-	TimelineParser() {};
+	static const int max_cached_documents = 256; // documents not used by the last run are dropped beyond this
+	TimelineParser() : mParsedDocuments(), mMappedResources(), mRun(0) {};
 	~TimelineParser() {};
 
 	GraphicsWidgetComposition *composition;
@@ -20,4 +29,34 @@ public slots:
 	void run();
 signals:
 	void PlaylistFinished();
+
+private:
+	//! A TTML document parsed without in- and out-point.
+	struct ParsedDocument {
+		QStringList files;
+		QVector<FileIdentity> identities;
+		float frameRate;
+		QString doc;
+		QVector<TTMLelem> items;
+		int generation; // changes whenever the document is parsed again
+		int lastUsedRun;
+	};
+	//! Items of a timed text resource within its in- and out-point.
+	struct MappedResource {
+		QUuid assetId;
+		float in;
+		float out;
+		int generation; // of the ParsedDocument the items were taken from
+		QVector<TTMLelem> items;
+		int lastUsedRun;
+	};
+	//! Parses the asset unless its files are unchanged since the last parse. Returns NULL if the asset has no readable document.
+	const ParsedDocument* GetParsedDocument(const QSharedPointer<AssetMxfTrack> &rAsset);
+	//! Sets frame rate, document and the items within in- and out-point of rResource.
+	void MapResource(const QUuid &rResourceId, const QSharedPointer<AssetMxfTrack> &rAsset, TTMLtimelineResource &rResource);
+	void PruneCaches();
+
+	QHash<QUuid, ParsedDocument> mParsedDocuments; // asset id -> document
+	QHash<QUuid, MappedResource> mMappedResources; // resource id -> items
+	int mRun;
 };
\ No newline at end of file
@@ -314,6 +314,7 @@ int WidgetCentral::ShowCplEditor(const QUuid &rCplAssetId) {
 			return i;
 		}
 	}
+	mpImfPackage->WaitForMetadata(rCplAssetId); // The composition needs the metadata of all referenced tracks.
 	WidgetComposition *p_widget = new WidgetComposition(mpImfPackage, rCplAssetId);
 	QSharedPointer<Asset> asset = mpImfPackage->GetAsset(rCplAssetId);
 	ImfError error = p_widget->Read();
@@ -15,6 +15,7 @@
  */
 #include "WidgetImagePreview.h"
 #include "global.h"
+#include "TTMLImageCache.h"
 #include <QOpenGLContext>
 #include <QOpenGLFunctions>
 #include <QApplication>
@@ -79,6 +80,25 @@ void WidgetImagePreview::resizeGL(int w, int h) {
 	f = QOpenGLContext::currentContext()->functions();
 	f->glViewport(0, 0, (GLint)w, (GLint)h);
 	repaint();
+	emit viewportResized(GetViewportSize());
+}
+
+QSize WidgetImagePreview::GetViewportSize() const {
+
+	return size() * devicePixelRatioF();
+}
+
+QRect WidgetImagePreview::GetVisibleArea(const QSize &rImageSize) const {
+
+	if (scaling || rImageSize.isEmpty()) return QRect();
+	// images are drawn 1:1 in device independent pixels, see paintGL()
+	const int overflow_x = qMax(0, rImageSize.width() - width());
+	const int overflow_y = qMax(0, rImageSize.height() - height());
+	const int column = extract_area % 3; // left, center, right
+	const int row = extract_area / 3; // top, center, bottom
+	const int left = (column == 0) ? 0 : (column == 1 ? overflow_x / 2 : overflow_x);
+	const int top = (row == 0) ? 0 : (row == 1 ? overflow_y / 2 : overflow_y);
+	return QRect(left, top, qMin(rImageSize.width(), width()), qMin(rImageSize.height(), height()));
 }
 
 void WidgetImagePreview::paintGL() {
@@ -159,8 +179,8 @@ void WidgetImagePreview::paintRegions(QPainter &painter, const QRect rect_viewpo
 			int region_height = qRound(ttml_regions[i].extent[1] * ((float)frame_size.height() / 100));
 
 			if (!ttml_regions[i].bgImage.isNull()) {
-				// set background image
-				ttml_regions[i].bgImageScaled = ttml_regions[i].bgImage.scaled(QSize(region_width, region_height),Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+				// set background image, scaled copies are cached per viewport size
+				ttml_regions[i].bgImageScaled = TTMLImageCache::GetGlobalInstance()->GetScaled(ttml_regions[i].bgImage, QSize(region_width, region_height));
 				painter.drawImage(QPoint(region_left, region_top), ttml_regions[i].bgImageScaled);
 			}
 			else if(show_ttml_regions){
@@ -40,6 +40,10 @@ public:
 	void setScaling(bool);
 	void setExtract(int);
 	void saveImage();
+	//! Size of the preview area in device pixels.
+	QSize GetViewportSize() const;
+	//! Part of an image of rImageSize which is visible without scaling (see WidgetImagePreview::setExtract()). Returns a null rect if the image is scaled to fit.
+	QRect GetVisibleArea(const QSize &rImageSize) const;
 
 	QVector<TTMLRegion> ttml_regions; // list of TTML regions
 
@@ -53,6 +57,7 @@ public slots:
 
 signals:
 	void keyPressed(QKeyEvent *pEvent);
+	void viewportResized(const QSize &rSize); // [device pixels]
 
 protected:
 
@@ -22,6 +22,7 @@
 #include "WidgetComposition.h"
 #include "UndoProxyModel.h"
 #include "JobQueue.h"
+#include "HashEngine.h"
 #include "Jobs.h"
 #include <QStringList>
 #include <QVBoxLayout>
@@ -306,12 +307,14 @@ void WidgetImpBrowser::Save() {
 		if(ret == QMessageBox::Ok) {
 			mpJobQueue->FlushQueue();
 			for(int i = 0; i < mpImfPackage->GetAssetCount(); i++) {
+				AbstractJob *p_wrap_job_asset = NULL; // The hash must not be calculated before the asset is wrapped.
 				QSharedPointer<AssetMxfTrack> mxf_asset = mpImfPackage->GetAsset(i).objectCast<AssetMxfTrack>();
 				if(mxf_asset && mxf_asset->Exists() == false) {
 					if(mxf_asset->GetEssenceType() == Metadata::Pcm) {
 						JobWrapWav *p_wrap_job = new JobWrapWav(mxf_asset->GetSourceFiles(), mxf_asset->GetPath().absoluteFilePath(), mxf_asset->GetSoundfieldGroup(), mxf_asset->GetId(), mxf_asset->GetLanguageTag(), mxf_asset->GetMCATitle(), mxf_asset->GetMCATitleVersion(), mxf_asset->GetMCAAudioContentKind(), mxf_asset->GetMCAAudioElementKind());
 						connect(p_wrap_job, SIGNAL(Success()), mxf_asset.data(), SLOT(FileModified()));
 						mpJobQueue->AddJob(p_wrap_job);
+						p_wrap_job_asset = p_wrap_job;
 					}
 
 
@@ -320,14 +323,22 @@ void WidgetImpBrowser::Save() {
 						JobWrapTimedText *p_wrap_job = new JobWrapTimedText(mxf_asset->GetSourceFiles(), mxf_asset->GetPath().absoluteFilePath(), mxf_asset->GetEditRate(), mxf_asset->GetDuration(), mxf_asset->GetId(), mxf_asset->GetProfile(), mxf_asset->GetLanguageTag());
 						connect(p_wrap_job, SIGNAL(Success()), mxf_asset.data(), SLOT(FileModified()));
 						mpJobQueue->AddJob(p_wrap_job);
+						p_wrap_job_asset = p_wrap_job;
 					}
 						/* -----Denis Manthey End----- */
 
 				}
 				QSharedPointer<Asset> abstract_asset = mpImfPackage->GetAsset(i);
 				if(abstract_asset && abstract_asset->NeedsNewHash() && abstract_asset->GetType() != Asset::pkl) {
+					// Unchanged files don't have to be read again.
+					QByteArray cached_hash = (p_wrap_job_asset == NULL) ? HashCache::GetGlobalInstance()->Lookup(abstract_asset->GetPath()) : QByteArray();
+					if(cached_hash.isEmpty() == false) {
+						abstract_asset->SetHash(cached_hash);
+						continue;
+					}
 					JobCalculateHash *p_hash_job = new JobCalculateHash(abstract_asset->GetPath().absoluteFilePath());
 					connect(p_hash_job, SIGNAL(Result(const QByteArray&, const QVariant&)), abstract_asset.data(), SLOT(SetHash(const QByteArray&)));
+					p_hash_job->AddDependency(p_wrap_job_asset);
 					mpJobQueue->AddJob(p_hash_job);
 				}
 			}
@@ -568,6 +579,7 @@ void WidgetImpBrowser::rMapCurrentRowSelectionChanged(const QModelIndex &rCurren
 void WidgetImpBrowser::rJobQueueFinished() {
 
 	mpProgressDialog->reset();
+	HashCache::GetGlobalInstance()->Save();
 	QString error_msg;
 	QList<Error> errors = mpJobQueue->GetErrors();
 	for(int i = 0; i < errors.size(); i++) {
@@ -758,6 +770,12 @@ void WidgetImpBrowser::RecalcHashForCpls() {
 	for(int i = 0; i < mpImfPackage->GetAssetCount(); i++) {
 		QSharedPointer<AssetCpl> asset_cpl = mpImfPackage->GetAsset(i).objectCast<AssetCpl>();
 		if(asset_cpl && asset_cpl->NeedsNewHash() ) {
+			QByteArray cached_hash = HashCache::GetGlobalInstance()->Lookup(asset_cpl->GetPath());
+			if(cached_hash.isEmpty() == false) {
+				asset_cpl->SetHash(cached_hash);
+				asset_cpl->SetIsNewOrModified(false);
+				continue;
+			}
 			JobCalculateHash *p_hash_job = new JobCalculateHash(asset_cpl->GetPath().absoluteFilePath());
 			connect(p_hash_job, SIGNAL(Result(const QByteArray&, const QVariant&)), asset_cpl.data(), SLOT(SetHash(const QByteArray&)));
 			mpJobQueue->AddJob(p_hash_job);
@@ -25,8 +25,10 @@
 #include <QCheckBox>
 #include "JP2K_Preview.h"
 #include "ImfPackage.h"
+#include "TTMLImageCache.h"
 #include <QThread>
 #include <QLineEdit>
+#include <limits>
 
 //#define DEBUG_JP2K
 
@@ -52,6 +54,7 @@ WidgetVideoPreview::WidgetVideoPreview(QWidget *pParent) : QWidget(pParent) {
 	playerThread = new QThread();
 	player->moveToThread(playerThread);
 	player->setLayer(decode_layer); // set default layer
+	player->setAdaptiveQuality(adaptive_quality);
 
 	connect(playerThread, SIGNAL(started()), player, SLOT(startPlay()));
 	connect(player, SIGNAL(currentPlayerPosition(qint64, bool)), this, SLOT(forwardPlayerPosition(qint64, bool)));
@@ -88,6 +91,7 @@ void WidgetVideoPreview::InitLayout() {
 	connect(decoders[0], SIGNAL(ShowFrame(const QImage&)), mpImagePreview, SLOT(ShowImage(const QImage&))); // decoder -> glWidget
 	connect(decoders[1], SIGNAL(ShowFrame(const QImage&)), mpImagePreview, SLOT(ShowImage(const QImage&))); // decoder -> glWidget
 	connect(mpImagePreview, SIGNAL(keyPressed(QKeyEvent*)), this, SLOT(keyPressEvent(QKeyEvent*)));
+	connect(mpImagePreview, SIGNAL(viewportResized(const QSize&)), this, SLOT(rViewportResized(const QSize&)));
 
 	// create menue bar
 	menuBar = new QMenuBar(this);
@@ -429,20 +433,28 @@ void WidgetVideoPreview::Clear() {
 }
 
 void WidgetVideoPreview::InstallImp() {
-	menuQuality->clear(); // clear prev. resolutions from menu
+	clearQualityMenu(); // clear prev. resolutions from menu
 }
 
 void WidgetVideoPreview::UninstallImp() {
-	menuQuality->clear(); // clear prev. resolutions from menu
+	clearQualityMenu(); // clear prev. resolutions from menu
 	mpImagePreview->Clear();
 }
 
+void WidgetVideoPreview::clearQualityMenu() {
+
+	menuQuality->clear(); // deletes the actions owned by the menu
+	quality_auto = NULL;
+	quality_adaptive = NULL;
+	for (int i = 0; i <= 5; i++) qualities[i] = NULL;
+}
+
 void WidgetVideoPreview::setPlaylist(QVector<VideoResource> &rPlayList, QVector<TTMLtimelineResource> &rTTMLs) {
 
 	ttmls = &rTTMLs; // set timed text elements
 	currentPlaylist = rPlayList; // set playlist
 	player->setPlaylist(rPlayList); // set playlist in player
-	menuQuality->clear(); // clear prev. resolutions from menu
+	clearQualityMenu(); // clear prev. resolutions from menu
 	current_playlist_index = 0; // set to first item in playlist 
 
 	// create array of TTMLtracks
@@ -452,6 +464,7 @@ void WidgetVideoPreview::setPlaylist(QVector<VideoResource> &rPlayList, QVector<
 	for (int i = 0; i < ttmls->length(); i++) {
 		ttml_tracks[ ttmls->at(i).track_index ].append(ttmls->at(i));
 	}
+	ttml_index.Build(ttml_tracks, CPLEditRate); // getTTML() and rPrevNextSubClicked() query the index
 
 	if (rPlayList.length() > 0) {
 		
@@ -479,13 +492,35 @@ void WidgetVideoPreview::setPlaylist(QVector<VideoResource> &rPlayList, QVector<
 			height = rPlayList.at(count).asset->GetMetadata().storedHeight;
 		}
 
+		// the codestream is reduced based on the stored size
+		if (rPlayList.at(count).asset->GetMetadata().storedWidth > 0) {
+			frame_size = QSize(rPlayList.at(count).asset->GetMetadata().storedWidth, rPlayList.at(count).asset->GetMetadata().storedHeight);
+		}
+		else {
+			frame_size = QSize(width, height);
+		}
+
+		quality_auto = new QAction(tr("Auto (fit to preview)"), menuQuality);
+		quality_auto->setData(-1);
+		quality_auto->setCheckable(true);
+		quality_auto->setChecked(auto_layer);
+		menuQuality->addAction(quality_auto);
+		quality_adaptive = new QAction(tr("Adapt to decoding speed"), menuQuality);
+		quality_adaptive->setData(-2);
+		quality_adaptive->setCheckable(true);
+		quality_adaptive->setChecked(adaptive_quality);
+		menuQuality->addAction(quality_adaptive);
+		menuQuality->addSeparator();
+		updateAutoLayer();
+		updateDecodeArea();
+
 		for (int i = 0; i <= 5; i++) {
 			int w = width / pow(2, i);
 			int h = height / pow(2, i);
-			qualities[i] = new QAction(QString("%1 x %2").arg(w).arg(h)); // create new action
+			qualities[i] = new QAction(QString("%1 x %2").arg(w).arg(h), menuQuality); // create new action (owned by the menu)
 			qualities[i]->setData(i);
 			qualities[i]->setCheckable(true);
-			if (i == decode_layer) qualities[i]->setChecked(true); // default
+			if (i == decode_layer && !auto_layer) qualities[i]->setChecked(true); // default
 			menuQuality->addAction(qualities[i]);
 		}
 
@@ -540,26 +575,81 @@ void WidgetVideoPreview::rChangeSpeed(QAction *action) {
 
 void WidgetVideoPreview::rChangeQuality(QAction *action) {
 
-	if (decode_layer != action->data().value<int>()) {
-		qualities[decode_layer]->setChecked(false); // uncheck 'old' layer
-
-		decode_layer = action->data().value<int>();
-		player->setLayer(decode_layer);
-		decoders[0]->setLayer(decode_layer);
-		decoders[1]->setLayer(decode_layer);
+	int layer = action->data().value<int>();
 
-		// reload the same frame again (if player is not playing)
-		if (!player->playing) {
-			now_running = !now_running; // use same decoder (relevant frame is still set)
-			decodingThreads[(int)now_running]->start(QThread::HighestPriority); // start decoder (again)
-			decoding_time->setText("loading...");
-		}
+	if (layer == -2) { // adaptive quality during playback
+		adaptive_quality = action->isChecked();
+		player->setAdaptiveQuality(adaptive_quality);
+	}
+	else if (layer < 0) { // auto
+		auto_layer = true;
+		quality_auto->setChecked(true);
+		qualities[decode_layer]->setChecked(false); // uncheck 'old' layer
+		if (updateAutoLayer()) reloadPreview();
+	}
+	else if (auto_layer || decode_layer != layer) {
+		auto_layer = false;
+		quality_auto->setChecked(false);
+		qualities[decode_layer]->setChecked(false); // uncheck 'old' layer
+		qualities[layer]->setChecked(true);
+		if (applyDecodeLayer(layer)) reloadPreview();
 	}
 	else {
 		qualities[decode_layer]->setChecked(true); // check again!
 	}
 }
 
+bool WidgetVideoPreview::applyDecodeLayer(int layer) {
+
+	if (layer == decode_layer) return false;
+	decode_layer = layer;
+	player->setLayer(decode_layer);
+	decoders[0]->setLayer(decode_layer);
+	decoders[1]->setLayer(decode_layer);
+	updateDecodeArea(); // depends on the size of the reduced frame
+	return true;
+}
+
+bool WidgetVideoPreview::updateAutoLayer() {
+
+	if (!auto_layer || frame_size.isEmpty()) return false;
+	int layer = 0; // 1:1 if the image isn't scaled to the preview
+	if (processing_extract_actions[1]->isChecked()) {
+		layer = JP2::ReductionForViewport(frame_size, mpImagePreview->GetViewportSize(), 5);
+	}
+	return applyDecodeLayer(layer);
+}
+
+bool WidgetVideoPreview::updateDecodeArea() {
+
+	QRect area; // null: decode the whole frame
+	if (!frame_size.isEmpty()) {
+		const int scale = 1 << decode_layer;
+		area = mpImagePreview->GetVisibleArea(QSize((frame_size.width() + scale - 1) / scale, (frame_size.height() + scale - 1) / scale));
+	}
+	if (area == decoders[0]->getDecodeArea() && area == decoders[1]->getDecodeArea()) return false;
+	decoders[0]->setDecodeArea(area);
+	decoders[1]->setDecodeArea(area);
+	return true;
+}
+
+void WidgetVideoPreview::reloadPreview() {
+
+	// reload the same frame again (if player is not playing)
+	if (!player->playing && currentPlaylist.length() > 0) {
+		now_running = !now_running; // use same decoder (relevant frame is still set)
+		decodingThreads[(int)now_running]->start(QThread::HighestPriority); // start decoder (again)
+		decoding_time->setText("loading...");
+	}
+}
+
+void WidgetVideoPreview::rViewportResized(const QSize &rSize) {
+
+	const bool layer_changed = updateAutoLayer();
+	const bool area_changed = updateDecodeArea();
+	if (layer_changed || area_changed) reloadPreview();
+}
+
 void WidgetVideoPreview::rChangeProcessing(QAction *action) {
 	
 	int nr = action->data().value<int>();
@@ -585,6 +675,7 @@ void WidgetVideoPreview::rChangeProcessing(QAction *action) {
 			processing_extract_action = 10;
 			mpImagePreview->setExtract(4);
 		}
+		if (updateAutoLayer() | updateDecodeArea()) reloadPreview();
 		break;
 	case 2:
 		player->show_subtitles = action->isChecked();
@@ -636,6 +727,7 @@ void WidgetVideoPreview::rChangeProcessing(QAction *action) {
 		if(processing_extract_action != nr) processing_extract_actions[processing_extract_action]->setChecked(false); // uncheck 'old' option
 		processing_extract_action = nr;
 		mpImagePreview->setExtract((nr - 6));
+		if (updateAutoLayer() | updateDecodeArea()) reloadPreview();
 	}
 }
 
@@ -649,72 +741,70 @@ void WidgetVideoPreview::getTTML() {
 
 	float frac_sec;
 	double seconds, rel_time;
-	int rel_frame;
 	QString h, m, s, f;
 
-	// loop tracks
-	QMap<int, QVector<TTMLtimelineResource>>::iterator x;
-	for (x = ttml_tracks.begin(); x != ttml_tracks.end(); ++x) { // i.key(), i.value()
-
-		// loop segments in track
-		for (int i = 0; i < x.value().length(); i++) {
-
-			TTMLtimelineResource resource = x.value().at(i);
-
-			float beg_rounded = ceil(qRound(resource.timeline_in * CPLEditRate * 100.f) / 100.f);
-			float end_rounded = ceil(qRound(resource.timeline_out * CPLEditRate * 100.f) / 100.f);
+	// visible segments and their visible tt elements
+	QVector<TTMLIndex::Visible> visible;
+	ttml_index.GetVisible(xSliderTotal, visible);
 
-			// loop tt elements within segment
-			if (xSliderTotal >= beg_rounded && xSliderTotal < end_rounded) {
-				// visible segment found -> search inside segment
+	for (int i = 0; i < visible.length(); i++) {
 
-				visibleTTtrack tt;
-				tt.resource = resource;
+		const TTMLtimelineResource &resource = ttml_tracks.constFind(visible.at(i).track).value().at(visible.at(i).resource);
 
-				if (resource.RepeatCount > 0) { // RepeatCount != 0
-					if (modf((time - resource.timeline_in) / (resource.out - resource.in), &seconds) > 0.99) {
-						rel_time = resource.in;
-					}
-					else {
-						rel_time = modf((time - resource.timeline_in) / (resource.out - resource.in), &seconds) * (resource.out - resource.in) + resource.in;
-					}
-					rel_frame = (qRound((time - resource.timeline_in)*CPLEditRate) % qRound((resource.out - resource.in) * CPLEditRate)) + resource.in * CPLEditRate;
-				}
-				else { // no repeating elements
-					rel_time = ((time - resource.timeline_in) + resource.in);
-					rel_frame = qRound(((time - resource.timeline_in) + resource.in)*CPLEditRate);
-				}
+		visibleTTtrack tt;
+		tt.resource = resource;
 
-				frac_sec = modf(rel_time, &seconds);
+		if (resource.RepeatCount > 0) { // RepeatCount != 0
+			if (modf((time - resource.timeline_in) / (resource.out - resource.in), &seconds) > 0.99) {
+				rel_time = resource.in;
+			}
+			else {
+				rel_time = modf((time - resource.timeline_in) / (resource.out - resource.in), &seconds) * (resource.out - resource.in) + resource.in;
+			}
+		}
+		else { // no repeating elements
+			rel_time = ((time - resource.timeline_in) + resource.in);
+		}
 
-				h = QString("%1").arg((int)(seconds / 3600.0f), 2, 10, QChar('0')); // hours
-				m = QString("%1").arg((int)(seconds / 60.0f), 2, 10, QChar('0')); // minutes
-				s = QString("%1").arg((int)(seconds) % 60, 2, 10, QChar('0')); // seconds
-				tt.formatted_time = QString("%1 : %2 : %3").arg(h).arg(m).arg(s); // ttml timecode
-				tt.fractional_frames = QString::number(qRound(frac_sec * resource.frameRate * (float)100) / (float)100, 'f', 2);
+		frac_sec = modf(rel_time, &seconds);
 
-				for (int z = 0; z < resource.items.length(); z++) {
+		h = QString("%1").arg((int)(seconds / 3600.0f), 2, 10, QChar('0')); // hours
+		m = QString("%1").arg((int)(seconds / 60.0f), 2, 10, QChar('0')); // minutes
+		s = QString("%1").arg((int)(seconds) % 60, 2, 10, QChar('0')); // seconds
+		tt.formatted_time = QString("%1 : %2 : %3").arg(h).arg(m).arg(s); // ttml timecode
+		tt.fractional_frames = QString::number(qRound(frac_sec * resource.frameRate * (float)100) / (float)100, 'f', 2);
 
-					TTMLelem ttelem = resource.items.at(z);
-					float beg_rounded = ceil(qRound(ttelem.beg * CPLEditRate * 100.f) / 100.f);
-					float end_rounded = ceil(qRound(ttelem.end * CPLEditRate * 100.f) / 100.f);
+		for (int z = 0; z < visible.at(i).items.length(); z++) {
 
-					if (rel_frame >= beg_rounded && rel_frame < end_rounded) {
+			const TTMLelem &ttelem = resource.items.at(visible.at(i).items.at(z));
 
-						// add visible element
-						tt.elements.append(ttelem);
+			// add visible element
+			tt.elements.append(ttelem);
 
-						if (ttelem.type == 1) {
-							ttelem.region.bgImage = ttelem.bgImage; // image
-						}
+			// append region
+			mpImagePreview->ttml_regions.append(ttelem.region);
+			if (ttelem.type == 1) {
+				tt.elements.last().bgImage = TTMLImageCache::GetGlobalInstance()->Get(TTMLImageKey(ttelem.bgImageFile, ttelem.bgImageId)); // decoded on first use only
+				mpImagePreview->ttml_regions.last().bgImage = tt.elements.last().bgImage; // image
+			}
+		}
+		current_tt.append(tt); // add visible track
+	}
 
-						// append region
-						mpImagePreview->ttml_regions.append(ttelem.region);
-					}
-				}
-				current_tt.append(tt); // add visible track
+	// decode the images of the next cue in the background
+	qint64 next_cue = 0;
+	if (ttml_index.GetNextCue(xSliderTotal, next_cue)) {
+		QVector<TTMLIndex::Visible> upcoming;
+		ttml_index.GetVisible(next_cue, upcoming);
+		QList<TTMLImageKey> keys;
+		for (int i = 0; i < upcoming.length(); i++) {
+			const TTMLtimelineResource &resource = ttml_tracks.constFind(upcoming.at(i).track).value().at(upcoming.at(i).resource);
+			for (int z = 0; z < upcoming.at(i).items.length(); z++) {
+				const TTMLelem &ttelem = resource.items.at(upcoming.at(i).items.at(z));
+				if (ttelem.type == 1) keys.append(TTMLImageKey(ttelem.bgImageFile, ttelem.bgImageId));
 			}
 		}
+		TTMLImageCache::GetGlobalInstance()->Prefetch(keys);
 	}
 
 	emit ttmlChanged(current_tt, ttml_search_time.elapsed());
@@ -722,80 +812,17 @@ void WidgetVideoPreview::getTTML() {
 
 void WidgetVideoPreview::rPrevNextSubClicked(bool direction) {
 
-	// calculate frame indicator time
-	float next = -1, prev = -1, item_begin = 0;
-	int repeat = 1;
-
-	// loop tracks
-	QMap<int, QVector<TTMLtimelineResource>>::iterator x;
-	for (x = ttml_tracks.begin(); x != ttml_tracks.end(); ++x) { // i.key(), i.value()
-		// loop resources within track
-		for (int i = 0; i < x.value().count(); i++) {
-			TTMLtimelineResource resource = x.value().at(i);
-
-			if (resource.RepeatCount > 1) {
-				repeat = resource.RepeatCount;
-			}
-			else {
-				repeat = 1; // default
-			}
-#ifdef DEBUG_JP2K
-					qDebug() << "resource.in" << resource.in << "resource.timeline_in" << resource.timeline_in
-							<< "resource.out" << resource.out << "resource.timeline_out" << resource.timeline_out;
-#endif
-
-			// loop repeated elements
-			for (int ii = 0; ii < repeat; ii++) {
-				// loop items within resource
-				for (int iii = 0; iii < resource.items.length(); iii++) {
-					item_begin = ceil(qRound((resource.items.at(iii).beg - resource.in + resource.timeline_in) * CPLEditRate * 100.f) / 100.f) + qRound((resource.out - resource.in)*ii * CPLEditRate);
-					if (item_begin < 0) item_begin = 0;
-#ifdef DEBUG_JP2K
-					qDebug() << "item" << item_begin << "resource.items.at(iii).beg" << resource.items.at(iii).beg;
-#endif
-
-					if (prev == -1) {
-						prev = item_begin; // initialize prev
-#ifdef DEBUG_JP2K
-						qDebug() << "init prev.";
-#endif
-					}
-
-					if (next == -1 && item_begin > xSliderTotal) { // make sure there is at least one frame difference to current frame
-						next = item_begin; // initialize next
-#ifdef DEBUG_JP2K
-						qDebug() << "init next.";
-#endif
-					}
-
-					if (item_begin < xSliderTotal && item_begin > prev) { // make sure there is at least one frame difference to current frame
-						prev = item_begin;
-#ifdef DEBUG_JP2K
-						qDebug() << "update prev.";
-#endif
-					}
-				}
-			}
-		}
-	}
-#ifdef DEBUG_JP2K
-	qDebug() << "CPL fps:" << CPLEditRate << "frame indicator" << xSliderTotal << "prev" << prev << "next" << next;
-#endif
-
-	if (next == -1) { // no next found, use last time
-		next = item_begin;
-	}
-
-	if (direction == true) { 
-		emit currentPlayerPosition(next); // next
-#ifdef DEBUG_JP2K
-		qDebug() << "set NEXT to qRound of:" << (next * CPLEditRate);
-#endif
+	// make sure there is at least one frame difference to current frame
+	qint64 cue = 0;
+	if (direction == true) {
+		if (!ttml_index.GetNextCue(xSliderTotal, cue) && !ttml_index.GetPreviousCue(std::numeric_limits<qint64>::max(), cue)) return; // no next found, use last cue
+		emit currentPlayerPosition(cue); // next
 	}
 	else {
-		emit currentPlayerPosition(prev); // previous
+		if (!ttml_index.GetPreviousCue(xSliderTotal, cue) && !ttml_index.GetNextCue(-1, cue)) return; // no previous found, use first cue
+		emit currentPlayerPosition(cue); // previous
+	}
 #ifdef DEBUG_JP2K
-		qDebug() << "set PREV to qRound of:" << (prev * CPLEditRate);
+	qDebug() << "CPL fps:" << CPLEditRate << "frame indicator" << xSliderTotal << "cue" << cue;
 #endif
-	}
 }
@@ -20,6 +20,7 @@
 #include <QThread>
 #include "JP2K_Preview.h"
 #include "JP2K_Player.h"
+#include "TTMLIndex.h"
 #include "qcombobox.h"
 #include "qxmlstream.h"
 #include <QMenuBar>
@@ -66,18 +67,25 @@ private slots:
 	void decodingStatus(qint64, QString);
 	void stopPlayback(bool clicked);
 	void rViewFullScreen();
+	void rViewportResized(const QSize&);
 public slots:
 	virtual void keyPressEvent(QKeyEvent *pEvent);
 
 private:
 	Q_DISABLE_COPY(WidgetVideoPreview);
 	void InitLayout();
+	bool applyDecodeLayer(int layer); // returns true if the layer changed
+	bool updateAutoLayer(); // returns true if the layer changed
+	bool updateDecodeArea(); // returns true if the visible area of the unscaled preview changed
+	void reloadPreview(); // decode the current frame again (if player is not playing)
+	void clearQualityMenu(); // deletes the resolution actions of the previous playlist
 
 	// TTML
 	bool showTTML = true;
 	QVector<TTMLtimelineResource> *ttmls;
 	QVector<visibleTTtrack> current_tt; // currently visible timed text elements
 	QMap<int, QVector<TTMLtimelineResource>> ttml_tracks;
+	TTMLIndex ttml_index; // visible elements and cues of ttml_tracks in CPL edit units
 	QTime ttml_search_time;
 	qint64 next_ttml;
 	qint64 prev_ttml;
@@ -90,7 +98,9 @@ private:
 	QMenu *menuSpeed;
 	QAction *speeds[50];
 	QMenu *menuQuality;
-	QAction *qualities[5];
+	QAction *qualities[6];
+	QAction *quality_auto = NULL;
+	QAction *quality_adaptive = NULL;
 	QMenu *menuProcessing;
 	QMenu *menuView;
 	QAction *view_actions[1];
@@ -109,6 +119,9 @@ private:
 
 	// player
 	int decode_layer = 3; // default
+	bool auto_layer = true; // derive decode_layer from the preview size (default)
+	bool adaptive_quality = true; // player lowers the quality below decode_layer to hold the frame rate (default)
+	QSize frame_size; // stored frame size of the current playlist
 	int decode_speed = 5; // default (fps in player)
 	QThread *playerThread;
 	int current_playlist_index = 0; // frame indicator position within the playlisqt
@@ -41,6 +41,9 @@
 #define IMFTOOL
 
 #define XML_NAMESPACE_CPL "http://www.smpte-ra.org/schemas/2067-3/2016"
+#define XML_NAMESPACE_CPL_2013 "http://www.smpte-ra.org/schemas/2067-3/2013"
+#define XML_NAMESPACE_CC_2013 "http://www.smpte-ra.org/schemas/2067-2/2013"
+#define XML_NAMESPACE_OPL "http://www.smpte-ra.org/schemas/2067-100/2014"
 #define XML_NAMESPACE_AM "http://www.smpte-ra.org/schemas/429-9/2007/AM"
 #define XML_NAMESPACE_PKL "http://www.smpte-ra.org/schemas/2067-2/2016/PKL"
 #define XML_NAMESPACE_DCML "http://www.smpte-ra.org/schemas/433/2008/dcmlTypes/"
@@ -179,6 +179,7 @@ int main(int argc, char *argv[]) {
 	qRegisterMetaType<EditRate>("EditRate");
 	qRegisterMetaType<Timecode>("Timecode");
 	qRegisterMetaType<Duration>("Duration");
+	qRegisterMetaType<QList<QImage> >("QList<QImage>");
 	qRegisterMetaType<WizardResourceGenerator::eMode>("WizardResourceGenerator::eMode");
 
 	xercesc::XMLPlatformUtils::Initialize();